@@ -0,0 +1,200 @@
+/*
+    Substring search of byte arrays with wildcards.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include "bytesearch.h"
+#include "common.h"
+
+/* below this skip, Horspool is slower than memchr() on a rare byte */
+#define HORSPOOL_MIN_SHIFT (16)
+
+/* a run of fixed bytes of the pattern */
+typedef struct {
+    size_t offset;
+    size_t len;
+} segment_t;
+
+struct sm_bytesearch {
+    uint8_t *bytes;
+    uint8_t *masks;             /* of the bytes neither FIXED nor WILDCARD */
+    size_t len;
+    segment_t *segments;
+    size_t nsegments;
+    size_t *masked;             /* offsets of the masked bytes */
+    size_t nmasked;
+    bool has_anchor;
+    size_t anchor;              /* offset of the rarest fixed byte */
+    bool horspool;
+    size_t window;              /* up to the last byte which isn't a wildcard */
+    size_t shift[256];          /* by the last byte of the window */
+};
+
+/* how common a byte is in process memory, roughly: zeroes and all-ones,
+ * then small numbers and the bytes of pointers, then text */
+static unsigned commonness(uint8_t b)
+{
+    if (b == 0x00 || b == 0xff)
+        return 3;
+    if (b < 0x10 || b >= 0xf0 || b == 0x7f || b == 0x55 || b == 0x56)
+        return 2;
+    if (isalnum(b) || b == ' ')
+        return 1;
+    return 0;
+}
+
+sm_bytesearch_t *sm_bytesearch_new(const uint8_t *bytes, const wildcard_t *wildcards, size_t len)
+{
+    sm_bytesearch_t *s;
+    size_t i, c, last_wildcard = 0, max_shift;
+    bool has_wildcard = false;
+
+    if (len == 0 || (s = calloc(1, sizeof(sm_bytesearch_t))) == NULL)
+        return NULL;
+    if ((s->bytes = malloc(len)) == NULL ||
+        (s->masks = malloc(len)) == NULL ||
+        (s->segments = malloc((len + 1) / 2 * sizeof(segment_t))) == NULL ||
+        (s->masked = malloc(len * sizeof(size_t))) == NULL) {
+        sm_bytesearch_free(s);
+        return NULL;
+    }
+    memcpy(s->bytes, bytes, len);
+    s->len = len;
+
+    /* split the pattern in runs of fixed bytes and pick the anchor */
+    for (i = 0; i < len; i++) {
+        s->masks[i] = wildcards ? wildcards[i] : FIXED;
+        if (s->masks[i] == WILDCARD)
+            continue;
+        s->window = i + 1;
+        if (s->masks[i] != FIXED) {
+            s->masked[s->nmasked++] = i;
+            continue;
+        }
+        if (s->nsegments == 0 ||
+            s->segments[s->nsegments - 1].offset + s->segments[s->nsegments - 1].len != i) {
+            s->segments[s->nsegments].offset = i;
+            s->segments[s->nsegments].len = 0;
+            s->nsegments++;
+        }
+        s->segments[s->nsegments - 1].len++;
+        if (!s->has_anchor || commonness(bytes[i]) < commonness(bytes[s->anchor]))
+            s->anchor = i;
+        s->has_anchor = true;
+    }
+    if (s->window == 0)
+        return s;
+
+    /* a window can be skipped up to the last wildcard, which matches anything */
+    for (i = 0; i + 1 < s->window; i++) {
+        if (s->masks[i] == WILDCARD) {
+            has_wildcard = true;
+            last_wildcard = i;
+        }
+    }
+    max_shift = has_wildcard ? s->window - 1 - last_wildcard : s->window;
+
+    /* masked bytes can't be looked for with memchr() */
+    s->horspool = (max_shift >= HORSPOOL_MIN_SHIFT || !s->has_anchor);
+    if (s->horspool) {
+        for (c = 0; c < 256; c++)
+            s->shift[c] = max_shift;
+        for (i = s->window - max_shift; i + 1 < s->window; i++) {
+            if (s->masks[i] == FIXED) {
+                s->shift[bytes[i]] = s->window - 1 - i;
+                continue;
+            }
+            for (c = 0; c < 256; c++) {
+                if ((c & s->masks[i]) == bytes[i])
+                    s->shift[c] = s->window - 1 - i;
+            }
+        }
+    }
+    return s;
+}
+
+void sm_bytesearch_free(sm_bytesearch_t *s)
+{
+    if (s == NULL)
+        return;
+    free(s->bytes);
+    free(s->masks);
+    free(s->segments);
+    free(s->masked);
+    free(s);
+}
+
+static inline bool matches_at(const sm_bytesearch_t *s, const uint8_t *data)
+{
+    size_t i;
+
+    for (i = 0; i < s->nsegments; i++) {
+        if (memcmp(data + s->segments[i].offset, s->bytes + s->segments[i].offset,
+                   s->segments[i].len) != 0)
+            return false;
+    }
+    for (i = 0; i < s->nmasked; i++) {
+        size_t offset = s->masked[i];
+        if ((data[offset] & s->masks[offset]) != s->bytes[offset])
+            return false;
+    }
+    return true;
+}
+
+size_t sm_bytesearch_next(const sm_bytesearch_t *s, const uint8_t *data, size_t size,
+                          size_t from, size_t limit)
+{
+    size_t end, pos = from;
+
+    if (s->len > size)
+        return limit;
+    /* past the last start where the whole pattern fits */
+    end = MIN(limit, size - s->len + 1);
+
+    if (s->window == 0)
+        return (pos < end) ? pos : limit;
+
+    if (s->horspool) {
+        const uint8_t last = s->bytes[s->window - 1], last_mask = s->masks[s->window - 1];
+        while (pos < end) {
+            uint8_t c = data[pos + s->window - 1];
+            if ((c & last_mask) == last && matches_at(s, data + pos))
+                return pos;
+            pos += s->shift[c];
+        }
+    }
+    else {
+        const uint8_t anchor = s->bytes[s->anchor];
+        while (pos < end) {
+            const uint8_t *hit = memchr(data + pos + s->anchor, anchor, end - pos);
+            if (hit == NULL)
+                break;
+            pos = hit - data - s->anchor;
+            if (matches_at(s, data + pos))
+                return pos;
+            pos++;
+        }
+    }
+    return limit;
+}
@@ -0,0 +1,50 @@
+/*
+    Substring search of byte arrays with wildcards.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BYTESEARCH_H
+#define BYTESEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "value.h"
+
+typedef struct sm_bytesearch sm_bytesearch_t;
+
+/*
+ * Prepare the search of the `len` bytes of `bytes`, where the bytes are
+ * compared after being ANDed with their `wildcards` entry, as in bytearray
+ * scans; `wildcards` may be NULL.
+ * Patterns with a long end without wildcards are searched Horspool-style,
+ * skipping up to that end at once, the others by looking with memchr() for
+ * their rarest fixed byte.
+ */
+sm_bytesearch_t *sm_bytesearch_new(const uint8_t *bytes, const wildcard_t *wildcards, size_t len);
+void sm_bytesearch_free(sm_bytesearch_t *s);
+
+/*
+ * Return the offset of the first match in the `size` bytes of `data` which
+ * starts in [from, limit), or `limit` if there is none.
+ */
+size_t sm_bytesearch_next(const sm_bytesearch_t *s, const uint8_t *data, size_t size,
+                          size_t from, size_t limit);
+
+#endif /* BYTESEARCH_H */
@@ -87,7 +87,7 @@ bool sm_registercommand(const char *command, handler_ptr handler, list_t *comman
 bool sm_execcommand(globals_t *vars, const char *commandline)
 {
     unsigned argc;
-    char *str = NULL, *tok = NULL;
+    char *str = NULL, *tok = NULL, *saveptr = NULL;
     char **argv = NULL;
     command_t *err = NULL;
     bool ret = false;
@@ -113,7 +113,7 @@ bool sm_execcommand(globals_t *vars, const char *commandline)
         }
 
         /* insert next token */
-        argv[argc] = tok = strtok(str, " \t");
+        argv[argc] = tok = strtok_r(str, " \t", &saveptr);
     }
 
     assert(argc >= 1);
@@ -28,7 +28,6 @@ import os
 import argparse
 import struct
 import platform
-import threading
 import json
 
 import gi
@@ -53,7 +52,6 @@ gettext.install(GETTEXT_PACKAGE, LOCALEDIR, names=('_'));
 
 CLIPBOARD = Gtk.Clipboard.get(Gdk.SELECTION_CLIPBOARD)
 WORK_DIR = os.path.dirname(sys.argv[0])
-PROGRESS_INTERVAL = 100 # for scan progress updates
 DATA_WORKER_INTERVAL = 500 # for read(update)/write(lock)
 HEXEDIT_SPAN = 1024 # hexview half-height
 SCAN_RESULT_LIST_LIMIT = 10000 # maximal number of entries that can be displayed
@@ -336,8 +334,7 @@ class GameConqueror():
         self.check_backend_version()
         self.is_first_scan = True
         GLib.timeout_add(DATA_WORKER_INTERVAL, self.data_worker)
-        self.command_lock = threading.RLock()
-        self.progress_watcher_id = None
+        self.scan_cmd = None # handle of the running scan
 
 
     ###########################
@@ -491,7 +488,8 @@ class GameConqueror():
         return True
 
     def Stop_Button_clicked_cb(self, button, data=None):
-        self.backend.set_stop_flag(True)
+        if self.scan_cmd is not None:
+            self.backend.cancel_command(self.scan_cmd)
         return True
 
     def Reset_Button_clicked_cb(self, button, data=None):
@@ -607,10 +605,8 @@ class GameConqueror():
     def scanresult_delete_selected_matches(self, menuitem, data=None):
         (model, pathlist) = self.scanresult_tv.get_selection().get_selected_rows()
         match_id_list = ','.join(str(model.get_value(model.get_iter(path), 6)) for path in pathlist)
-        self.command_lock.acquire()
         self.backend.send_command('delete {}'.format(match_id_list))
         self.update_scan_result()
-        self.command_lock.release()
 
     def scanresult_popup_cb(self, menuitem, data=None):
         (model, pathlist) = self.scanresult_tv.get_selection().get_selected_rows()
@@ -887,12 +883,9 @@ class GameConqueror():
             self.memoryeditor_hexview.show_addr(addr)
         self.memoryeditor_window.show()
 
-    # this callback will be called from other thread
-    def progress_watcher(self):
-        Gdk.threads_enter()
-        self.scanprogress_progressbar.set_fraction(self.backend.get_scan_progress())
-        Gdk.threads_leave()
-        return True
+    # this callback will be called from the scan thread
+    def scan_progress_cb(self, progress):
+        GLib.idle_add(self.scanprogress_progressbar.set_fraction, progress)
 
     def add_to_cheat_list(self, addr, value, typestr, description=_('No Description'), at_end=False):
         # determine longest possible type
@@ -932,10 +925,8 @@ class GameConqueror():
             self.process_label.set_text('%d - %s' % (pid, process_name))
             self.process_label.set_property('tooltip-text', process_name)
 
-        self.command_lock.acquire()
         self.backend.send_command('pid %d' % (pid,))
         self.reset_scan()
-        self.command_lock.release()
 
         # unlock all entries in cheat list
         for i in range(len(self.cheatlist_liststore)):
@@ -966,10 +957,8 @@ class GameConqueror():
         # reset search type and value type
         self.scanresult_liststore.clear()
         
-        self.command_lock.acquire()
         self.backend.send_command('reset')
         self.update_scan_result()
-        self.command_lock.release()
 
         self.scanprogress_progressbar.set_fraction(0.0)
         self.scanoption_frame.set_sensitive(True)
@@ -985,13 +974,11 @@ class GameConqueror():
         isnumeric = ('int' in datatype or 'float' in datatype or 'number' in datatype)
         self.scanresult_liststore.set_sort_func(1, misc.value_compare, (1, isnumeric))
 
-        self.command_lock.acquire()
         self.backend.send_command('option scan_data_type %s' % (datatype,))
         # search scope
         self.backend.send_command('option region_scan_level %d' %(1 + int(self.search_scope_scale.get_value()),))
         # TODO: ugly, reset to make region_scan_level taking effect
         self.backend.send_command('reset')
-        self.command_lock.release()
 
     
     # perform scanning through backend
@@ -1027,16 +1014,16 @@ class GameConqueror():
         if self.is_first_scan:
             self.apply_scan_settings()
             self.is_first_scan = False
-        self.progress_watcher_id = GLib.timeout_add(PROGRESS_INTERVAL,
-            self.progress_watcher, priority=GLib.PRIORITY_DEFAULT_IDLE)
-        threading.Thread(target=self.scan_thread_func, args=(cmd,)).start()
-
-    def scan_thread_func(self, cmd):
-        self.command_lock.acquire()
-        self.backend.send_command(cmd)
+        self.scan_cmd = self.backend.send_command_async(cmd, self.scan_progress_cb,
+            lambda success: GLib.idle_add(self.finish_scan))
+        if self.scan_cmd is None:
+            self.finish_scan()
 
-        GLib.source_remove(self.progress_watcher_id)
-        Gdk.threads_enter()
+    # called in the main loop once the scan thread is done
+    def finish_scan(self):
+        if self.scan_cmd is not None:
+            self.backend.wait_command(self.scan_cmd)
+            self.scan_cmd = None
 
         self.scanprogress_progressbar.set_fraction(1.0)
 
@@ -1052,9 +1039,7 @@ class GameConqueror():
 
         self.is_scanning = False
         self.update_scan_result()
-
-        Gdk.threads_leave()
-        self.command_lock.release()
+        return False
 
     def update_scan_result(self):
         match_count = self.backend.get_match_count()
@@ -1062,9 +1047,7 @@ class GameConqueror():
         if (match_count > SCAN_RESULT_LIST_LIMIT):
             self.scanresult_liststore.clear()
         else:
-            self.command_lock.acquire()
             list_bytes = self.backend.send_command('list', get_output=True)
-            self.command_lock.release()
             lines = filter(None, misc.decode(list_bytes).split('\n'))
 
             self.scanresult_tv.set_model(None)
@@ -1107,51 +1090,68 @@ class GameConqueror():
 
     # read/write data periodically
     def data_worker(self):
-        if (not self.is_scanning) and (self.pid != 0) and self.command_lock.acquire(0): # non-blocking
+        if (not self.is_scanning) and (self.pid != 0):
             Gdk.threads_enter()
 
             # Write to memory locked values in cheat list
             for i in self.cheatlist_liststore:
                 if i[1] and i[6]: # locked and valid
                     self.write_value(i[3], i[4], i[5]) # addr, typestr, value
-            # Update visible (and unlocked) cheat list rows
-            rows = self.get_visible_rows(self.cheatlist_tv)
-            for i in rows:
+            # Collect visible (and unlocked) cheat list rows and visible
+            # scanresult rows, then read all of them with a single request
+            cheat_rows = [i for i in self.get_visible_rows(self.cheatlist_tv)
+                          if self.cheatlist_liststore[i][6] and not self.cheatlist_liststore[i][1]]
+            result_rows = [i for i in self.get_visible_rows(self.scanresult_tv)
+                           if self.scanresult_liststore[i][3]]
+            areas = []
+            for i in cheat_rows:
+                addr, typestr, value = self.cheatlist_liststore[i][3:6]
+                areas.append((addr, typestr, value))
+            for i in result_rows:
+                addr, cur_value, scanmem_type = self.scanresult_liststore[i][:3]
+                areas.append((addr, TYPENAMES_S2G[scanmem_type.split(' ', 1)[0]], cur_value))
+            values = self.read_values(areas)
+
+            # Update cheat list rows
+            for i, newvalue in zip(cheat_rows, values[:len(cheat_rows)]):
                 lockflag, locked, desc, addr, typestr, value, valid = self.cheatlist_liststore[i]
-                if valid and not locked:
-                    newvalue = self.read_value(addr, typestr, value)
-                    if newvalue is None:
-                        self.cheatlist_liststore[i] = (lockflag, False, desc, addr, typestr, '??', False)
-                    elif newvalue != value and not self.cheatlist_editing:
-                        self.cheatlist_liststore[i] = (lockflag, locked, desc, addr, typestr, str(newvalue), valid)
-            # Update visible scanresult rows
-            rows = self.get_visible_rows(self.scanresult_tv)
-            for i in rows:
+                if newvalue is None:
+                    self.cheatlist_liststore[i] = (lockflag, False, desc, addr, typestr, '??', False)
+                elif newvalue != value and not self.cheatlist_editing:
+                    self.cheatlist_liststore[i] = (lockflag, locked, desc, addr, typestr, str(newvalue), valid)
+            # Update scanresult rows
+            for i, new_value in zip(result_rows, values[len(cheat_rows):]):
                 row = self.scanresult_liststore[i]
-                addr, cur_value, scanmem_type, valid = row[:4]
-                if valid:
-                    new_value = self.read_value(addr, TYPENAMES_S2G[scanmem_type.split(' ', 1)[0]], cur_value)
-                    if new_value is not None:
-                        row[1] = str(new_value)
-                    else:
-                        row[1] = '??'
-                        row[3] = False
+                if new_value is not None:
+                    row[1] = str(new_value)
+                else:
+                    row[1] = '??'
+                    row[3] = False
 
             Gdk.threads_leave()
-            self.command_lock.release()
         return not self.exit_flag
 
     def read_value(self, addr, typestr, prev_value):
         return self.bytes2value(typestr, self.read_memory(addr, self.get_type_size(typestr, prev_value)))
     
+    # areas is a list of (addr, typestr, prev_value), addr could be int or str
+    # returns the list of new values, None for the unreadable ones
+    def read_values(self, areas):
+        requests = []
+        for (addr, typestr, prev_value) in areas:
+            if isinstance(addr, str):
+                addr = int(addr, 16)
+            requests.append((addr, int(self.get_type_size(typestr, prev_value))))
+        data = self.backend.read_memory_multi(self.pid, requests)
+        return [self.bytes2value(typestr, databytes)
+                for ((addr, typestr, prev_value), databytes) in zip(areas, data)]
+
     # addr could be int or str
     def read_memory(self, addr, length):
         if not isinstance(addr,str):
             addr = '%x'%(addr,)
 
-        self.command_lock.acquire()
         data = self.backend.send_command('dump %s %d' %(addr, length), get_output=True)
-        self.command_lock.release()
 
         # TODO raise Exception here isn't good
         if len(data) != length:
@@ -1164,9 +1164,7 @@ class GameConqueror():
         if not isinstance(addr,str):
             addr = '%x'%(addr,)
 
-        self.command_lock.acquire()
         self.backend.send_command('write %s %s %s'%(typestr, addr, value))
-        self.command_lock.release()
 
     def exit(self, object, data=None):
         self.exit_flag = True
@@ -24,6 +24,21 @@ import tempfile
 
 import misc
 
+class ReadRequest(ctypes.Structure):
+    _fields_ = [('addr', ctypes.c_void_p),
+                ('len', ctypes.c_size_t),
+                ('ok', ctypes.c_bool)]
+
+PROGRESS_CALLBACK = ctypes.CFUNCTYPE(None, ctypes.c_double, ctypes.c_void_p)
+PARTIAL_CALLBACK = ctypes.CFUNCTYPE(None, ctypes.c_ulong, ctypes.c_void_p)
+DONE_CALLBACK = ctypes.CFUNCTYPE(None, ctypes.c_bool, ctypes.c_ulong, ctypes.c_void_p)
+
+class ScanCallbacks(ctypes.Structure):
+    _fields_ = [('progress', PROGRESS_CALLBACK),
+                ('partial', PARTIAL_CALLBACK),
+                ('done', DONE_CALLBACK),
+                ('user_data', ctypes.c_void_p)]
+
 class GameConquerorBackend():
     BACKEND_FUNCS = {
         'sm_init' : (ctypes.c_bool, ),
@@ -33,12 +48,17 @@ class GameConquerorBackend():
         'sm_get_num_matches' : (ctypes.c_ulong, ),
         'sm_get_version' : (ctypes.c_char_p, ),
         'sm_get_scan_progress' : (ctypes.c_double, ),
-        'sm_set_stop_flag' : (ctypes.c_bool, )
+        'sm_set_stop_flag' : (ctypes.c_bool, ),
+        'sm_read_multi' : (ctypes.c_bool, ctypes.c_int, ctypes.POINTER(ReadRequest), ctypes.c_size_t, ctypes.c_char_p),
+        'sm_exec_cmd_async' : (ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(ScanCallbacks)),
+        'sm_async_cancel' : (None, ctypes.c_void_p),
+        'sm_async_wait' : (ctypes.c_bool, ctypes.c_void_p)
     }
 
     def __init__(self, libpath='libscanmem.so'):
         self.lib = ctypes.CDLL(libpath)
         self.init_lib_functions()
+        self.async_callbacks = {}
         self.lib.sm_set_backend()
         self.lib.sm_init()
         self.send_command('reset')
@@ -67,6 +87,28 @@ class GameConquerorBackend():
 
             self.lib.sm_backend_exec_cmd(ctypes.c_char_p(misc.encode(cmd)))
 
+    # run `cmd` in a libscanmem thread and return a handle, or None on failure
+    # progress_cb(fraction) and done_cb(success) are called from that thread,
+    # wait_command() must be called on the handle afterwards
+    def send_command_async(self, cmd, progress_cb, done_cb):
+        callbacks = ScanCallbacks(PROGRESS_CALLBACK(lambda progress, data: progress_cb(progress)),
+                                  PARTIAL_CALLBACK(),
+                                  DONE_CALLBACK(lambda success, matches, data: done_cb(success)),
+                                  None)
+        handle = self.lib.sm_exec_cmd_async(ctypes.c_char_p(misc.encode(cmd)), ctypes.byref(callbacks))
+        if handle:
+            # keep the ctypes callbacks alive while the thread runs
+            self.async_callbacks[handle] = callbacks
+        return handle
+
+    def cancel_command(self, handle):
+        self.lib.sm_async_cancel(handle)
+
+    def wait_command(self, handle):
+        result = self.lib.sm_async_wait(handle)
+        del self.async_callbacks[handle]
+        return result
+
     def get_match_count(self):
         return self.lib.sm_get_num_matches()
 
@@ -79,5 +121,25 @@ class GameConquerorBackend():
     def set_stop_flag(self, stop_flag):
         self.lib.sm_set_stop_flag(stop_flag)
 
+    # read many (addr, length) areas with a single stop of the target
+    # returns a list with the data of each area, or None where it can't be read
+    def read_memory_multi(self, pid, areas):
+        if not areas:
+            return []
+        requests = (ReadRequest * len(areas))()
+        for i, (addr, length) in enumerate(areas):
+            requests[i].addr = addr
+            requests[i].len = length
+        buf = ctypes.create_string_buffer(sum(length for (addr, length) in areas) + 1)
+        if not self.lib.sm_read_multi(pid, requests, len(areas), buf):
+            return [None] * len(areas)
+        result = []
+        offset = 0
+        raw = buf.raw
+        for r in requests:
+            result.append(raw[offset:offset + r.len] if r.ok else None)
+            offset += r.len
+        return result
+
     def exit_cleanup(self):
         self.lib.sm_cleanup()
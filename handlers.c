@@ -54,11 +54,17 @@
 #include "commands.h"
 #include "endianness.h"
 #include "handlers.h"
+#include "image.h"
 #include "interrupt.h"
+#include "memregex.h"
+#include "ptrscan.h"
+#include "regionfilter.h"
+#include "relocate.h"
 #include "scanmem.h"
 #include "scanroutines.h"
 #include "sets.h"
 #include "show_message.h"
+#include "signatures.h"
 
 #define USEPARAMS() ((void) vars, (void) argv, (void) argc)     /* macro to hide gcc unused warnings */
 
@@ -92,7 +98,7 @@
 #endif
 
 /* pager support */
-static FILE *get_pager(FILE *fallback_output)
+static FILE *get_pager(globals_t *vars, FILE *fallback_output)
 {
     const char *pager;
     pid_t pgpid;
@@ -104,7 +110,7 @@ static FILE *get_pager(FILE *fallback_output)
 
     assert(fallback_output != NULL);
 
-    if (sm_globals.options.backend)
+    if (vars->options.backend)
         return fallback_output;
 
     if ((pager = getenv("PAGER")) == NULL || *pager == '\0') {
@@ -293,7 +299,7 @@ bool handler__set(globals_t * vars, char **argv, unsigned argc)
         /* control returns here when interrupted */
 // settings is allocated with alloca, do not free it
 //        free(settings);
-        sm_detach(vars->target);
+        sm_session_detach(vars);
         ENDINTERRUPTABLE();
         return true;
     }
@@ -349,7 +355,7 @@ bool handler__set(globals_t * vars, char **argv, unsigned argc)
 
                         /* set the value specified */
                         fix_endianness(&v, vars->options.reverse_endianness);
-                        if (sm_setaddr(vars->target, address, &v) == false) {
+                        if (sm_session_setaddr(vars, address, &v) == false) {
                             show_error("failed to set a value.\n");
                             set_cleanup(&match_set);
                             goto fail;
@@ -381,7 +387,7 @@ bool handler__set(globals_t * vars, char **argv, unsigned argc)
                         show_info("setting *%p to %#"PRIx64"...\n", address, v.int64_value);
 
                         fix_endianness(&v, vars->options.reverse_endianness);
-                        if (sm_setaddr(vars->target, address, &v) == false) {
+                        if (sm_session_setaddr(vars, address, &v) == false) {
                             show_error("failed to set a value.\n");
                             goto fail;
                         }
@@ -421,12 +427,21 @@ fail:
  * FORMAT (don't change, front-end depends on this):
  * [#no] addr, value, [possible types (separated by space)]
  */
+/* the id of the signature recorded with a match, or -1 */
+static long signature_of_match(const globals_t *vars, const matches_and_old_values_swath *swath,
+                               size_t index)
+{
+    if (vars->signatures == NULL)
+        return -1;
+    return sm_sigset_lookup(vars->signatures, swath->first_byte_in_child + index);
+}
+
 bool handler__list(globals_t *vars, char **argv, unsigned argc)
 {
     unsigned long num = 0;
     size_t buf_len = 128; /* will be realloc'd later if necessary */
     int printed;
-    element_t *np = NULL;
+    const region_t *region = NULL;
     char *v;
     struct winsize w;
     FILE *pager;
@@ -450,19 +465,16 @@ bool handler__list(globals_t *vars, char **argv, unsigned argc)
         return false;
     }
 
-    if (vars->regions)
-        np = vars->regions->head;
-
     matches_and_old_values_swath *reading_swath_index = vars->matches->swaths;
     size_t reading_iterator = 0;
 
     if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == -1) {
         if (!vars->options.backend)
             show_warn("handler__list(): couldn't get terminal size.\n");
-        pager = get_pager(stdout);
+        pager = get_pager(vars, stdout);
     } else {
         /* check if the output fits in the terminal window */
-        pager = (w.ws_row >= MIN(max_to_print, vars->num_matches)) ? stdout : get_pager(stdout);
+        pager = (w.ws_row >= MIN(max_to_print, vars->num_matches)) ? stdout : get_pager(vars, stdout);
     }
 
     /* list all known matches */
@@ -481,7 +493,11 @@ bool handler__list(globals_t *vars, char **argv, unsigned argc)
             switch(vars->options.scan_data_type)
             {
             case BYTEARRAY:
-                buf_len = flags * 3 + 32;
+                ; /* cheat gcc */
+                long sig = signature_of_match(vars, reading_swath_index, reading_iterator);
+                const char *sig_name = (sig >= 0) ? sm_sigset_name(vars->signatures, sig) : NULL;
+
+                buf_len = flags * 3 + 32 + (sig_name ? strlen(sig_name) + 32 : 0);
                 v = realloc(v, buf_len); /* for each byte and the suffix, this should be enough */
 
                 if (v == NULL)
@@ -491,6 +507,8 @@ bool handler__list(globals_t *vars, char **argv, unsigned argc)
                 }
                 printed = bytearray_match_to_text(v, buf_len, reading_swath_index, reading_iterator, flags);
                 printed += snprintf(v + printed, buf_len - printed, ", [bytearray:%u]", flags);
+                if (sig_name)
+                    printed += snprintf(v + printed, buf_len - printed, ", [signature %ld: %s]", sig, sig_name);
                 assert(printed < buf_len);
                 break;
             case STRING:
@@ -518,20 +536,15 @@ bool handler__list(globals_t *vars, char **argv, unsigned argc)
             unsigned int region_id = 99;
             unsigned long match_off = 0;
             const char *region_type = "??";
-            /* get region info belonging to the match -
-             * note: we assume the regions list and matches are sorted
-             */
-            while (np) {
-                region_t *region = np->data;
-                unsigned long region_start = (unsigned long)region->start;
-                if (address_ul < region_start + region->size &&
-                  address_ul >= region_start) {
-                    region_id = region->id;
-                    match_off = address_ul - region->load_addr;
-                    region_type = region_type_names[region->type];
-                    break;
-                }
-                np = np->next;
+            /* get region info belonging to the match, often the one of
+             * the previous match */
+            if (vars->regions && (region == NULL || address < region->start ||
+                                  address >= region->start + region->size))
+                region = sm_regions_find(vars->regions, address);
+            if (region) {
+                region_id = region->id;
+                match_off = address_ul - region->load_addr;
+                region_type = region_type_names[region->type];
             }
             fprintf(pager, "[%2lu] "POINTER_FMT", %2u + "POINTER_FMT", %5s, %s\n",
                    num++, address_ul, region_id, match_off, region_type, v);
@@ -615,28 +628,48 @@ bool handler__delete(globals_t * vars, char **argv, unsigned argc)
     return false;
 }
 
+/* the regions of the image or of the target process */
+static bool read_regions(globals_t *vars, regions_t *regions)
+{
+    if (vars->image) {
+        if (sm_readmaps_image(vars->image, regions, vars->options.region_scan_level,
+                              vars->options.region_filter) != true) {
+            show_error("sorry, there was a problem getting a list of regions to search.\n");
+            return false;
+        }
+        return true;
+    }
+    if (sm_readmaps(vars->target, regions, vars->options.region_scan_level,
+                    vars->options.region_filter) != true) {
+        show_error("sorry, there was a problem getting a list of regions to search.\n");
+        show_warn("the pid may be invalid, or you don't have permission.\n");
+        return false;
+    }
+    return true;
+}
+
 bool handler__reset(globals_t * vars, char **argv, unsigned argc)
 {
+    double progress = 0.0;
+
     USEPARAMS();
 
-    /* reset scan progress */
-    vars->scan_progress = 0;
+    /* reset scan progress, front-ends may be reading it */
+    __atomic_store(&vars->scan_progress, &progress, __ATOMIC_RELAXED);
 
     if (vars->matches) { free(vars->matches); vars->matches = NULL; vars->num_matches = 0; }
 
     /* refresh list of regions */
-    l_destroy(vars->regions);
+    sm_regions_free(vars->regions);
 
-    /* create a new linked list of regions */
-    if ((vars->regions = l_init()) == NULL) {
+    /* create a new array of regions */
+    if ((vars->regions = sm_regions_new()) == NULL) {
         show_error("sorry, there was a problem allocating memory.\n");
         return false;
     }
 
-    /* read in maps if a pid is known */
-    if (vars->target && sm_readmaps(vars->target, vars->regions, vars->options.region_scan_level) != true) {
-        show_error("sorry, there was a problem getting a list of regions to search.\n");
-        show_warn("the pid may be invalid, or you don't have permission.\n");
+    /* read in maps if a pid or an image is known */
+    if (sm_session_has_target(vars) && read_regions(vars, vars->regions) != true) {
         vars->target = 0;
         return false;
     }
@@ -644,6 +677,118 @@ bool handler__reset(globals_t * vars, char **argv, unsigned argc)
     return true;
 }
 
+bool handler__refresh(globals_t * vars, char **argv, unsigned argc)
+{
+    regions_t *regions;
+    address_range_t *gaps = NULL;
+    size_t ngaps = 0, i, j;
+    size_t unchanged = 0, added = 0;
+    unsigned long unmapped = 0;
+    char *covered_end = NULL;
+    bool ok = true;
+
+    USEPARAMS();
+
+    if (!sm_session_has_target(vars)) {
+        show_error("no target set, type `help pid`.\n");
+        return false;
+    }
+
+    if ((regions = sm_regions_new()) == NULL) {
+        show_error("sorry, there was a problem allocating memory.\n");
+        return false;
+    }
+
+    if (read_regions(vars, regions) != true) {
+        sm_regions_free(regions);
+        return false;
+    }
+
+    /* at most one gap before each part of an old region still mapped, and one after them all */
+    if ((gaps = calloc(vars->regions->size + regions->size + 1, sizeof(address_range_t))) == NULL) {
+        show_error("sorry, there was a problem allocating memory.\n");
+        sm_regions_free(regions);
+        return false;
+    }
+
+    /* both lists are sorted by address, so walk them together: an old region
+     * keeps its matches where it overlaps a new region of the same file */
+    for (i = 0, j = 0; i < vars->regions->size && j < regions->size; ) {
+        const region_t *old = &vars->regions->array[i];
+        const region_t *new = &regions->array[j];
+        char *old_end = old->start + old->size;
+        char *new_end = new->start + new->size;
+        char *start = MAX(old->start, new->start);
+        char *end = MIN(old_end, new_end);
+
+        if (start < end && strcmp(old->filename, new->filename) == 0) {
+            if (start > covered_end)
+                gaps[ngaps++] = (address_range_t){ covered_end, start };
+            covered_end = end;
+            if (old->start == new->start && old->size == new->size)
+                ++unchanged;
+        }
+
+        if (old_end <= new_end)
+            ++i;
+        else
+            ++j;
+    }
+    gaps[ngaps++] = (address_range_t){ covered_end, (char *) UINTPTR_MAX };
+
+    /* the bytes of the old regions in the gaps are gone */
+    for (i = 0, j = 0; i < vars->regions->size; ++i) {
+        const region_t *old = &vars->regions->array[i];
+        char *old_end = old->start + old->size;
+
+        while (j < ngaps && gaps[j].end <= old->start)
+            ++j;
+        for (size_t k = j; k < ngaps && gaps[k].start < old_end; ++k)
+            unmapped += MIN(old_end, gaps[k].end) - MAX(old->start, gaps[k].start);
+    }
+
+    /* new regions overlap no old region of the same file */
+    for (i = 0, j = 0; j < regions->size; ++j) {
+        const region_t *new = &regions->array[j];
+        bool seen = false;
+
+        while (i < vars->regions->size &&
+               vars->regions->array[i].start + vars->regions->array[i].size <= new->start)
+            ++i;
+        for (size_t k = i; k < vars->regions->size &&
+                           vars->regions->array[k].start < new->start + new->size; ++k) {
+            if (strcmp(vars->regions->array[k].filename, new->filename) == 0) {
+                seen = true;
+                break;
+            }
+        }
+        if (!seen)
+            ++added;
+    }
+
+    if (vars->matches) {
+        vars->matches = delete_in_address_ranges(vars->matches, &vars->num_matches, gaps, ngaps);
+        if (vars->matches == NULL) {
+            show_error("memory allocation error while deleting matches.\n");
+            vars->num_matches = 0;
+            ok = false;
+        }
+    }
+    free(gaps);
+
+    sm_regions_free(vars->regions);
+    vars->regions = regions;
+
+    show_info("%lu of %lu regions unchanged, %lu bytes unmapped, %lu new regions.\n",
+              (unsigned long) unchanged, (unsigned long) regions->size, unmapped,
+              (unsigned long) added);
+    if (vars->matches)
+        show_info("we currently have %ld matches.\n", vars->num_matches);
+
+    /* the matches are lost, a script must not go on narrowing them */
+    return ok;
+}
+
 bool handler__pid(globals_t * vars, char **argv, unsigned argc)
 {
     char *resetargv[] = { "reset", NULL };
@@ -656,6 +801,13 @@ bool handler__pid(globals_t * vars, char **argv, unsigned argc)
             show_error("`%s` does not look like a valid pid.\n", argv[1]);
             return false;
         }
+
+        /* a process replaces the image */
+        if (vars->image) {
+            sm_image_close(vars->image);
+            sm_ptrindex_free(vars);
+            vars->image = NULL;
+        }
     } else if (vars->target) {
         /* print the pid of the target program */
         show_info("target pid is %u.\n", vars->target);
@@ -668,13 +820,236 @@ bool handler__pid(globals_t * vars, char **argv, unsigned argc)
     return handler__reset(vars, resetargv, 1);
 }
 
+/* refresh the old values of matches just moved to another process */
+static bool rescan_relocated(globals_t *vars)
+{
+    if (vars->num_matches == 0)
+        return true;
+    if (sm_find_scanroutine(vars->options.scan_data_type, MATCHUPDATE, NULL,
+                            vars->options.reverse_endianness) == NULL) {
+        show_info("the old values of the matches are kept, search them again.\n");
+        return true;
+    }
+    if (sm_checkmatches(vars, MATCHUPDATE, NULL) == false) {
+        show_error("failed to scan target address space.\n");
+        return false;
+    }
+    return true;
+}
+
+bool handler__savematches(globals_t * vars, char **argv, unsigned argc)
+{
+    sm_relocset_t set;
+    unsigned long skipped;
+    bool ret;
+
+    if (argc != 2)
+    {
+        show_error("bad arguments, see `help savematches`.\n");
+        return false;
+    }
+
+    if (vars->num_matches == 0) {
+        show_error("there are currently no matches.\n");
+        return false;
+    }
+
+    if (!sm_relocset_build(vars, &set, &skipped))
+        return false;
+    ret = sm_relocset_save(&set, argv[1]);
+    if (ret)
+        show_info("%lu matches saved to `%s`, %lu outside of modules skipped.\n",
+                  (unsigned long) set.count, argv[1], skipped);
+    sm_relocset_free(&set);
+    return ret;
+}
+
+bool handler__loadmatches(globals_t * vars, char **argv, unsigned argc)
+{
+    sm_relocset_t set;
+    unsigned long dropped;
+
+    if (argc != 2)
+    {
+        show_error("bad arguments, see `help loadmatches`.\n");
+        return false;
+    }
+
+    if (!sm_session_has_target(vars)) {
+        show_error("no target specified, see `help pid`\n");
+        return false;
+    }
+
+    if (!sm_relocset_load(&set, argv[1]))
+        return false;
+
+    if (vars->options.scan_data_type != set.scan_data_type) {
+        show_info("scan_data_type was set to the one of the matches.\n");
+        vars->options.scan_data_type = set.scan_data_type;
+    }
+
+    if (!sm_relocset_apply(vars, &set, &dropped)) {
+        sm_relocset_free(&set);
+        return false;
+    }
+    show_info("%lu matches loaded, %lu outside of the modules of the target.\n",
+              vars->num_matches, dropped);
+    sm_relocset_free(&set);
+
+    return rescan_relocated(vars);
+}
+
+bool handler__retarget(globals_t * vars, char **argv, unsigned argc)
+{
+    sm_relocset_t set;
+    unsigned long skipped, dropped;
+
+    if (argc != 2)
+    {
+        show_error("bad arguments, see `help retarget`.\n");
+        return false;
+    }
+
+    if (!sm_relocset_build(vars, &set, &skipped))
+        return false;
+
+    /* forget the old target, as `pid` does */
+    if (!handler__pid(vars, argv, argc)) {
+        sm_relocset_free(&set);
+        return false;
+    }
+
+    if (!sm_relocset_apply(vars, &set, &dropped)) {
+        sm_relocset_free(&set);
+        return false;
+    }
+    show_info("%lu matches moved, %lu outside of the modules of the new target, "
+              "%lu outside of any module.\n", vars->num_matches, dropped, skipped);
+    sm_relocset_free(&set);
+
+    return rescan_relocated(vars);
+}
+
+/* make `image` the target of the session, and read its regions */
+static bool use_image(globals_t *vars, sm_image_t *image)
+{
+    char *resetargv[] = { "reset", NULL };
+
+    /* the image replaces the target, and its pointers */
+    sm_image_close(vars->image);
+    sm_ptrindex_free(vars);
+    vars->image = image;
+    vars->target = 0;
+
+    return handler__reset(vars, resetargv, 1);
+}
+
+bool handler__open(globals_t * vars, char **argv, unsigned argc)
+{
+    sm_image_t *image;
+
+    if (argc == 1) {
+        if (vars->image == NULL) {
+            show_info("no image is currently open.\n");
+            return false;
+        }
+        show_info("the open image is %s.\n", sm_image_path(vars->image));
+        return true;
+    }
+    if (argc != 2) {
+        show_error("bad arguments, see `help open`.\n");
+        return false;
+    }
+
+    if ((image = sm_image_open(argv[1])) == NULL)
+        return false;
+
+    return use_image(vars, image);
+}
+
+/* diff <before> <after> [<value>] */
+bool handler__diff(globals_t * vars, char **argv, unsigned argc)
+{
+    sm_image_t *before, *after;
+    regions_t *regions, *changed;
+    unsigned long npages, nchanged;
+    bool ok;
+
+    if (argc < 3) {
+        show_error("expected two images, see `help diff`.\n");
+        return false;
+    }
+
+    if ((before = sm_image_open(argv[1])) == NULL)
+        return false;
+    if ((after = sm_image_open(argv[2])) == NULL) {
+        sm_image_close(before);
+        return false;
+    }
+
+    /* the session goes on with the later image */
+    if (!use_image(vars, after)) {
+        sm_image_close(before);
+        return false;
+    }
+
+    if ((changed = sm_regions_new()) == NULL) {
+        show_error("sorry, there was a problem allocating memory.\n");
+        sm_image_close(before);
+        return false;
+    }
+    if (!sm_image_diff(before, after, vars->regions, changed, &npages, &nchanged)) {
+        sm_regions_free(changed);
+        sm_image_close(before);
+        return false;
+    }
+    show_info("%lu of %lu pages changed.\n", nchanged, npages);
+    if (nchanged == 0) {
+        sm_regions_free(changed);
+        sm_image_close(before);
+        return true;
+    }
+
+    /* search the old values in the changed pages only, the next search
+     * compares the new values to them */
+    regions = vars->regions;
+    vars->regions = changed;
+    vars->image = before;
+    if (argc > 3) {
+        ok = handler__default(vars, argv + 3, argc - 3);
+    } else if ((ok = sm_searchregions(vars, MATCHANY, NULL)) != true) {
+        show_error("failed to save target address space.\n");
+    }
+    vars->regions = regions;
+    vars->image = after;
+
+    sm_regions_free(changed);
+    sm_image_close(before);
+    return ok;
+}
+
+bool handler__saveimage(globals_t * vars, char **argv, unsigned argc)
+{
+    if (argc != 2) {
+        show_error("bad arguments, see `help saveimage`.\n");
+        return false;
+    }
+
+    if (!sm_session_has_target(vars)) {
+        show_error("no target set, type `help pid`.\n");
+        return false;
+    }
+
+    return sm_image_save(vars, argv[1]);
+}
+
 bool handler__snapshot(globals_t *vars, char **argv, unsigned argc)
 {
     USEPARAMS();
     
 
     /* check that a pid has been specified */
-    if (vars->target == 0) {
+    if (!sm_session_has_target(vars)) {
         show_error("no target set, type `help pid`.\n");
         return false;
     }
@@ -694,6 +1069,8 @@ bool handler__snapshot(globals_t *vars, char **argv, unsigned argc)
 bool handler__dregion(globals_t *vars, char **argv, unsigned argc)
 {
     struct set reg_set;
+    address_range_t *ranges;
+    size_t nranges = 0;
 
     /* need an argument */
     if (argc < 2) {
@@ -702,7 +1079,7 @@ bool handler__dregion(globals_t *vars, char **argv, unsigned argc)
     }
 
     /* check that there is a process known */
-    if (vars->target == 0) {
+    if (!sm_session_has_target(vars)) {
         show_error("no target specified, see `help pid`\n");
         return false;
     }
@@ -713,67 +1090,60 @@ bool handler__dregion(globals_t *vars, char **argv, unsigned argc)
         return false;
     }
 
-    size_t last_region_id = ((region_t*)(vars->regions->tail->data))->id;
+    size_t last_region_id = vars->regions->array[vars->regions->size - 1].id;
 
     if (!parse_uintset(argv[1], &reg_set, last_region_id + 1)) {
         show_error("failed to parse the set, try `help dregion`.\n");
         return false;
     }
 
-    /* loop for every reg_id in the set */
+    if ((ranges = calloc(reg_set.size, sizeof(address_range_t))) == NULL) {
+        show_error("memory allocation error while deleting regions\n");
+        set_cleanup(&reg_set);
+        return false;
+    }
+
+    /* the set is sorted like the ids and the addresses of the regions, so
+     * are the ranges */
     for (size_t set_idx = 0; set_idx < reg_set.size; set_idx++) {
         size_t reg_id = reg_set.buf[set_idx];
-        
-        /* initialize list pointers */
-        element_t *np = vars->regions->head;
-        element_t *pp = NULL;
-        
-        /* find the correct region node */
-        while (np) {
-            region_t *r = np->data;
-            
-            /* compare the node id to the id the user specified */
-            if (r->id == reg_id)
-                break;
-            
-            pp = np; /* keep track of prev for l_remove() */
-            np = np->next;
-        }
+        region_t *reg_to_delete = sm_regions_find_id(vars->regions, reg_id);
 
         /* check if a match was found */
-        if (np == NULL) {
+        if (reg_to_delete == NULL) {
             show_warn("no region matching %u, or already removed.\n", reg_id);
             continue;
         }
-        
-        /* check for any affected matches before removing it */
-        if(vars->num_matches > 0)
-        {
-            region_t *reg_to_delete = np->data;
 
-            char *start_address = reg_to_delete->start;
-            char *end_address = reg_to_delete->start + reg_to_delete->size;
-            vars->matches = delete_in_address_range(vars->matches, &vars->num_matches,
-                                                    start_address, end_address);
-            if (vars->matches == NULL)
-            {
-                show_error("memory allocation error while deleting matches\n");
-            }
-        }
+        ranges[nranges].start = reg_to_delete->start;
+        ranges[nranges].end = reg_to_delete->start + reg_to_delete->size;
+        nranges++;
+        sm_regions_remove(vars->regions, reg_to_delete - vars->regions->array);
+    }
+    set_cleanup(&reg_set);
 
-        l_remove(vars->regions, pp, NULL);
+    /* delete the affected matches at once */
+    if (vars->num_matches > 0 && nranges > 0)
+    {
+        vars->matches = delete_in_address_ranges(vars->matches, &vars->num_matches,
+                                                 ranges, nranges);
+        if (vars->matches == NULL)
+        {
+            show_error("memory allocation error while deleting matches\n");
+        }
     }
+    free(ranges);
 
     return true;
 }
 
 bool handler__lregions(globals_t * vars, char **argv, unsigned argc)
 {
-    element_t *np = vars->regions->head;
+    size_t i;
 
     USEPARAMS();
 
-    if (vars->target == 0) {
+    if (!sm_session_has_target(vars)) {
         show_error("no target has been specified, see `help pid`.\n");
         return false;
     }
@@ -783,8 +1153,8 @@ bool handler__lregions(globals_t * vars, char **argv, unsigned argc)
     }
     
     /* print a list of regions that have been searched */
-    while (np) {
-        region_t *region = np->data;
+    for (i = 0; i < vars->regions->size; i++) {
+        region_t *region = &vars->regions->array[i];
 
         fprintf(stderr, "[%2u] "POINTER_FMT", %7lu bytes, %5s, "POINTER_FMT", %c%c%c, %s\n", 
                 region->id,
@@ -794,7 +1164,6 @@ bool handler__lregions(globals_t * vars, char **argv, unsigned argc)
                 region->flags.write ? 'w' : '-',
                 region->flags.exec ? 'x' : '-',
                 region->filename[0] ? region->filename : "unassociated");
-        np = np->next;
     }
 
     return true;
@@ -904,6 +1273,48 @@ bool handler__version(globals_t *vars, char **argv, unsigned argc)
     return true;
 }
 
+bool handler__stats(globals_t *vars, char **argv, unsigned argc)
+{
+    static const char *phases[SM_PHASES] = {
+        [SM_PHASE_ATTACH] = "attach",
+        [SM_PHASE_READ] = "read",
+        [SM_PHASE_SCAN] = "scan",
+        [SM_PHASE_WRITE] = "write",
+        [SM_PHASE_DETACH] = "detach",
+    };
+    const sm_stats_t *stats = &vars->stats;
+    unsigned long peeks = stats->peek_hits + stats->peek_misses;
+    size_t matches_bytes = vars->matches ? vars->matches->bytes_allocated : 0;
+    unsigned i;
+
+    if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+        memset(&vars->stats, 0, sizeof(vars->stats));
+        return true;
+    }
+    if (argc != 1) {
+        show_error("bad arguments, see `help stats`.\n");
+        return false;
+    }
+
+    for (i = 0; i < SM_PHASES; i++)
+        printf("%-8s %12.6f s\n", phases[i], stats->seconds[i]);
+    printf("%lu searches, %lu rescans, %lu sets, %lu reads, %lu attaches\n",
+           stats->searches, stats->checks, stats->sets, stats->reads, stats->attaches);
+    printf("%lu syscalls, %llu bytes read, %lu reallocations of the matches\n",
+           stats->syscalls, stats->bytes_read, stats->reallocs);
+    printf("peek buffer: %lu hits, %lu misses (%.1f%% hits)\n", stats->peek_hits,
+           stats->peek_misses, peeks ? 100.0 * stats->peek_hits / peeks : 0.0);
+    printf("matches: %lu bytes, %.1f bytes per match, %lu bytes at most\n",
+           (unsigned long) matches_bytes,
+           vars->num_matches ? (double) matches_bytes / vars->num_matches : 0.0,
+           (unsigned long) MAX(stats->matches_peak, matches_bytes));
+    printf("scan buffer: %lu bytes at most", (unsigned long) stats->buffer_peak);
+    if (vars->options.memory_budget)
+        printf(", memory budget %lu bytes", (unsigned long) vars->options.memory_budget);
+    printf("\n");
+    return true;
+}
+
 bool handler__string(globals_t * vars, char **argv, unsigned argc)
 {
     USEPARAMS();
@@ -922,33 +1333,21 @@ bool handler__string(globals_t * vars, char **argv, unsigned argc)
         show_error("please specify a string\n");
         return false;
     }
-    size_t string_length = cmdline_length-2;
-    if (string_length > (uint16_t)(-1)) /* string too long */
-    {
-        show_error("String length is limited to %u\n", (uint16_t)(-1));
-        return false;
-    }
 
-    /* Allocate a copy of the target string. While it would be possible to reuse
+    /* Parse a copy of the target string. While it would be possible to reuse
      * the incoming string, truncating the first 2 chars means it is aligned
      * at most at a 2 bytes boundary, which will generate unaligned accesses
      * when the string will be read as a sequence of int64 during a scan.
      * `malloc()` instead ensures enough alignment for any type.
      */
-    char *string_value = malloc((string_length+1)*sizeof(char));
-    if (string_value == NULL)
-    {
-        show_error("memory allocation for string failed.\n");
-        return false;
-    }
-    strcpy(string_value, vars->current_cmdline+2);
-
     uservalue_t val;
-    val.string_value = string_value;
-    val.flags = string_length;
+    if (!parse_uservalue_string(vars->current_cmdline+2, vars->options.string_encoding,
+                                vars->options.string_ignore_case, &val))
+        return false;
+    char *string_value = (char *)val.string_value;
  
     /* need a pid for the rest of this to work */
-    if (vars->target == 0) {
+    if (!sm_session_has_target(vars)) {
         goto fail;
     }
 
@@ -956,7 +1355,7 @@ bool handler__string(globals_t * vars, char **argv, unsigned argc)
     if (vars->matches) {
         if (vars->num_matches == 0) {
             show_error("there are currently no matches.\n");
-            return false;
+            goto fail;
         }
         /* already know some matches */
         if (sm_checkmatches(vars, MATCHEQUALTO, &val) != true) {
@@ -978,13 +1377,169 @@ bool handler__string(globals_t * vars, char **argv, unsigned argc)
     }
 
     free(string_value);
+    free_uservalue(&val);
     return true;
 
 fail:
     free(string_value);
+    free_uservalue(&val);
+    return false;
+}
+
+bool handler__regex(globals_t * vars, char **argv, unsigned argc)
+{
+    const char *pattern = vars->current_cmdline;
+    uservalue_t val;
+
+    if (argc < 2) {
+        show_error("please specify a regular expression, see `help regex`.\n");
+        return false;
+    }
+
+    /* the pattern is the rest of the line, spaces included */
+    pattern += strspn(pattern, " \t");
+    pattern += strcspn(pattern, " \t");
+    pattern++;
+
+    zero_uservalue(&val);
+    if ((val.regex_value = sm_regex_compile(pattern, vars->options.string_ignore_case)) == NULL)
+        return false;
+
+    /* Test scan_data_type. Automatically set to string for convenience */
+    if (vars->options.scan_data_type != STRING)
+    {
+        show_info("scan_data_type was not string, it was set automatically.\n");
+        vars->options.scan_data_type = STRING;
+    }
+
+    /* need a pid for the rest of this to work */
+    if (!sm_session_has_target(vars)) {
+        goto fail;
+    }
+
+    if (vars->matches) {
+        if (vars->num_matches == 0) {
+            show_error("there are currently no matches.\n");
+            goto fail;
+        }
+        /* already know some matches */
+        if (sm_checkmatches(vars, MATCHEQUALTO, &val) != true) {
+            show_error("failed to search target address space.\n");
+            goto fail;
+        }
+    } else {
+        /* initial search */
+        if (sm_searchregions(vars, MATCHEQUALTO, &val) != true) {
+            show_error("failed to search target address space.\n");
+            goto fail;
+        }
+    }
+
+    /* check if we now know the only possible candidate */
+    if (vars->num_matches == 1) {
+        show_info("match identified, use \"set\" to modify value.\n");
+        show_info("enter \"help\" for other commands.\n");
+    }
+
+    free_uservalue(&val);
+    return true;
+
+fail:
+    free_uservalue(&val);
     return false;
 }
 
+/* tell how many matches each signature has */
+static void report_signatures(const globals_t *vars)
+{
+    size_t count = sm_sigset_count(vars->signatures), found = 0, i;
+    matches_and_old_values_swath *reading_swath_index = vars->matches->swaths;
+    size_t reading_iterator = 0;
+    unsigned long *hits;
+
+    if ((hits = calloc(count, sizeof(unsigned long))) == NULL)
+        return;
+
+    while (reading_swath_index->first_byte_in_child) {
+        match_flags flags = reading_swath_index->data[reading_iterator].match_info;
+
+        if (flags != flags_empty) {
+            long id = signature_of_match(vars, reading_swath_index, reading_iterator);
+            if (id >= 0)
+                hits[id]++;
+        }
+
+        ++reading_iterator;
+        if (reading_iterator >= reading_swath_index->number_of_bytes) {
+            reading_swath_index = (matches_and_old_values_swath *)
+                local_address_beyond_last_element(reading_swath_index);
+            reading_iterator = 0;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (hits[i] == 0)
+            continue;
+        show_info("signature %lu (%s): %lu matches.\n", (unsigned long) i,
+                  sm_sigset_name(vars->signatures, i), hits[i]);
+        found++;
+    }
+    show_info("%lu of %lu signatures found.\n", (unsigned long) found, (unsigned long) count);
+    free(hits);
+}
+
+bool handler__signatures(globals_t * vars, char **argv, unsigned argc)
+{
+    sm_sigset_t *set;
+    uservalue_t val;
+
+    if (argc != 2) {
+        show_error("expected a file of signatures, see `help signatures`.\n");
+        return false;
+    }
+    if (!sm_session_has_target(vars)) {
+        show_error("no target specified, see `help pid`\n");
+        return false;
+    }
+    if (vars->matches && vars->num_matches == 0) {
+        show_error("there are currently no matches.\n");
+        return false;
+    }
+    if ((set = sm_sigset_load(argv[1])) == NULL)
+        return false;
+
+    /* Test scan_data_type. Automatically set to bytearray for convenience */
+    if (vars->options.scan_data_type != BYTEARRAY)
+    {
+        show_info("scan_data_type was not bytearray, it was set automatically.\n");
+        vars->options.scan_data_type = BYTEARRAY;
+    }
+
+    zero_uservalue(&val);
+    val.sigset_value = set;
+
+    if (vars->matches) {
+        /* already know some matches */
+        if (sm_checkmatches(vars, MATCHEQUALTO, &val) != true) {
+            show_error("failed to search target address space.\n");
+            sm_sigset_free(set);
+            return false;
+        }
+    } else {
+        /* initial search */
+        if (sm_searchregions(vars, MATCHEQUALTO, &val) != true) {
+            show_error("failed to search target address space.\n");
+            sm_sigset_free(set);
+            return false;
+        }
+    }
+
+    /* keep the signatures to name the matches */
+    vars->signatures = set;
+    report_signatures(vars);
+    return true;
+}
+
 static inline bool parse_uservalue_default(const char *str, uservalue_t *val)
 {
     bool ret = true;
@@ -996,6 +1551,223 @@ static inline bool parse_uservalue_default(const char *str, uservalue_t *val)
     return ret;
 }
 
+static const struct {
+    const char *name;
+    scan_data_type_t type;
+    uint16_t width;
+    match_flags flags;
+} group_field_types[] = {
+    { "int8",    INTEGER8,  1, flags_i8b  },
+    { "int16",   INTEGER16, 2, flags_i16b },
+    { "int32",   INTEGER32, 4, flags_i32b },
+    { "int64",   INTEGER64, 8, flags_i64b },
+    { "float32", FLOAT32,   4, flag_f32b  },
+    { "float64", FLOAT64,   8, flag_f64b  },
+    { "float",   FLOAT32,   4, flag_f32b  },
+    { "double",  FLOAT64,   8, flag_f64b  },
+};
+
+/* parse a `type:value` or `type:min..max` group field */
+static bool parse_group_field(char *str, group_field_t *field, bool reverse_endianness)
+{
+    scan_match_type_t m = MATCHEQUALTO;
+    char *value, *pos;
+    unsigned i;
+
+    if ((value = strchr(str, ':')) == NULL) {
+        show_error("bad group field `%s`, see `help group`.\n", str);
+        return false;
+    }
+    *value++ = '\0';
+    for (i = 0; i < sizeof(group_field_types) / sizeof(group_field_types[0]); i++) {
+        if (strcmp(str, group_field_types[i].name) == 0)
+            break;
+    }
+    if (i == sizeof(group_field_types) / sizeof(group_field_types[0])) {
+        show_error("unknown group field type `%s`, see `help group`.\n", str);
+        return false;
+    }
+
+    /* detect a range */
+    if ((pos = strstr(value, "..")) != NULL) {
+        *pos = '\0';
+        if (!parse_uservalue_default(value, &field->value[0]) ||
+            !parse_uservalue_default(pos + 2, &field->value[1]))
+            return false;
+        if (field->value[0].float64_value > field->value[1].float64_value) {
+            show_error("Empty range\n");
+            return false;
+        }
+        field->value[0].flags &= field->value[1].flags;
+        m = MATCHRANGE;
+    }
+    else if (!parse_uservalue_default(value, &field->value[0])) {
+        return false;
+    }
+
+    field->value[0].flags &= group_field_types[i].flags;
+    if (field->value[0].flags == flags_empty) {
+        show_error("`%s` can't be stored in a %s.\n", value, str);
+        return false;
+    }
+    field->width = group_field_types[i].width;
+    field->routine = sm_get_scanroutine(group_field_types[i].type, m, field->value[0].flags,
+                                        reverse_endianness);
+    return (field->routine != NULL);
+}
+
+/* fields with a fixed offset first, exact integers being the most selective */
+static unsigned group_field_rank(const group_field_t *field)
+{
+    if (field->offset < 0)
+        return 0;
+    if (field->value[0].flags & flags_integer)
+        return 4 * field->width + 2;
+    return 4 * field->width + 1;
+}
+
+/* parse the arguments of `group`, the group is allocated and has to be freed by `free_uservalue()` */
+static bool parse_uservalue_group(char **argv, unsigned argc, uservalue_t *val, bool reverse_endianness)
+{
+    group_t *group;
+    long offset = -1;
+    unsigned i, j;
+    char *endptr;
+
+    if ((group = calloc(1, sizeof(group_t))) == NULL) {
+        show_error("memory allocation for group failed.\n");
+        return false;
+    }
+    val->group_value = group;
+
+    for (i = 0; i < argc; i++) {
+        group_field_t *field;
+
+        if (strcmp(argv[i], "within") == 0 && i + 1 < argc) {
+            unsigned long window = strtoul(argv[++i], &endptr, 0);
+            if (*endptr != '\0' || window == 0 || window > MAX_GROUP_WINDOW) {
+                show_error("the window must be between 1 and %d bytes.\n", MAX_GROUP_WINDOW);
+                return false;
+            }
+            group->window = window;
+            continue;
+        }
+        if (argv[i][0] == '+') {
+            offset = strtol(argv[i] + 1, &endptr, 0);
+            if (*endptr != '\0' || argv[i][1] == '\0' || offset < 0 ||
+                offset >= MAX_GROUP_WINDOW) {
+                show_error("bad offset `%s`, see `help group`.\n", argv[i]);
+                return false;
+            }
+            continue;
+        }
+
+        if (group->count == MAX_GROUP_FIELDS) {
+            show_error("a group has at most %d fields.\n", MAX_GROUP_FIELDS);
+            return false;
+        }
+        field = &group->fields[group->count];
+        if (!parse_group_field(argv[i], field, reverse_endianness))
+            return false;
+        /* the first field is at offset 0 */
+        field->offset = (group->count == 0) ? 0 : offset;
+        if (group->count == 0)
+            group->anchor_width = field->width;
+        /* the flags of the first field would hide those of a second one */
+        for (j = 0; j < group->count && field->offset >= 0; j++) {
+            if (group->fields[j].offset == field->offset) {
+                show_error("two fields at offset %d, see `help group`.\n", field->offset);
+                return false;
+            }
+        }
+        group->count++;
+        offset = -1;
+    }
+
+    if (group->count == 0) {
+        show_error("please specify the fields of the group, see `help group`.\n");
+        return false;
+    }
+
+    group->span = group->window;
+    for (i = 0; i < group->count; i++) {
+        const group_field_t *field = &group->fields[i];
+
+        if (field->offset < 0 && group->window == 0) {
+            show_error("fields without an offset need `within <n>`.\n");
+            return false;
+        }
+        if (field->offset >= 0)
+            group->span = MAX(group->span, field->offset + field->width);
+    }
+
+    /* sort the fields by selectivity */
+    for (i = 1; i < group->count; i++) {
+        group_field_t field = group->fields[i];
+        for (j = i; j > 0 && group_field_rank(&group->fields[j - 1]) < group_field_rank(&field); j--)
+            group->fields[j] = group->fields[j - 1];
+        group->fields[j] = field;
+    }
+    return true;
+}
+
+bool handler__group(globals_t * vars, char **argv, unsigned argc)
+{
+    uservalue_t val;
+    bool ret = false;
+
+    zero_uservalue(&val);
+
+    if (argc < 2) {
+        show_error("please specify the fields of the group, see `help group`.\n");
+        return false;
+    }
+    if (!parse_uservalue_group(argv + 1, argc - 1, &val, vars->options.reverse_endianness))
+        goto retl;
+
+    /* matches keep the flags of the first field, so they must be numbers */
+    if (vars->options.scan_data_type == BYTEARRAY || vars->options.scan_data_type == STRING)
+    {
+        show_info("scan_data_type was not a number, it was set automatically.\n");
+        vars->options.scan_data_type = ANYNUMBER;
+    }
+
+    /* need a pid for the rest of this to work */
+    if (!sm_session_has_target(vars)) {
+        goto retl;
+    }
+
+    if (vars->matches) {
+        if (vars->num_matches == 0) {
+            show_error("there are currently no matches.\n");
+            goto retl;
+        }
+        /* already know some matches */
+        if (sm_checkmatches(vars, MATCHEQUALTO, &val) != true) {
+            show_error("failed to search target address space.\n");
+            goto retl;
+        }
+    } else {
+        /* initial search */
+        if (sm_searchregions(vars, MATCHEQUALTO, &val) != true) {
+            show_error("failed to search target address space.\n");
+            goto retl;
+        }
+    }
+
+    /* check if we now know the only possible candidate */
+    if (vars->num_matches == 1) {
+        show_info("match identified, use \"set\" to modify value.\n");
+        show_info("enter \"help\" for other commands.\n");
+    }
+
+    ret = true;
+
+retl:
+    free_uservalue(&val);
+    return ret;
+}
+
 bool handler__default(globals_t * vars, char **argv, unsigned argc)
 {
     uservalue_t vals[2];
@@ -1017,13 +1789,46 @@ bool handler__default(globals_t * vars, char **argv, unsigned argc)
     case INTEGER32:
     case INTEGER64:
     case FLOAT32:
-    case FLOAT64:
-        /* attempt to parse command as a number */
-        if (argc != 1)
-        {
-            show_error("unknown command\n");
-            goto retl;
+    case FLOAT64:
+        /* detect a set or a tolerance, possibly split on spaces */
+        if (argc > 1 || ustr[0] == '{' || ustr[0] == '~' ||
+            strstr(ustr, "+-") || strstr(ustr, "\xc2\xb1")) {
+            char joined[1024] = "";
+            bool ulps;
+            unsigned i;
+
+            /* keep the spaces, a number split by one is an error */
+            for (i = 0; i < argc; i++) {
+                if (strlen(joined) + strlen(argv[i]) + 1 >= sizeof(joined)) {
+                    show_error("the value is too long.\n");
+                    goto retl;
+                }
+                if (i > 0)
+                    strcat(joined, " ");
+                strcat(joined, argv[i]);
+            }
+            if (joined[0] == '{') {
+                if (!parse_uservalue_set(joined, val)) {
+                    show_error("unable to parse set `%s`\n", joined);
+                    goto retl;
+                }
+                m = MATCHANYOF;
+            }
+            else if (parse_uservalue_tolerance(joined, vars->options.float_display_digits,
+                                               vals, &ulps)) {
+                m = ulps ? MATCHWITHINULPS : MATCHRANGE;
+            }
+            else if (argc > 1) {
+                show_error("unknown command\n");
+                goto retl;
+            }
+            else {
+                show_error("unable to parse `%s`\n", joined);
+                goto retl;
+            }
+            break;
         }
+        /* attempt to parse command as a number */
         /* detect a range */
         pos = strstr(ustr, "..");
         if (pos) {
@@ -1068,7 +1873,7 @@ bool handler__default(globals_t * vars, char **argv, unsigned argc)
     }
 
     /* need a pid for the rest of this to work */
-    if (vars->target == 0) {
+    if (!sm_session_has_target(vars)) {
         goto retl;
     }
 
@@ -1144,7 +1949,7 @@ bool handler__help(globals_t *vars, char **argv, unsigned argc)
 
     np = commands->head;
 
-    pager = get_pager(stderr);
+    pager = get_pager(vars, stderr);
 
     /* print version information for generic help */
     if (argv[1] == NULL) {
@@ -1263,6 +2068,10 @@ bool handler__watch(globals_t * vars, char **argv, unsigned argc)
         show_error("`watch` is not supported for bytearray or string.\n");
         return false;
     }
+    if (vars->image) {
+        show_error("the values of an image don't change, `watch` needs a process.\n");
+        return false;
+    }
 
     /* parse argument */
     id = strtoul(argv[1], &end, 0x00);
@@ -1288,7 +2097,7 @@ bool handler__watch(globals_t * vars, char **argv, unsigned argc)
     val = data_to_val(loc.swath, loc.index);
 
     if (INTERRUPTABLE()) {
-        (void) sm_detach(vars->target);
+        (void) sm_session_detach(vars);
         ENDINTERRUPTABLE();
         return true;
     }
@@ -1304,10 +2113,10 @@ bool handler__watch(globals_t * vars, char **argv, unsigned argc)
         const mem64_t *memory_ptr;
         size_t memlength;
 
-        if (sm_attach(vars->target) == false)
+        if (sm_session_attach(vars) == false)
             return false;
 
-        if (sm_peekdata(vars->target, address, sizeof(uint64_t), &memory_ptr, &memlength) == false)
+        if (sm_session_peekdata(vars, address, sizeof(uint64_t), &memory_ptr, &memlength) == false)
             return false;
 
         /* check if the new value is different */
@@ -1326,7 +2135,7 @@ bool handler__watch(globals_t * vars, char **argv, unsigned argc)
         }
 
         /* detach after valuecmp_routine, since it may read more data (e.g. bytearray) */
-        sm_detach(vars->target);
+        sm_session_detach(vars);
 
         (void) sleep(1);
     }
@@ -1357,6 +2166,52 @@ bool handler__show(globals_t * vars, char **argv, unsigned argc)
     return true;
 }
 
+/* print a memory dump in a human-readable format */
+static void print_dump(globals_t *vars, const char *addr, const char *buf, int len)
+{
+    int i,j;
+    int buf_idx = 0;
+    for (i = 0; i + 16 < len; i += 16)
+    {
+        printf("%p: ", addr+i);
+        for (j = 0; j < 16; ++j)
+        {
+            printf("%02X ", (unsigned char)(buf[buf_idx++]));
+        }
+        if(vars->options.dump_with_ascii == 1)
+        {
+            for (j = 0; j < 16; ++j)
+            {
+                char c = buf[i+j];
+                printf("%c", isprint(c) ? c : '.');
+            }
+        }
+        printf("\n");
+    }
+    if (i < len)
+    {
+        printf("%p: ", addr+i);
+        for (j = i; j < len; ++j)
+        {
+            printf("%02X ", (unsigned char)(buf[buf_idx++]));
+        }
+        if(vars->options.dump_with_ascii == 1)
+        {
+            while(j%16 !=0) // skip "empty" numbers
+            {
+                printf("   ");
+                ++j;
+            }
+            for (j = 0; i+j < len; ++j)
+            {
+                char c = buf[i+j];
+                printf("%c", isprint(c) ? c : '.');
+            }
+        }
+        printf("\n");
+    }
+}
+
 bool handler__dump(globals_t * vars, char **argv, unsigned argc)
 {
     char *addr;
@@ -1410,7 +2265,7 @@ bool handler__dump(globals_t * vars, char **argv, unsigned argc)
         return false;
     }
 
-    if (!sm_read_array(vars->target, addr, buf, len))
+    if (!sm_session_read_array(vars, addr, buf, len))
     {
         if (dump_f)
             fclose(dump_f);
@@ -1440,51 +2295,334 @@ bool handler__dump(globals_t * vars, char **argv, unsigned argc)
         else
         {
             /* print it out nicely */
-            int i,j;
-            int buf_idx = 0;
-            for (i = 0; i + 16 < len; i += 16)
-            {
-                printf("%p: ", addr+i);
-                for (j = 0; j < 16; ++j)
-                {
-                    printf("%02X ", (unsigned char)(buf[buf_idx++]));
-                }
-                if(vars->options.dump_with_ascii == 1)
-                {
-                    for (j = 0; j < 16; ++j)
-                    {
-                        char c = buf[i+j];
-                        printf("%c", isprint(c) ? c : '.');
-                    }
-                }
-                printf("\n");
-            }
-            if (i < len)
-            {
-                printf("%p: ", addr+i);
-                for (j = i; j < len; ++j)
-                {
-                    printf("%02X ", (unsigned char)(buf[buf_idx++]));
-                }
-                if(vars->options.dump_with_ascii == 1)
-                {
-                    while(j%16 !=0) // skip "empty" numbers
-                    {
-                        printf("   ");
-                        ++j;
-                    }
-                    for (j = 0; i+j < len; ++j)
-                    {
-                        char c = buf[i+j];
-                        printf("%c", isprint(c) ? c : '.');
-                    }
-                }
-                printf("\n");
-            }
+            print_dump(vars, addr, buf, len);
+        }
+    }
+
+    free(buf);
+    return true;
+}
+
+/* mdump <address> <length> [<address> <length> ...] */
+bool handler__mdump(globals_t * vars, char **argv, unsigned argc)
+{
+    sm_read_request_t *requests;
+    size_t count, i;
+    size_t total_len = 0;
+    char *endptr;
+    char *buf, *data;
+
+    if (argc < 3 || argc % 2 == 0)
+    {
+        show_error("bad argument, see `help mdump`.\n");
+        return false;
+    }
+
+    if (!sm_session_has_target(vars)) {
+        show_error("no target specified, see `help pid`\n");
+        return false;
+    }
+
+    count = argc / 2;
+    if ((requests = calloc(count, sizeof(sm_read_request_t))) == NULL)
+    {
+        show_error("memory allocation failed.\n");
+        return false;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        /* check address */
+        errno = 0;
+        requests[i].addr = (char *)(strtoll(argv[1 + 2*i], &endptr, 16));
+        if ((errno != 0) || (*endptr != '\0'))
+        {
+            show_error("bad address `%s`, see `help mdump`.\n", argv[1 + 2*i]);
+            free(requests);
+            return false;
+        }
+
+        /* check length */
+        errno = 0;
+        requests[i].len = strtoul(argv[2 + 2*i], &endptr, 0);
+        if ((errno != 0) || (*endptr != '\0') || argv[2 + 2*i][0] == '-')
+        {
+            show_error("bad length `%s`, see `help mdump`.\n", argv[2 + 2*i]);
+            free(requests);
+            return false;
         }
+        total_len += requests[i].len;
+    }
+
+    if ((buf = malloc(total_len + 1)) == NULL)
+    {
+        show_error("memory allocation failed.\n");
+        free(requests);
+        return false;
+    }
+
+    if (!sm_session_read_multi(vars, requests, count, buf))
+    {
+        show_error("read memory failed.\n");
+        free(buf);
+        free(requests);
+        return false;
+    }
+
+    if (vars->options.backend == 1)
+    {
+        /* dump raw memory to stdout, the front-end will handle it */
+        fwrite(buf, sizeof(char), total_len, stdout);
+    }
+
+    for (i = 0, data = buf; i < count; data += requests[i].len, i++)
+    {
+        if (!requests[i].ok)
+            show_warn("couldn't read %lu bytes at %p.\n", (unsigned long) requests[i].len,
+                      requests[i].addr);
+        else if (vars->options.backend == 0)
+            print_dump(vars, requests[i].addr, data, requests[i].len);
     }
 
     free(buf);
+    free(requests);
+    return true;
+}
+
+bool handler__pointerscan(globals_t * vars, char **argv, unsigned argc)
+{
+    uintptr_t target;
+    unsigned long depth = 3, maxoffset = 0x400, found;
+    const char *filename = NULL;
+    char *endptr;
+    FILE *out = stdout;
+    sm_ptrmap_t map;
+    unsigned i;
+    bool ret;
+
+    if (argc < 2)
+    {
+        show_error("bad argument, see `help pointerscan`.\n");
+        return false;
+    }
+
+    if (!sm_session_has_target(vars)) {
+        show_error("no target specified, see `help pid`\n");
+        return false;
+    }
+
+    /* check address */
+    errno = 0;
+    target = (uintptr_t)(strtoull(argv[1], &endptr, 16));
+    if ((errno != 0) || (*endptr != '\0'))
+    {
+        show_error("bad address, see `help pointerscan`.\n");
+        return false;
+    }
+
+    /* check options and filename */
+    for (i = 2; i < argc; i++)
+    {
+        unsigned long *option = NULL;
+        const char *value = NULL;
+
+        if (strncmp(argv[i], "depth=", 6) == 0) {
+            option = &depth;
+            value = argv[i] + 6;
+        } else if (strncmp(argv[i], "maxoffset=", 10) == 0) {
+            option = &maxoffset;
+            value = argv[i] + 10;
+        } else if (filename == NULL) {
+            filename = argv[i];
+            continue;
+        } else {
+            show_error("bad argument `%s`, see `help pointerscan`.\n", argv[i]);
+            return false;
+        }
+
+        errno = 0;
+        *option = strtoul(value, &endptr, 0);
+        if ((errno != 0) || (*endptr != '\0') || *value == '\0' || *value == '-')
+        {
+            show_error("bad value `%s`, see `help pointerscan`.\n", argv[i]);
+            return false;
+        }
+    }
+
+    if (depth == 0 || depth > MAX_POINTER_DEPTH) {
+        show_error("depth must be between 1 and %d.\n", MAX_POINTER_DEPTH);
+        return false;
+    }
+
+    if (filename && (out = fopen(filename, "w")) == NULL)
+    {
+        show_error("failed to open `%s`: %s.\n", filename, strerror(errno));
+        return false;
+    }
+
+    show_info("building the pointer map...\n");
+    if (!sm_ptrmap_build(vars, &map)) {
+        if (filename)
+            fclose(out);
+        return false;
+    }
+    show_info("%lu pointers found, searching chains...\n", (unsigned long) map.count);
+
+    ret = sm_pointerscan(vars, &map, target, depth, maxoffset, out, &found);
+    sm_ptrmap_free(&map);
+
+    if (filename)
+        fclose(out);
+    if (ret)
+        show_info("%lu pointer chains found.\n", found);
+    return ret;
+}
+
+bool handler__savepointermap(globals_t * vars, char **argv, unsigned argc)
+{
+    sm_ptrmap_t map;
+    bool ret;
+
+    if (argc != 2)
+    {
+        show_error("bad arguments, see `help savepointermap`.\n");
+        return false;
+    }
+
+    if (!sm_session_has_target(vars)) {
+        show_error("no target specified, see `help pid`\n");
+        return false;
+    }
+
+    if (!sm_ptrmap_build(vars, &map))
+        return false;
+    ret = sm_ptrmap_save(&map, argv[1]);
+    if (ret)
+        show_info("%lu pointers saved to `%s`.\n", (unsigned long) map.count, argv[1]);
+    sm_ptrmap_free(&map);
+    return ret;
+}
+
+bool handler__filterchains(globals_t * vars, char **argv, unsigned argc)
+{
+    uintptr_t target;
+    const char *mapname = NULL, *outname = NULL;
+    unsigned long kept, total;
+    char *endptr;
+    FILE *in, *out = stdout;
+    sm_ptrmap_t map;
+    unsigned i;
+    bool ret;
+
+    if (argc < 3)
+    {
+        show_error("bad arguments, see `help filterchains`.\n");
+        return false;
+    }
+
+    /* check address */
+    errno = 0;
+    target = (uintptr_t)(strtoull(argv[1], &endptr, 16));
+    if ((errno != 0) || (*endptr != '\0'))
+    {
+        show_error("bad address, see `help filterchains`.\n");
+        return false;
+    }
+
+    /* check map and output file */
+    for (i = 3; i < argc; i++)
+    {
+        if (strncmp(argv[i], "map=", 4) == 0 && argv[i][4] != '\0') {
+            mapname = argv[i] + 4;
+        } else if (outname == NULL) {
+            outname = argv[i];
+        } else {
+            show_error("bad argument `%s`, see `help filterchains`.\n", argv[i]);
+            return false;
+        }
+    }
+    if (outname && strcmp(outname, argv[2]) == 0) {
+        show_error("the chains can't be written to the file they are read from.\n");
+        return false;
+    }
+
+    if (mapname) {
+        if (!sm_ptrmap_load(&map, mapname))
+            return false;
+    } else {
+        if (!sm_session_has_target(vars)) {
+            show_error("no target specified, see `help pid`\n");
+            return false;
+        }
+        if (!sm_ptrmap_build(vars, &map))
+            return false;
+    }
+
+    if ((in = fopen(argv[2], "r")) == NULL) {
+        show_error("failed to open `%s`: %s.\n", argv[2], strerror(errno));
+        sm_ptrmap_free(&map);
+        return false;
+    }
+    if (outname && (out = fopen(outname, "w")) == NULL) {
+        show_error("failed to open `%s`: %s.\n", outname, strerror(errno));
+        fclose(in);
+        sm_ptrmap_free(&map);
+        return false;
+    }
+
+    ret = sm_filterchains(&map, target, in, out, &kept, &total);
+    sm_ptrmap_free(&map);
+    fclose(in);
+    if (outname)
+        fclose(out);
+    if (ret)
+        show_info("%lu of %lu pointer chains kept.\n", kept, total);
+    return ret;
+}
+
+bool handler__pointers_to(globals_t * vars, char **argv, unsigned argc)
+{
+    uintptr_t start, end;
+    const sm_ptr_t *ptrs;
+    size_t count, nread, i;
+    bool rebuild = false;
+    char *endptr;
+
+    if (argc == 3 && strcmp(argv[2], "refresh") == 0) {
+        rebuild = true;
+    } else if (argc != 2) {
+        show_error("bad arguments, see `help pointers_to`.\n");
+        return false;
+    }
+
+    if (!sm_session_has_target(vars)) {
+        show_error("no target specified, see `help pid`\n");
+        return false;
+    }
+
+    /* check the address range */
+    errno = 0;
+    start = (uintptr_t)(strtoull(argv[1], &endptr, 16));
+    if (errno == 0 && *endptr == '-')
+        end = (uintptr_t)(strtoull(endptr + 1, &endptr, 16));
+    else
+        end = start + 1;
+    if ((errno != 0) || (*endptr != '\0') || end <= start)
+    {
+        show_error("bad address range, see `help pointers_to`.\n");
+        return false;
+    }
+
+    if (!sm_ptrindex_update(vars, rebuild, &nread))
+        return false;
+    if (nread > 0)
+        show_info("%lu regions indexed.\n", (unsigned long) nread);
+
+    count = sm_ptrindex_query(vars, start, end, &ptrs);
+    for (i = 0; i < count; i++)
+        printf("[%2lu] %10lx -> %10lx\n", (unsigned long) i, (unsigned long) ptrs[i].holder,
+               (unsigned long) ptrs[i].value);
+    show_info("%lu pointers found.\n", (unsigned long) count);
     return true;
 }
 
@@ -1682,7 +2820,7 @@ bool handler__write(globals_t * vars, char **argv, unsigned argc)
             }
             if (wildcard_used)
             {
-                if(!sm_read_array(vars->target, addr, buf, data_width))
+                if(!sm_session_read_array(vars, addr, buf, data_width))
                 {
                     show_error("read memory failed.\n");
                     free_uservalue(&val_buf);
@@ -1709,7 +2847,7 @@ bool handler__write(globals_t * vars, char **argv, unsigned argc)
     }
 
     /* write into memory */
-    ret = sm_write_array(vars->target, addr, buf, data_width);
+    ret = sm_session_write_array(vars, addr, buf, data_width);
 
 retl:
     if(buf)
@@ -1719,6 +2857,22 @@ retl:
 
 bool handler__option(globals_t * vars, char **argv, unsigned argc)
 {
+    if (argc >= 3 && strcasecmp(argv[1], "region_filter") == 0)
+    {
+        /* the expression is the rest of the line, spaces included */
+        const char *expr = strstr(vars->current_cmdline, argv[1]) + strlen(argv[1]);
+        sm_region_filter_t *filter = NULL;
+
+        expr += strspn(expr, " \t");
+        if (strcasecmp(argv[2], "none") != 0 || argc > 3) {
+            if ((filter = sm_region_filter_compile(expr)) == NULL)
+                return false;
+        }
+        sm_region_filter_free(vars->options.region_filter);
+        vars->options.region_filter = filter;
+        return true;
+    }
+
     /* this might need to change */
     if (argc != 3)
     {
@@ -1773,6 +2927,66 @@ bool handler__option(globals_t * vars, char **argv, unsigned argc)
             return false;
         }
     }
+    else if (strcasecmp(argv[1], "string_encoding") == 0)
+    {
+        if (strcasecmp(argv[2], "utf8") == 0) {vars->options.string_encoding = ENCODING_UTF8; }
+        else if (strcasecmp(argv[2], "utf16le") == 0) {vars->options.string_encoding = ENCODING_UTF16LE; }
+        else if (strcasecmp(argv[2], "utf16be") == 0) {vars->options.string_encoding = ENCODING_UTF16BE; }
+        else
+        {
+            show_error("bad value for string_encoding, see `help option`.\n");
+            return false;
+        }
+    }
+    else if (strcasecmp(argv[1], "string_case") == 0)
+    {
+        if (strcasecmp(argv[2], "sensitive") == 0) {vars->options.string_ignore_case = 0; }
+        else if (strcasecmp(argv[2], "insensitive") == 0) {vars->options.string_ignore_case = 1; }
+        else
+        {
+            show_error("bad value for string_case, see `help option`.\n");
+            return false;
+        }
+    }
+    else if (strcasecmp(argv[1], "float_display_digits") == 0)
+    {
+        char *endptr;
+        long digits = strtol(argv[2], &endptr, 10);
+
+        if (strcmp(argv[2], "auto") == 0) {vars->options.float_display_digits = -1; }
+        else if (*argv[2] != '\0' && *endptr == '\0' && digits >= 0 && digits <= 17) {
+            vars->options.float_display_digits = digits;
+        }
+        else
+        {
+            show_error("bad value for float_display_digits, see `help option`.\n");
+            return false;
+        }
+    }
+    else if (strcasecmp(argv[1], "memory_budget") == 0)
+    {
+        char *endptr;
+        unsigned long long budget, scale = 1;
+
+        errno = 0;
+        budget = strtoull(argv[2], &endptr, 0);
+        switch (toupper((unsigned char) *endptr)) {
+        case 'K': scale = 1ULL << 10; endptr++; break;
+        case 'M': scale = 1ULL << 20; endptr++; break;
+        case 'G': scale = 1ULL << 30; endptr++; break;
+        case 'T': scale = 1ULL << 40; endptr++; break;
+        }
+        if (strcasecmp(argv[2], "none") == 0) {vars->options.memory_budget = 0; }
+        else if (isdigit((unsigned char) *argv[2]) && *endptr == '\0' && errno != ERANGE &&
+                 budget <= SIZE_MAX / scale) {
+            vars->options.memory_budget = budget * scale;
+        }
+        else
+        {
+            show_error("bad value for memory_budget, see `help option`.\n");
+            return false;
+        }
+    }
     else
     {
         show_error("unknown option specified, see `help option`.\n");
@@ -121,6 +121,16 @@ bool handler__delete(globals_t *vars, char **argv, unsigned argc);
 
 bool handler__reset(globals_t *vars, char **argv, unsigned argc);
 
+#define REFRESH_SHRTDOC "reread regions, keeping the matches that are still mapped"
+#define REFRESH_LONGDOC "usage: refresh\n" \
+                "Reread the regions from the relevant maps file like `reset`, but keep\n" \
+                "the matches in memory that is still mapped to the same file. Matches in\n" \
+                "unmapped memory, or in regions no longer selected by `region_scan_level`,\n" \
+                "are deleted. New regions are searched by the next initial scan only.\n" \
+                "Useful after the target has allocated or freed memory.\n"
+
+bool handler__refresh(globals_t *vars, char **argv, unsigned argc);
+
 #define PID_SHRTDOC "print current pid, or attach to a new process"
 #define PID_LONGDOC "usage: pid [pid]\n" \
                 "If `pid` is specified, reset current session and then attach to new\n" \
@@ -129,6 +139,79 @@ bool handler__reset(globals_t *vars, char **argv, unsigned argc);
 
 bool handler__pid(globals_t *vars, char **argv, unsigned argc);
 
+#define SAVEMATCHES_SHRTDOC "save the matches in modules to a file"
+#define SAVEMATCHES_LONGDOC "usage: savematches <filename>\n" \
+                "\n" \
+                "Save the matches in exe and code regions to <filename>, each one as\n" \
+                "its module name and its offset from the load address of the module,\n" \
+                "like the pointer chains. The other matches are skipped, as their\n" \
+                "addresses change with every run of the target.\n"
+
+bool handler__savematches(globals_t *vars, char **argv, unsigned argc);
+
+#define LOADMATCHES_SHRTDOC "replace the matches by those saved to a file"
+#define LOADMATCHES_LONGDOC "usage: loadmatches <filename>\n" \
+                "\n" \
+                "Replace the matches by those saved with `savematches`, at the load\n" \
+                "addresses of their modules in the target, which may have been\n" \
+                "restarted since. scan_data_type is set to the one of the matches,\n" \
+                "and their values are read again as with `update`.\n"
+
+bool handler__loadmatches(globals_t *vars, char **argv, unsigned argc);
+
+#define RETARGET_SHRTDOC "attach to a new process, moving the matches in modules to it"
+#define RETARGET_LONGDOC "usage: retarget <pid>\n" \
+                "\n" \
+                "Attach to the process `pid` like `pid`, but keep the matches in exe\n" \
+                "and code regions, moved to the load addresses of their modules in the\n" \
+                "new process, and read their values again as with `update`. Useful\n" \
+                "when the target has been restarted: the search doesn't have to be\n" \
+                "done again.\n"
+
+bool handler__retarget(globals_t *vars, char **argv, unsigned argc);
+
+#define OPEN_SHRTDOC "scan a core file or a saved image instead of a process"
+#define OPEN_LONGDOC "usage: open [<filename>]\n" \
+                "\n" \
+                "Reset the current session and scan <filename> instead of a process.\n" \
+                "It is either an ELF core file, whose memory is in its PT_LOAD segments,\n" \
+                "or an image saved with `saveimage`, with its regions in the sidecar\n" \
+                "<filename>.maps. The file is mapped and searched in place. Searches,\n" \
+                "`list`, `dump` and the pointer commands work as with a process, but\n" \
+                "the image is read-only. `pid` goes back to a process.\n" \
+                "Without <filename>, print the name of the open image.\n"
+
+bool handler__open(globals_t *vars, char **argv, unsigned argc);
+
+#define DIFF_SHRTDOC "compare two images, keeping the values in the pages which changed"
+#define DIFF_LONGDOC "usage: diff <before> <after> [<value>]\n" \
+                "\n" \
+                "Open the image <after> like `open`, and find the pages which differ\n" \
+                "in the image <before>. The matches are the values of <before> in\n" \
+                "these pages, all of them as with `snapshot`, or those equal to\n" \
+                "<value>, which is given as to a search. The next search compares the\n" \
+                "values of <after> to them, so that e.g. `!=` keeps the values which\n" \
+                "changed, `+ 1` those which increased by 1 and `<value>` those which\n" \
+                "went to <value>. The unchanged pages are never searched.\n" \
+                "\n" \
+                "Example:\n" \
+                "\tdiff before.img after.img 100\n" \
+                "\t120 - values which went from 100 to 120\n"
+
+bool handler__diff(globals_t *vars, char **argv, unsigned argc);
+
+#define SAVEIMAGE_SHRTDOC "save the memory of the target to an image for `open`"
+#define SAVEIMAGE_LONGDOC "usage: saveimage <filename>\n" \
+                "\n" \
+                "Save the contents of every readable region of the target to\n" \
+                "<filename>, one after the other, and their addresses to\n" \
+                "<filename>.maps, in the format of /proc/pid/maps with the offsets of\n" \
+                "the regions in <filename>. The image can be opened with `open` later,\n" \
+                "e.g. to compare it with another one or to repeat searches on the same\n" \
+                "memory. region_scan_level and region_filter apply when it is opened.\n"
+
+bool handler__saveimage(globals_t *vars, char **argv, unsigned argc);
+
 #define SNAPSHOT_SHRTDOC "take a snapshot of the current process state"
 #define SNAPSHOT_LONGDOC "usage: snapshot\n" \
                 "Take a snapshot of the entire process in its current state. This is useful\n" \
@@ -203,6 +286,17 @@ bool handler__operators(globals_t *vars, char **argv, unsigned argc);
 
 bool handler__version(globals_t *vars, char **argv, unsigned argc);
 
+#define STATS_SHRTDOC "print the time spent in each phase and other counters"
+#define STATS_LONGDOC "usage: stats [reset]\n" \
+                "Print the time spent attaching, reading, scanning, writing and\n" \
+                "detaching since scanmem started or since `stats reset`, the number\n" \
+                "of searches, rescans, sets and reads, of system calls made on the\n" \
+                "target, of bytes read, of reallocations of the matches, the hit\n" \
+                "rate of the cache used by rescans and `set`, the memory used by the\n" \
+                "matches now, per match and at most, and the largest scan buffer.\n"
+
+bool handler__stats(globals_t *vars, char **argv, unsigned argc);
+
 #define EXIT_SHRTDOC "exit the program immediately"
 #define EXIT_LONGDOC "usage: exit\n" \
                 "Exit scanmem immediately, zero will be returned."
@@ -222,6 +316,11 @@ bool handler__help(globals_t *vars, char **argv, unsigned argc);
                 "hexadecimal, leading 0 for octal, everything else is assumed to be decimal).\n" \
                 "Float numbers are also acceptable, but will be rounded if scanning integers.\n" \
                 "Use \'..\' for a range, e.g. \'1..3\' searches between 1 and 3 inclusive.\n" \
+                "Use braces for a set, e.g. \'{1,10,100}\' searches for any of these values.\n" \
+                "Use \'~\' for what is displayed, e.g. \'~12.5\' searches between 12.45 and 12.55,\n" \
+                "see `help option` for float_display_digits. Use \'+-\' (or \'\xc2\xb1\') for a\n" \
+                "tolerance, e.g. \'12.5+-0.1\', or a number of units in the last place of floats,\n" \
+                "e.g. \'12.5+-4ulp\'.\n" \
                 "\n" \
                 "When searching for an array of byte, use 2-byte hexadecimal notation, \n" \
                 "separated by spaces, wildcard '?\?' is also supported. E.g. FF ?\? EE ?\? 02 01\n" \
@@ -239,11 +338,67 @@ bool handler__default(globals_t *vars, char **argv, unsigned argc);
 #define STRING_LONGDOC "usage \" <text>\n" \
                 "<text> is counted since the 2nd character following the leading \"\n" \
                 "scan_data_type will be set to be string, if it currently isn't.\n" \
+                "The options string_encoding and string_case select UTF-16 strings\n" \
+                "and strings in any case, see `help option`.\n" \
                 "Example:\n" \
                 "\t\" Scan for string, spaces and ' \" are all acceptable.\n"
 
 bool handler__string(globals_t *vars, char **argv, unsigned argc);
 
+#define REGEX_SHRTDOC "match a regular expression"
+#define REGEX_LONGDOC "usage: regex <pattern>\n" \
+                "Search memory for the bytes matching <pattern>, which is everything\n" \
+                "after the first space following `regex`. The longest match at an\n" \
+                "address is recorded as a string, and matches don't overlap.\n" \
+                "When there are matches, each of them is checked again for a match\n" \
+                "within its old length.\n" \
+                "The syntax is that of extended regular expressions on bytes:\n" \
+                "\t.  [abc]  [^a-z]  \\d \\w \\s \\D \\W \\S  \\n \\t \\r \\0 \\xHH\n" \
+                "\t(...)  (?:...)  a|b  *  +  ?  {m}  {m,}  {m,n}\n" \
+                "`.` matches any byte but NUL and newline, there are no anchors.\n" \
+                "string_case insensitive makes letters match in any case.\n" \
+                "scan_data_type will be set to be string, if it currently isn't.\n" \
+                "Example:\n" \
+                "\tregex score: ?\\d+\n"
+
+bool handler__regex(globals_t *vars, char **argv, unsigned argc);
+
+#define SIGNATURES_SHRTDOC "match many byte signatures in a single pass"
+#define SIGNATURES_LONGDOC "usage: signatures <file>\n" \
+                "Search memory for all the signatures of <file> at once. Each line of\n" \
+                "<file> is a signature, a name followed by bytes as for bytearray\n" \
+                "scans, where `?` is also any byte. Empty lines and lines starting with\n" \
+                "`#` are skipped. The id of a signature is its index in the file, from 0.\n" \
+                "Each match is the first signature matching at its address, `list`\n" \
+                "shows which one, and the number of matches of each signature is told.\n" \
+                "When there are matches, they are checked again within their old length.\n" \
+                "scan_data_type will be set to be bytearray, if it currently isn't.\n" \
+                "Example of <file>:\n" \
+                "\t# name       bytes\n" \
+                "\tplayer_vtbl  48 8b 05 ?? ?? ?? ?? 48 85 c0\n" \
+                "\telf_header   7f 45 4c 46 02 01 01\n"
+
+bool handler__signatures(globals_t *vars, char **argv, unsigned argc);
+
+#define GROUP_SHRTDOC "match several values at offsets from each other"
+#define GROUP_LONGDOC "usage: group <type>:<value> [[+<offset>] <type>:<value> ...] [within <n>]\n" \
+                "\n" \
+                "Match the fields of a structure in a single pass, instead of scanning\n" \
+                "for each value and comparing the addresses. The address of a match is\n" \
+                "the address of the first field, the others are found at <offset> bytes\n" \
+                "from it. Fields without an offset may be anywhere in the first <n>\n" \
+                "bytes from the first field, aligned to their size.\n" \
+                "Types are int8, int16, int32, int64, float32 (or float) and float64\n" \
+                "(or double), a value may be a range `<min>..<max>`.\n" \
+                "When there are matches, the group is checked again at each match.\n" \
+                "The matches keep the type of the first field.\n" \
+                "\n" \
+                "Example:\n" \
+                "\tgroup int32:100 +4 float:1.5 +16 int16:30\n" \
+                "\tgroup int32:100 float:0..2 within 64\n"
+
+bool handler__group(globals_t *vars, char **argv, unsigned argc);
+
 #define UPDATE_SHRTDOC "update match values without culling list"
 #define UPDATE_LONGDOC "usage: update\n" \
                 "Scans the current process, getting the current values of all matches.\n" \
@@ -292,6 +447,85 @@ bool handler__show(globals_t *vars, char **argv, unsigned argc);
     
 bool handler__dump(globals_t *vars, char **argv, unsigned argc);
 
+#define MDUMP_SHRTDOC "dump many small memory areas at once"
+#define MDUMP_LONGDOC "usage: mdump <address> <length> [<address> <length> ...]\n" \
+                "\n" \
+                "Read all the given memory areas with a single stop of the target.\n" \
+                "As a backend, the raw data of all the areas is written consecutively\n" \
+                "to stdout, with the areas that can't be read filled with zeros.\n" \
+                "Otherwise each area is displayed like with `dump`.\n" \
+                "\n" \
+                "Example:\n" \
+                "\tmdump 60103e 4 601040 8 7ffd1230 2\n"
+
+bool handler__mdump(globals_t *vars, char **argv, unsigned argc);
+
+#define POINTERSCAN_SHRTDOC "find pointer chains from static addresses to an address"
+#define POINTERSCAN_LONGDOC "usage: pointerscan <address> [depth=<n>] [maxoffset=<m>] [<filename>]\n" \
+                "\n" \
+                "Find the chains of pointers which lead from a static address, in an\n" \
+                "exe or code region, to <address>. Such a chain stays valid when the\n" \
+                "program is restarted, while <address> often doesn't.\n" \
+                "All the pointers within the known regions are indexed first, then the\n" \
+                "chains are searched backwards from <address>, using all the CPUs.\n" \
+                "\n" \
+                "depth: maximum number of pointers in a chain, 3 by default\n" \
+                "maxoffset: maximum offset added after each dereference, 0x400 by default\n" \
+                "\n" \
+                "Every chain is written as one line to <filename>, or to stdout:\n" \
+                "\t<module>+<offset> <offset 1> ... <offset n>\n" \
+                "meaning: read the pointer at the load address of <module> plus <offset>,\n" \
+                "add <offset 1>, read the pointer there, and so on. Adding <offset n>\n" \
+                "to the last pointer read gives the address. Spaces, control characters\n" \
+                "and backslashes in <module> are written as \\xNN.\n" \
+                "\n" \
+                "Example:\n" \
+                "\tpointerscan 7f1234560010 depth=4 maxoffset=0x1000 chains.txt\n"
+
+bool handler__pointerscan(globals_t *vars, char **argv, unsigned argc);
+
+#define POINTERS_TO_SHRTDOC "list the addresses holding a pointer into a range"
+#define POINTERS_TO_LONGDOC "usage: pointers_to <start>-<end> [refresh]\n" \
+                "       pointers_to <address> [refresh]\n" \
+                "\n" \
+                "List every pointer-aligned address of the known regions which holds a\n" \
+                "value from <start> to <end>, <end> excluded, or equal to <address>.\n" \
+                "The values are looked up in an index of the known regions, built by the\n" \
+                "first query and kept until the regions change: then only the new regions\n" \
+                "are read. The index is a snapshot, use `refresh` to read all the\n" \
+                "regions again.\n" \
+                "\n" \
+                "Example:\n" \
+                "\tpointers_to 7f1234560000-7f1234560100\n"
+
+bool handler__pointers_to(globals_t *vars, char **argv, unsigned argc);
+
+#define SAVEPOINTERMAP_SHRTDOC "save the pointer map of the target to a file"
+#define SAVEPOINTERMAP_LONGDOC "usage: savepointermap <filename>\n" \
+                "\n" \
+                "Save all the pointers from known regions into known regions, along\n" \
+                "with the load address of every module, to <filename>. The file can be\n" \
+                "given to `filterchains` once the target has been restarted.\n"
+
+bool handler__savepointermap(globals_t *vars, char **argv, unsigned argc);
+
+#define FILTERCHAINS_SHRTDOC "keep the pointer chains that still lead to an address"
+#define FILTERCHAINS_LONGDOC "usage: filterchains <address> <chainfile> [map=<mapfile>] [<filename>]\n" \
+                "\n" \
+                "Follow every pointer chain of <chainfile>, as written by `pointerscan`,\n" \
+                "and keep the ones which lead to <address>. The chains are followed\n" \
+                "through a fresh pointer map of the target, or through <mapfile> saved\n" \
+                "by `savepointermap`. The chains kept are written to <filename>, or to\n" \
+                "stdout.\n" \
+                "\n" \
+                "This checks chains found in a previous run of the target with one map\n" \
+                "of the new run, instead of searching chains again:\n" \
+                "\tpointerscan 7f1234560010 chains1.txt\n" \
+                "\t(restart the target and find the address again)\n" \
+                "\tfilterchains 7f6543210010 chains1.txt chains2.txt\n"
+
+bool handler__filterchains(globals_t *vars, char **argv, unsigned argc);
+
 #define WRITE_SHRTDOC "change the value of a specific memory location"
 #define WRITE_LONGDOC "usage: write <value_type> <address> <value>\n" \
                 "\n" \
@@ -336,6 +570,20 @@ bool handler__write(globals_t *vars, char **argv, unsigned argc);
                  "\t2:\theap, stack executable and bss only\n" \
                  "\t3:\teverything(e.g. other libs)\n" \
                  "\n" \
+                 "region_filter\texpression selecting the readable regions to scan\n" \
+                 "\t\t\tinstead of region_scan_level, used by the next `reset'\n" \
+                 "\t\t\tDefault:none\n" \
+                 "\n" \
+                 "\tproperties, combined with !, &, | and parentheses,\n" \
+                 "\t& binding tighter than |:\n" \
+                 "\tmisc, code, exe, heap, stack:\tthe region type\n" \
+                 "\tanon:\t\t\tno associated file\n" \
+                 "\tpath=<glob>:\t\tthe associated file matches the glob\n" \
+                 "\tperm=<rwxsp>:\t\tall of these permissions\n" \
+                 "\tsize<N, <=, >, >=, =:\tsize in bytes, with a K, M, G or T suffix\n" \
+                 "\taddr=<start>[-<end>]:\toverlaps the hexadecimal address range\n" \
+                 "\tnone:\t\t\tuse region_scan_level again\n" \
+                 "\n" \
                  "dump_with_ascii\twhether to print ascii characters with a memory dump\n" \
                  "\t\t\tDefault:1\n" \
                  "\n" \
@@ -351,8 +599,42 @@ bool handler__write(globals_t *vars, char **argv, unsigned argc);
                  "\t1:\tlittle endian\n" \
                  "\t2:\tbig endian\n" \
                  "\n" \
-                 "Example:\n" \
-                 "\toption scan_data_type int32\n"
+                 "string_encoding\tencoding of the strings searched with `\"`\n" \
+                 "\t\t\tDefault:utf8\n" \
+                 "\n" \
+                 "\tpossible values:\n" \
+                 "\tutf8:\t\tUTF-8 or any ASCII-compatible encoding\n" \
+                 "\tutf16le:\tUTF-16 little endian (e.g. Windows, .NET)\n" \
+                 "\tutf16be:\tUTF-16 big endian (e.g. Java class files)\n" \
+                 "\n" \
+                 "string_case\twhether strings are searched regardless of case\n" \
+                 "\t\t\tDefault:sensitive\n" \
+                 "\n" \
+                 "\tpossible values:\n" \
+                 "\tsensitive:\tmatch the case\n" \
+                 "\tinsensitive:\tignore the case of ASCII letters\n" \
+                 "\n" \
+                 "float_display_digits\tnumber of decimals shown for the values searched\n" \
+                 "\t\t\twith `~v`, which match anything displayed as v\n" \
+                 "\t\t\tDefault:auto\n" \
+                 "\n" \
+                 "\tpossible values:\n" \
+                 "\t0-17:\tthe number of decimals\n" \
+                 "\tauto:\tthe number of decimals written in v\n" \
+                 "\n" \
+                 "memory_budget\tmemory for the matches and the buffers of a search\n" \
+                 "\t\t\tDefault:none\n" \
+                 "\tregions larger than what is left are read in slices, the\n" \
+                 "\tsearch stops with the matches found so far when it is reached\n" \
+                 "\n" \
+                 "\tpossible values:\n" \
+                 "\tN:\tbytes, with a K, M, G or T suffix\n" \
+                 "\tnone:\tno limit\n" \
+                 "\n" \
+                 "Examples:\n" \
+                 "\toption scan_data_type int32\n" \
+                 "\toption region_filter (heap|stack|anon) & size<1G & !path=*libnvidia*\n" \
+                 "\toption memory_budget 512M\n"
 
 bool handler__option(globals_t *vars, char **argv, unsigned argc);
 
@@ -0,0 +1,554 @@
+/*
+    Memory images: core files and saved regions, scanned without a process.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "image.h"
+#include "common.h"
+#include "regionfilter.h"
+#include "show_message.h"
+
+/* cores of the same word size as scanmem */
+#if UINTPTR_MAX == UINT64_MAX
+# define IMAGE_ELFCLASS ELFCLASS64
+typedef Elf64_Ehdr elf_ehdr_t;
+typedef Elf64_Phdr elf_phdr_t;
+typedef Elf64_Nhdr elf_nhdr_t;
+#else
+# define IMAGE_ELFCLASS ELFCLASS32
+typedef Elf32_Ehdr elf_ehdr_t;
+typedef Elf32_Phdr elf_phdr_t;
+typedef Elf32_Nhdr elf_nhdr_t;
+#endif
+
+#define IMAGE_CHUNK_SIZE (1 << 20)
+
+/* images are compared by pages, the values around a changed page are kept */
+#define IMAGE_DIFF_BLOCK (4096)
+#define IMAGE_DIFF_MARGIN (sizeof(uint64_t) - 1)
+
+struct sm_image {
+    char *path;
+    uint8_t *data;              /* the whole file, mapped read-only */
+    size_t length;
+    sm_segment_t *segments;     /* sorted by address */
+    size_t count;
+    const char *exename;
+    char *text;                 /* of the sidecar, which holds the file names */
+};
+
+static bool add_segment(sm_image_t *image, size_t *capacity, const sm_segment_t *segment)
+{
+    if (image->count == *capacity) {
+        size_t n = *capacity ? *capacity * 2 : 64;
+        sm_segment_t *segments = realloc(image->segments, n * sizeof(sm_segment_t));
+        if (segments == NULL)
+            return false;
+        image->segments = segments;
+        *capacity = n;
+    }
+    image->segments[image->count++] = *segment;
+    return true;
+}
+
+static int cmp_segments(const void *a, const void *b)
+{
+    const sm_segment_t *x = a, *y = b;
+
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+/* the file names of the mappings and addresses in the exe and the stack,
+ * from the notes */
+typedef struct {
+    const unsigned long *files; /* start, end and offset of each mapping */
+    const char *names;          /* one after the other */
+    const char *names_end;
+    size_t nfiles;
+    unsigned long entry;
+    unsigned long random;       /* the random bytes given on the stack */
+} core_notes_t;
+
+static void read_notes(const uint8_t *data, size_t size, core_notes_t *notes)
+{
+    size_t pos = 0;
+
+    while (pos + sizeof(elf_nhdr_t) <= size) {
+        const elf_nhdr_t *nhdr = (const elf_nhdr_t *) (data + pos);
+        size_t desc = pos + sizeof(elf_nhdr_t) + ((nhdr->n_namesz + 3) & ~3UL);
+        size_t next = desc + ((nhdr->n_descsz + 3) & ~3UL);
+        const unsigned long *words = (const unsigned long *) (data + desc);
+        size_t nwords = nhdr->n_descsz / sizeof(unsigned long);
+
+        if (next > size || next <= pos)
+            break;
+
+        if (nhdr->n_type == NT_FILE && nwords >= 2 && (nwords - 2) / 3 >= words[0]) {
+            /* count, page size, then start, end and offset of each file */
+            notes->nfiles = words[0];
+            notes->files = words + 2;
+            notes->names = (const char *) (words + 2 + 3 * words[0]);
+            notes->names_end = (const char *) (data + desc + nhdr->n_descsz);
+        } else if (nhdr->n_type == NT_AUXV) {
+            for (size_t i = 0; i + 1 < nwords && words[i] != AT_NULL; i += 2) {
+                if (words[i] == AT_ENTRY)
+                    notes->entry = words[i + 1];
+                else if (words[i] == AT_RANDOM)
+                    notes->random = words[i + 1];
+            }
+        }
+        pos = next;
+    }
+}
+
+/* name the segments of a core from its mapped files, and its stack */
+static void name_segments(sm_image_t *image, const core_notes_t *notes)
+{
+    const char *name = notes->names;
+    size_t i, j = 0;
+
+    for (i = 0; i < image->count; i++) {
+        sm_segment_t *s = &image->segments[i];
+        if (s->start <= notes->random && notes->random < s->end)
+            s->filename = "[stack]";
+    }
+
+    for (i = 0; i < notes->nfiles && name < notes->names_end; i++) {
+        const char *end = memchr(name, '\0', notes->names_end - name);
+        unsigned long start = notes->files[3 * i], stop = notes->files[3 * i + 1];
+
+        if (end == NULL)
+            break;
+        if (start <= notes->entry && notes->entry < stop)
+            image->exename = name;
+        /* the files are sorted by address too */
+        while (j < image->count && image->segments[j].start < start)
+            j++;
+        for (; j < image->count && image->segments[j].start < stop; j++)
+            image->segments[j].filename = name;
+        name = end + 1;
+    }
+}
+
+static bool open_core(sm_image_t *image)
+{
+    const elf_ehdr_t *ehdr = (const elf_ehdr_t *) image->data;
+    core_notes_t notes;
+    size_t capacity = 0;
+
+    if (ehdr->e_ident[EI_CLASS] != IMAGE_ELFCLASS ||
+        ehdr->e_phentsize != sizeof(elf_phdr_t) ||
+        ehdr->e_phoff + (size_t) ehdr->e_phnum * sizeof(elf_phdr_t) > image->length) {
+        show_error("%s is not a core file of this architecture.\n", image->path);
+        return false;
+    }
+
+    memset(&notes, 0, sizeof(notes));
+    for (unsigned i = 0; i < ehdr->e_phnum; i++) {
+        const elf_phdr_t *phdr = (const elf_phdr_t *) (image->data + ehdr->e_phoff) + i;
+        sm_segment_t segment;
+
+        if (phdr->p_offset > image->length)
+            continue;
+        if (phdr->p_type == PT_NOTE) {
+            read_notes(image->data + phdr->p_offset,
+                       MIN(phdr->p_filesz, image->length - phdr->p_offset), &notes);
+            continue;
+        }
+        if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0)
+            continue;
+
+        segment.start = phdr->p_vaddr;
+        segment.end = phdr->p_vaddr + phdr->p_memsz;
+        segment.offset = phdr->p_offset;
+        /* a truncated core still has the beginning of the data */
+        segment.filesz = MIN(MIN(phdr->p_filesz, phdr->p_memsz), image->length - phdr->p_offset);
+        segment.perms[0] = (phdr->p_flags & PF_R) ? 'r' : '-';
+        segment.perms[1] = (phdr->p_flags & PF_W) ? 'w' : '-';
+        segment.perms[2] = (phdr->p_flags & PF_X) ? 'x' : '-';
+        segment.perms[3] = 'p';
+        segment.filename = "";
+        if (!add_segment(image, &capacity, &segment)) {
+            show_error("sorry, there was a memory allocation error.\n");
+            return false;
+        }
+    }
+
+    qsort(image->segments, image->count, sizeof(sm_segment_t), cmp_segments);
+    name_segments(image, &notes);
+    return true;
+}
+
+/* read the sidecar of a raw image: `# exe <path>`, then maps lines */
+static bool open_raw(sm_image_t *image)
+{
+    char *sidecar, *line, *next;
+    size_t capacity = 0, length = 0;
+    unsigned lineno = 0;
+    FILE *f;
+
+    if (asprintf(&sidecar, "%s.maps", image->path) < 0) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+    if ((f = fopen(sidecar, "r")) == NULL) {
+        show_error("%s is neither a core file nor a raw image with a sidecar %s.\n",
+                   image->path, sidecar);
+        free(sidecar);
+        return false;
+    }
+    if (getdelim(&image->text, &length, '\0', f) < 0 && ferror(f)) {
+        show_error("failed to read %s.\n", sidecar);
+        fclose(f);
+        free(sidecar);
+        return false;
+    }
+    fclose(f);
+
+    for (line = image->text; line && *line; line = next) {
+        sm_segment_t segment;
+        unsigned long end;
+        int name = 0;
+
+        if ((next = strchr(line, '\n')) != NULL)
+            *next++ = '\0';
+        ++lineno;
+        if (strncmp(line, "# exe ", 6) == 0) {
+            image->exename = line + 6;
+            continue;
+        }
+        if (line[0] == '#' || line[0] == '\0')
+            continue;
+
+        if (sscanf(line, "%lx-%lx %4c %lx %*s %*s %n", &segment.start, &segment.end,
+                   segment.perms, &segment.offset, &name) != 4 || name == 0 ||
+            segment.end < segment.start) {
+            show_error("unexpected line %u in %s.\n", lineno, sidecar);
+            free(sidecar);
+            return false;
+        }
+        end = segment.offset + (segment.end - segment.start);
+        if (segment.offset > image->length || end > image->length || end < segment.offset) {
+            show_error("line %u of %s is beyond the end of the image.\n", lineno, sidecar);
+            free(sidecar);
+            return false;
+        }
+        segment.filesz = segment.end - segment.start;
+        segment.filename = line + name;
+        if (!add_segment(image, &capacity, &segment)) {
+            show_error("sorry, there was a memory allocation error.\n");
+            free(sidecar);
+            return false;
+        }
+    }
+
+    free(sidecar);
+    qsort(image->segments, image->count, sizeof(sm_segment_t), cmp_segments);
+    return true;
+}
+
+sm_image_t *sm_image_open(const char *path)
+{
+    sm_image_t *image;
+    struct stat st;
+    bool ok;
+    int fd;
+
+    if ((image = calloc(1, sizeof(sm_image_t))) == NULL ||
+        (image->path = strdup(path)) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        free(image);
+        return NULL;
+    }
+    image->exename = "";
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1 || fstat(fd, &st) == -1) {
+        show_error("failed to open %s, %s.\n", path, strerror(errno));
+        if (fd != -1)
+            close(fd);
+        sm_image_close(image);
+        return NULL;
+    }
+    image->length = st.st_size;
+    if (image->length > 0) {
+        image->data = mmap(NULL, image->length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (image->data == MAP_FAILED) {
+            show_error("failed to map %s, %s.\n", path, strerror(errno));
+            image->data = NULL;
+            close(fd);
+            sm_image_close(image);
+            return NULL;
+        }
+    }
+    close(fd);
+
+    /* a raw image may well start with an ELF header, of the exe */
+    if (image->length >= sizeof(elf_ehdr_t) && memcmp(image->data, ELFMAG, SELFMAG) == 0 &&
+        ((const elf_ehdr_t *) image->data)->e_type == ET_CORE)
+        ok = open_core(image);
+    else
+        ok = open_raw(image);
+    if (!ok) {
+        sm_image_close(image);
+        return NULL;
+    }
+
+    show_info("%s opened, %lu segments.\n", path, (unsigned long) image->count);
+    return image;
+}
+
+void sm_image_close(sm_image_t *image)
+{
+    if (image == NULL)
+        return;
+    if (image->data)
+        munmap(image->data, image->length);
+    free(image->segments);
+    free(image->text);
+    free(image->path);
+    free(image);
+}
+
+const char *sm_image_path(const sm_image_t *image)
+{
+    return image->path;
+}
+
+const char *sm_image_exename(const sm_image_t *image)
+{
+    return image->exename;
+}
+
+const sm_segment_t *sm_image_segments(const sm_image_t *image, size_t *count)
+{
+    *count = image->count;
+    return image->segments;
+}
+
+const uint8_t *sm_image_data(const sm_image_t *image, const void *addr, size_t *available)
+{
+    unsigned long address = (unsigned long) addr;
+    size_t lo = 0, hi = image->count;
+    const sm_segment_t *s;
+
+    /* the last segment starting at or before the address */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (image->segments[mid].start <= address)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0)
+        return NULL;
+    s = &image->segments[lo - 1];
+    if (address - s->start >= s->filesz)
+        return NULL;
+
+    *available = s->filesz - (address - s->start);
+    return image->data + s->offset + (address - s->start);
+}
+
+/* a part of `r` with changed pages, widened by the margin */
+static bool add_changed(regions_t *changed, const region_t *r, char *start, char *end)
+{
+    region_t part = *r;
+
+    start = MAX(r->start, start - MIN((size_t) (start - r->start), IMAGE_DIFF_MARGIN));
+    end = MIN(r->start + r->size, end + IMAGE_DIFF_MARGIN);
+    part.start = start;
+    part.size = end - start;
+    part.id = changed->size;
+    if (sm_regions_add(changed, &part, r->filename) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+    return true;
+}
+
+bool sm_image_diff(const sm_image_t *before, const sm_image_t *after, const regions_t *regions,
+                   regions_t *changed, unsigned long *npages, unsigned long *nchanged)
+{
+    size_t n;
+
+    *npages = *nchanged = 0;
+    for (n = 0; n < regions->size; n++) {
+        const region_t *r = &regions->array[n];
+        char *p = r->start, *end = r->start + r->size;
+        char *run = NULL;       /* start of the changed pages before `p` */
+
+        while (p < end) {
+            char *next = MIN(end, (char *) (((uintptr_t) p / IMAGE_DIFF_BLOCK + 1) * IMAGE_DIFF_BLOCK));
+            size_t len = next - p, na = 0, nb = 0;
+            const uint8_t *a = sm_image_data(after, p, &na);
+            const uint8_t *b = sm_image_data(before, p, &nb);
+            bool comparable = a && b && na >= len && nb >= len;
+            /* memcmp() is vectorized by the C library, and stops at the first difference */
+            bool differs = comparable && memcmp(a, b, len) != 0;
+
+            *npages += comparable;
+            if (differs) {
+                ++*nchanged;
+                if (run == NULL)
+                    run = p;
+            } else if (run) {
+                if (!add_changed(changed, r, run, p))
+                    return false;
+                run = NULL;
+            }
+            p = next;
+        }
+        if (run && !add_changed(changed, r, run, end))
+            return false;
+    }
+    return true;
+}
+
+/* every readable region of the target, whatever the scan level, so that
+ * the types of the regions are found again in the image */
+static regions_t *all_regions(globals_t *vars)
+{
+    sm_region_filter_t *readable;
+    regions_t *regions;
+    bool ok;
+
+    if ((readable = sm_region_filter_compile("perm=r")) == NULL)
+        return NULL;
+    if ((regions = sm_regions_new()) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        sm_region_filter_free(readable);
+        return NULL;
+    }
+    if (vars->image)
+        ok = sm_readmaps_image(vars->image, regions, REGION_ALL, readable);
+    else
+        ok = sm_readmaps(vars->target, regions, REGION_ALL, readable);
+    sm_region_filter_free(readable);
+    if (!ok) {
+        show_error("sorry, there was a problem getting a list of regions to save.\n");
+        sm_regions_free(regions);
+        return NULL;
+    }
+    return regions;
+}
+
+bool sm_image_save(globals_t *vars, const char *path)
+{
+    const char *exename = "";
+    char *sidecar = NULL, *buf = NULL;
+    unsigned long offset = 0;
+    FILE *out = NULL, *maps = NULL;
+    regions_t *regions = NULL;
+    bool ok = false;
+    size_t n;
+
+    /* the image being scanned is mapped, it can't be overwritten */
+    if (vars->image && strcmp(path, sm_image_path(vars->image)) == 0) {
+        show_error("%s is the open image.\n", path);
+        return false;
+    }
+
+    if (asprintf(&sidecar, "%s.maps", path) < 0 ||
+        (buf = malloc(IMAGE_CHUNK_SIZE)) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        free(sidecar);
+        return false;
+    }
+    if ((out = fopen(path, "wb")) == NULL || (maps = fopen(sidecar, "w")) == NULL) {
+        show_error("failed to open %s, %s.\n", out ? sidecar : path, strerror(errno));
+        goto out;
+    }
+    if ((regions = all_regions(vars)) == NULL)
+        goto out;
+
+    for (n = 0; n < regions->size; n++) {
+        if (regions->array[n].type == REGION_TYPE_EXE) {
+            exename = regions->array[n].filename;
+            break;
+        }
+    }
+    if (exename[0])
+        fprintf(maps, "# exe %s\n", exename);
+
+    if (sm_session_attach(vars) == false)
+        goto out;
+
+    for (n = 0; n < regions->size; n++) {
+        const region_t *r = &regions->array[n];
+        unsigned long nread = 0;
+
+        /* keep what can be read of the region */
+        while (nread < r->size) {
+            size_t len = MIN(r->size - nread, (unsigned long) IMAGE_CHUNK_SIZE);
+            size_t got = sm_session_read(vars, r->start + nread, buf, len);
+
+            if (got > 0 && fwrite(buf, 1, got, out) != got) {
+                show_error("failed to write %s.\n", path);
+                sm_session_detach(vars);
+                goto out;
+            }
+            nread += got;
+            if (got < len)
+                break;
+        }
+        if (nread == 0)
+            continue;
+
+        fprintf(maps, "%lx-%lx %c%c%c%c %08lx 00:00 0 %s\n",
+                (unsigned long) r->start, (unsigned long) r->start + nread,
+                r->flags.read ? 'r' : '-', r->flags.write ? 'w' : '-',
+                r->flags.exec ? 'x' : '-', r->flags.shared ? 's' : 'p',
+                offset, r->filename);
+        offset += nread;
+    }
+
+    if (sm_session_detach(vars) == false)
+        goto out;
+    show_info("saved %lu bytes to %s, with the regions in %s.\n", offset, path, sidecar);
+    ok = true;
+
+out:
+    if (maps && fclose(maps) != 0 && ok) {
+        show_error("failed to write %s.\n", sidecar);
+        ok = false;
+    }
+    if (out && fclose(out) != 0 && ok) {
+        show_error("failed to write %s.\n", path);
+        ok = false;
+    }
+    sm_regions_free(regions);
+    free(sidecar);
+    free(buf);
+    return ok;
+}
@@ -0,0 +1,80 @@
+/*
+    Memory images: core files and saved regions, scanned without a process.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scanmem.h"
+
+/* a mapping of the target, whose first `filesz` bytes are in the image */
+typedef struct {
+    unsigned long start, end;   /* addresses in the target */
+    unsigned long offset;       /* of the data in the image file */
+    unsigned long filesz;
+    char perms[4];              /* as in /proc/pid/maps, e.g. "rw-p" */
+    const char *filename;       /* "" if none */
+} sm_segment_t;
+
+/*
+ * Open an ELF core file, using its PT_LOAD segments, or a raw image saved
+ * with sm_image_save(), using the regions of its sidecar `<path>.maps`.
+ * The file is mapped, the scans read it in place.
+ */
+sm_image_t *sm_image_open(const char *path);
+void sm_image_close(sm_image_t *image);
+
+const char *sm_image_path(const sm_image_t *image);
+
+/* the path of the executable of the target, "" if unknown */
+const char *sm_image_exename(const sm_image_t *image);
+
+/* the segments of an image, sorted by address */
+const sm_segment_t *sm_image_segments(const sm_image_t *image, size_t *count);
+
+/*
+ * The bytes of the target at `addr`, with the number of bytes which follow
+ * in the same segment in `available`. NULL if they aren't in the image.
+ */
+const uint8_t *sm_image_data(const sm_image_t *image, const void *addr, size_t *available);
+
+/*
+ * Append to `changed` the parts of `regions`, of the image `after`, whose
+ * pages differ in `before`, widened so that the values overlapping them are
+ * inside. Pages which aren't in both images aren't compared. The numbers of
+ * pages compared and of those which changed are stored in `npages` and
+ * `nchanged`.
+ */
+bool sm_image_diff(const sm_image_t *before, const sm_image_t *after, const regions_t *regions,
+                   regions_t *changed, unsigned long *npages, unsigned long *nchanged);
+
+/*
+ * Save every readable region of the target of `vars` to a raw image at
+ * `path`, one after the other, and their addresses to the sidecar
+ * `<path>.maps`, in the format of /proc/pid/maps with the offsets of the
+ * regions in the image.
+ */
+bool sm_image_save(globals_t *vars, const char *path);
+
+#endif /* IMAGE_H */
@@ -41,6 +41,7 @@
 #include "show_message.h"
 
 #include "menu.h"
+#include "server.h"
 
 
 static const char copy_text[] =
@@ -71,6 +72,8 @@ static const char help_text[] =
 "\n"
 "-p, --pid=pid\t\tset the target process pid\n"
 "-c, --command\t\trun given commands (separated by `;`)\n"
+"-s, --serve=socket\tserve commands on a Unix domain socket, executing\n"
+"\t\t\tthe requests of all the clients one at a time\n"
 "-h, --help\t\tprint this message\n"
 "-v, --version\t\tprint version information\n"
 "\n"
@@ -98,11 +101,13 @@ static inline void show_user_quick_help(pid_t target)
     }
 }
 
-static void parse_parameters(int argc, char **argv, char **initial_commands, bool *exit_on_error)
+static void parse_parameters(int argc, char **argv, char **initial_commands,
+                             char **serve_path, bool *exit_on_error)
 {
     struct option longopts[] = {
         {"pid",     1, NULL, 'p'},      /* target pid */
         {"command", 1, NULL, 'c'},      /* commands to run at the beginning */
+        {"serve",   1, NULL, 's'},      /* serve on a Unix domain socket */
         {"version", 0, NULL, 'v'},      /* print version */
         {"help",    0, NULL, 'h'},      /* print help summary */
         {"debug",   0, NULL, 'd'},      /* enable debug mode */
@@ -116,7 +121,7 @@ static void parse_parameters(int argc, char **argv, char **initial_commands, boo
 
     /* process command line */
     while (!done) {
-        switch (getopt_long(argc, argv, "vhdep:c:", longopts, &optindex)) {
+        switch (getopt_long(argc, argv, "vhdep:c:s:", longopts, &optindex)) {
             case 'p':
                 vars->target = (pid_t) strtoul(optarg, &end, 0);
 
@@ -129,6 +134,9 @@ static void parse_parameters(int argc, char **argv, char **initial_commands, boo
             case 'c':
                 *initial_commands = optarg;
                 break;
+            case 's':
+                *serve_path = optarg;
+                break;
             case 'v':
                 printversion(stderr);
                 exit(EXIT_FAILURE);
@@ -164,8 +172,9 @@ static void parse_parameters(int argc, char **argv, char **initial_commands, boo
 int main(int argc, char **argv)
 {
     char *initial_commands = NULL;
+    char *serve_path = NULL;
     bool exit_on_error = false;
-    parse_parameters(argc, argv, &initial_commands, &exit_on_error);
+    parse_parameters(argc, argv, &initial_commands, &serve_path, &exit_on_error);
 
     int ret = EXIT_SUCCESS;
     globals_t *vars = &sm_globals;
@@ -206,7 +215,10 @@ int main(int argc, char **argv)
             }
 
             if (sm_execcommand(vars, line) == false) {
-                if (exit_on_error) goto end;
+                if (exit_on_error) {
+                    ret = EXIT_FAILURE;
+                    goto end;
+                }
                 show_user_quick_help(vars->target);
             }
 
@@ -215,6 +227,13 @@ int main(int argc, char **argv)
         }
     }
 
+    /* serve clients instead of reading commands from the user */
+    if (serve_path) {
+        if (!vars->exit && !serve(vars, serve_path))
+            ret = EXIT_FAILURE;
+        goto end;
+    }
+
     /* main loop, read input and process commands */
     while (!vars->exit) {
         char *line;
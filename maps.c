@@ -1,5 +1,5 @@
 /*
-    Reading the data from /proc/pid/maps into a regions list.
+    Reading the data from /proc/pid/maps into an array of regions.
 
     Copyright (C) 2006,2007,2009 Tavis Ormandy <taviso@sdf.lonestar.org>
     Copyright (C) 2009           Eli Dupree <elidupree@charter.net>
@@ -28,165 +28,565 @@
 
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/ioctl.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <alloca.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
 
-#include "list.h"
 #include "maps.h"
-#include "getline.h"
+#include "image.h"
+#include "regionfilter.h"
 #include "show_message.h"
 
 const char *region_type_names[] = REGION_TYPE_NAMES;
 
-bool sm_readmaps(pid_t target, list_t *regions, region_scan_level_t region_scan_level)
+/* the file names are copied in blocks which are never moved, so that the
+ * regions can point to them while the array grows */
+#define NAMES_BLOCK_SIZE (64 * 1024)
+
+struct region_names {
+    struct region_names *next;
+    size_t used, size;
+    char data[];
+};
+
+regions_t *sm_regions_new(void)
 {
-    FILE *maps;
-    char name[128], *line = NULL;
-    char exelink[128];
-    size_t len = 0;
-    unsigned int code_regions = 0, exe_regions = 0;
-    unsigned long prev_end = 0, load_addr = 0, exe_load = 0;
-    bool is_exe = false;
+    return calloc(1, sizeof(regions_t));
+}
 
-#define MAX_LINKBUF_SIZE 256
-    char linkbuf[MAX_LINKBUF_SIZE], *exename = linkbuf;
-    int linkbuf_size;
-    char binname[MAX_LINKBUF_SIZE];
+void sm_regions_free(regions_t *regions)
+{
+    struct region_names *names, *next;
 
-    /* check if target is valid */
-    if (target == 0)
-        return false;
+    if (regions == NULL)
+        return;
+    for (names = regions->names; names; names = next) {
+        next = names->next;
+        free(names);
+    }
+    free(regions->array);
+    free(regions);
+}
 
-    /* construct the maps filename */
-    snprintf(name, sizeof(name), "/proc/%u/maps", target);
+regions_t *sm_regions_copy(const regions_t *regions)
+{
+    regions_t *copy;
+    size_t i;
+
+    if ((copy = sm_regions_new()) == NULL)
+        return NULL;
+    for (i = 0; i < regions->size; i++) {
+        if (sm_regions_add(copy, &regions->array[i], regions->array[i].filename) == NULL) {
+            sm_regions_free(copy);
+            return NULL;
+        }
+    }
+    return copy;
+}
 
-    /* attempt to open the maps file */
-    if ((maps = fopen(name, "r")) == NULL) {
-        show_error("failed to open maps file %s.\n", name);
-        return false;
+static const char *copy_name(regions_t *regions, const char *filename)
+{
+    struct region_names *names = regions->names;
+    size_t len = strlen(filename) + 1;
+
+    if (len == 1)
+        return "";
+    if (names == NULL || names->size - names->used < len) {
+        size_t size = (len > NAMES_BLOCK_SIZE) ? len : NAMES_BLOCK_SIZE;
+        if ((names = malloc(sizeof(struct region_names) + size)) == NULL)
+            return NULL;
+        names->next = regions->names;
+        names->used = 0;
+        names->size = size;
+        regions->names = names;
     }
+    memcpy(names->data + names->used, filename, len);
+    names->used += len;
+    return names->data + names->used - len;
+}
 
-    show_info("maps file located at %s opened.\n", name);
+region_t *sm_regions_add(regions_t *regions, const region_t *region, const char *filename)
+{
+    region_t *r;
+    size_t index;
+
+    if (regions->size == regions->capacity) {
+        size_t capacity = regions->capacity ? 2 * regions->capacity : 64;
+        region_t *array = realloc(regions->array, capacity * sizeof(region_t));
+        if (array == NULL)
+            return NULL;
+        regions->array = array;
+        regions->capacity = capacity;
+    }
+    if ((filename = copy_name(regions, filename)) == NULL)
+        return NULL;
+
+    /* the maps come sorted, so this is nearly always an append */
+    index = regions->size;
+    if (index > 0 && regions->array[index - 1].start > region->start) {
+        index = sm_regions_lower_bound(regions, region->start);
+        memmove(&regions->array[index + 1], &regions->array[index],
+                (regions->size - index) * sizeof(region_t));
+    }
+    r = &regions->array[index];
+    *r = *region;
+    r->filename = filename;
+    regions->size++;
+    return r;
+}
 
-    /* get executable name */
-    snprintf(exelink, sizeof(exelink), "/proc/%u/exe", target);
-    linkbuf_size = readlink(exelink, exename, MAX_LINKBUF_SIZE - 1);
-    if (linkbuf_size > 0)
-    {
-        exename[linkbuf_size] = 0;
+void sm_regions_remove(regions_t *regions, size_t index)
+{
+    if (index >= regions->size)
+        return;
+    memmove(&regions->array[index], &regions->array[index + 1],
+            (regions->size - index - 1) * sizeof(region_t));
+    regions->size--;
+}
+
+/* the regions of an ELF file share their load address, but only
+ * the first ones have its name */
+const char *sm_regions_module(const regions_t *regions, const region_t *r)
+{
+    const char *path = NULL, *slash;
+    size_t i;
+
+    if (r->type != REGION_TYPE_EXE && r->type != REGION_TYPE_CODE)
+        return NULL;
+
+    if (r->filename[0]) {
+        path = r->filename;
     } else {
-        /* readlink may fail for special processes, just treat as empty in
-           order not to miss those regions */
-        exename[0] = 0;
+        /* the regions are sorted, those of an ELF file are together */
+        for (i = r - regions->array; i-- > 0; ) {
+            const region_t *other = &regions->array[i];
+            if (other->load_addr != r->load_addr)
+                break;
+            if (other->filename[0]) {
+                path = other->filename;
+                break;
+            }
+        }
     }
+    if (path == NULL)
+        return "unassociated";
+    slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
 
-    /* read every line of the maps file */
-    while (getline(&line, &len, maps) != -1) {
-        unsigned long start, end;
-        region_t *map = NULL;
-        char read, write, exec, cow, *filename;
-        int offset, dev_major, dev_minor, inode;
-        region_type_t type = REGION_TYPE_MISC;
+size_t sm_module_escape(const char *name, char *buf, size_t size)
+{
+    size_t len = 0;
 
-        /* slight overallocation */
-        if ((filename = alloca(len)) == NULL) {
-            show_error("failed to allocate %lu bytes for filename.\n", (unsigned long)len);
-            goto error;
+    for (; *name; name++) {
+        unsigned char c = *name;
+        char escaped[5] = { c, '\0' };
+
+        if (c <= ' ' || c == '\\' || c == 0x7f)
+            snprintf(escaped, sizeof(escaped), "\\x%02x", c);
+        for (char *e = escaped; *e; e++, len++) {
+            if (len + 1 < size)
+                buf[len] = *e;
         }
+    }
+    if (size > 0)
+        buf[len < size ? len : size - 1] = '\0';
+    return len;
+}
 
-        /* initialise to zero */
-        memset(filename, '\0', len);
-
-        /* parse each line */
-        if (sscanf(line, "%lx-%lx %c%c%c%c %x %x:%x %u %[^\n]", &start, &end, &read,
-                &write, &exec, &cow, &offset, &dev_major, &dev_minor, &inode, filename) >= 6) {
-            /*
-             * get the load address for regions of the same ELF file
-             *
-             * When the ELF loader loads an executable or a library into
-             * memory, there is one region per ELF segment created:
-             * .text (r-x), .rodata (r--), .data (rw-) and .bss (rw-). The
-             * 'x' permission of .text is used to detect the load address
-             * (region start) and the end of the ELF file in memory. All
-             * these regions have the same filename. The only exception
-             * is the .bss region. Its filename is empty and it is
-             * consecutive with the .data region. But the regions .bss and
-             * .rodata may not be present with some ELF files. This is why
-             * we can't rely on other regions to be consecutive in memory.
-             * There should never be more than these four regions.
-             * The data regions use their variables relative to the load
-             * address. So determining it makes sense as we can get the
-             * variable address used within the ELF file with it.
-             * But for the executable there is the special case that there
-             * is a gap between .text and .rodata. Other regions might be
-             * loaded via mmap() to it. So we have to count the number of
-             * regions belonging to the exe separately to handle that.
-             * References:
-             * http://en.wikipedia.org/wiki/Executable_and_Linkable_Format
-             * http://wiki.osdev.org/ELF
-             * http://lwn.net/Articles/531148/
-             */
-
-            /* detect further regions of the same ELF file and its end */
-            if (code_regions > 0) {
-                if (exec == 'x' || (strncmp(filename, binname,
-                  MAX_LINKBUF_SIZE) != 0 && (filename[0] != '\0' ||
-                  start != prev_end)) || code_regions >= 4) {
-                    code_regions = 0;
-                    is_exe = false;
-                    /* exe with .text and without .data is impossible */
-                    if (exe_regions > 1)
-                        exe_regions = 0;
-                } else {
-                    code_regions++;
-                    if (is_exe)
-                        exe_regions++;
-                }
+bool sm_module_unescape(char *name)
+{
+    char *out = name;
+
+    for (; *name; name++) {
+        if (*name == '\\') {
+            char hex[3];
+            char *endptr;
+
+            if (name[1] != 'x' || !name[2] || !name[3])
+                return false;
+            hex[0] = name[2];
+            hex[1] = name[3];
+            hex[2] = '\0';
+            *out++ = (char) strtoul(hex, &endptr, 16);
+            if (*endptr != '\0')
+                return false;
+            name += 3;
+        } else {
+            *out++ = *name;
+        }
+    }
+    *out = '\0';
+    return true;
+}
+
+size_t sm_regions_lower_bound(const regions_t *regions, const void *address)
+{
+    size_t lo = 0, hi = regions->size;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const region_t *r = &regions->array[mid];
+        if ((uintptr_t) r->start + r->size <= (uintptr_t) address)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+region_t *sm_regions_find(const regions_t *regions, const void *address)
+{
+    size_t index = sm_regions_lower_bound(regions, address);
+
+    if (index == regions->size || (const char *) address < regions->array[index].start)
+        return NULL;
+    return &regions->array[index];
+}
+
+region_t *sm_regions_find_id(const regions_t *regions, unsigned id)
+{
+    size_t lo = 0, hi = regions->size;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (regions->array[mid].id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == regions->size || regions->array[lo].id != id)
+        return NULL;
+    return &regions->array[lo];
+}
+
+/* PROCMAP_QUERY of <linux/fs.h>, since Linux 6.11 */
+#define PROCMAP_QUERY_VMA_READABLE          0x01
+#define PROCMAP_QUERY_VMA_WRITABLE          0x02
+#define PROCMAP_QUERY_VMA_EXECUTABLE        0x04
+#define PROCMAP_QUERY_VMA_SHARED            0x08
+#define PROCMAP_QUERY_COVERING_OR_NEXT_VMA  0x10
+
+struct procmap_query {
+    uint64_t size;
+    uint64_t query_flags;
+    uint64_t query_addr;
+    uint64_t vma_start;
+    uint64_t vma_end;
+    uint64_t vma_flags;
+    uint64_t vma_page_size;
+    uint64_t vma_offset;
+    uint64_t inode;
+    uint32_t dev_major;
+    uint32_t dev_minor;
+    uint32_t vma_name_size;
+    uint32_t build_id_size;
+    uint64_t vma_name_addr;
+    uint64_t build_id_addr;
+};
+
+#define PROCMAP_QUERY _IOWR('f', 17, struct procmap_query)
+
+/* a line of the maps file holds at most a path and 100 characters */
+#define MAPS_BUFFER_SIZE (4 * PATH_MAX)
+
+/* one line of the maps file */
+typedef struct {
+    unsigned long start, end;
+    char read, write, exec, cow;
+    const char *filename;
+} mapping_t;
+
+/* reads the mappings of a target without allocating anything */
+typedef struct {
+    int fd;
+    const sm_image_t *image;    /* the segments of an image instead */
+    size_t next_segment;
+    bool query;                 /* with PROCMAP_QUERY, or by parsing */
+    unsigned long next_addr;    /* of the next query */
+    size_t pos, len;            /* of the unparsed text in `buf` */
+    bool eof;
+    char buf[MAPS_BUFFER_SIZE]; /* text of the maps file, or the name of a query */
+} maps_reader_t;
+
+/* 1 with the next mapping in `m`, 0 at the end, -1 on error */
+static int query_mapping(maps_reader_t *rd, mapping_t *m)
+{
+    struct procmap_query q;
+
+    memset(&q, 0, sizeof(q));
+    q.size = sizeof(q);
+    q.query_flags = PROCMAP_QUERY_COVERING_OR_NEXT_VMA;
+    q.query_addr = rd->next_addr;
+    q.vma_name_addr = (uintptr_t) rd->buf;
+    q.vma_name_size = sizeof(rd->buf);
+
+    if (ioctl(rd->fd, PROCMAP_QUERY, &q) == -1)
+        return (errno == ENOENT) ? 0 : -1;
+
+    rd->next_addr = q.vma_end;
+    m->start = q.vma_start;
+    m->end = q.vma_end;
+    m->read = (q.vma_flags & PROCMAP_QUERY_VMA_READABLE) ? 'r' : '-';
+    m->write = (q.vma_flags & PROCMAP_QUERY_VMA_WRITABLE) ? 'w' : '-';
+    m->exec = (q.vma_flags & PROCMAP_QUERY_VMA_EXECUTABLE) ? 'x' : '-';
+    m->cow = (q.vma_flags & PROCMAP_QUERY_VMA_SHARED) ? 's' : 'p';
+    if (q.vma_name_size == 0)
+        rd->buf[0] = '\0';
+    m->filename = rd->buf;
+    return 1;
+}
+
+static inline unsigned long parse_hex(char **p)
+{
+    unsigned long v = 0;
+
+    for (;; (*p)++) {
+        char c = **p;
+        if (c >= '0' && c <= '9')
+            v = (v << 4) | (c - '0');
+        else if (c >= 'a' && c <= 'f')
+            v = (v << 4) | (c - 'a' + 10);
+        else
+            return v;
+    }
+}
+
+static inline char *skip_field(char *p)
+{
+    while (*p != ' ' && *p != '\0')
+        p++;
+    while (*p == ' ')
+        p++;
+    return p;
+}
+
+/* parse `start-end perms offset dev inode [filename]`, in place */
+static bool parse_maps_line(char *line, mapping_t *m)
+{
+    char *p = line;
+
+    m->start = parse_hex(&p);
+    if (*p++ != '-')
+        return false;
+    m->end = parse_hex(&p);
+    if (*p++ != ' ' || strnlen(p, 4) < 4)
+        return false;
+    m->read = p[0];
+    m->write = p[1];
+    m->exec = p[2];
+    m->cow = p[3];
+    p = skip_field(p);          /* perms */
+    p = skip_field(p);          /* offset */
+    p = skip_field(p);          /* dev */
+    p = skip_field(p);          /* inode */
+    m->filename = p;
+    return true;
+}
+
+/* 1 with the next mapping in `m`, 0 at the end, -1 on error */
+static int parse_mapping(maps_reader_t *rd, mapping_t *m)
+{
+    char *line, *newline;
+
+    for (;;) {
+        line = rd->buf + rd->pos;
+        newline = memchr(line, '\n', rd->len - rd->pos);
+        if (newline || (rd->eof && rd->pos < rd->len))
+            break;
+        if (rd->eof)
+            return 0;
+
+        /* move the partial line to the front and read more */
+        memmove(rd->buf, line, rd->len - rd->pos);
+        rd->len -= rd->pos;
+        rd->pos = 0;
+        if (rd->len == sizeof(rd->buf) - 1) {
+            show_error("too long line in the maps file.\n");
+            return -1;
+        }
+        ssize_t n = read(rd->fd, rd->buf + rd->len, sizeof(rd->buf) - 1 - rd->len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            show_error("failed to read the maps file.\n");
+            return -1;
+        }
+        rd->len += n;
+        rd->eof = (n == 0);
+    }
+
+    if (newline == NULL)
+        newline = rd->buf + rd->len;
+    *newline = '\0';
+    rd->pos = newline - rd->buf + (newline < rd->buf + rd->len);
+    if (!parse_maps_line(line, m)) {
+        show_error("unexpected line in the maps file: %s\n", line);
+        return -1;
+    }
+    return 1;
+}
+
+/* 1 with the next segment of the image in `m`, 0 at the end */
+static int image_mapping(maps_reader_t *rd, mapping_t *m)
+{
+    size_t count;
+    const sm_segment_t *s = sm_image_segments(rd->image, &count);
+
+    if (rd->next_segment == count)
+        return 0;
+    s += rd->next_segment++;
+    m->start = s->start;
+    /* only what the image holds can be read */
+    m->end = s->start + s->filesz;
+    m->read = s->perms[0];
+    m->write = s->perms[1];
+    m->exec = s->perms[2];
+    m->cow = s->perms[3];
+    m->filename = s->filename;
+    return 1;
+}
+
+static int next_mapping(maps_reader_t *rd, mapping_t *m)
+{
+    if (rd->image)
+        return image_mapping(rd, m);
+    return rd->query ? query_mapping(rd, m) : parse_mapping(rd, m);
+}
+
+/* the longest paths of the executable and of the ELF files which are compared */
+#define MAX_LINKBUF_SIZE 256
+
+/*
+ * Add the useful regions among the mappings of `rd`, the first one being in
+ * `m` if `ret` is 1. Returns 0, -1 if reading failed or -2 if adding failed.
+ */
+static int add_mappings(maps_reader_t *rd, mapping_t *m, int ret, const char *exename,
+                        regions_t *regions, region_scan_level_t region_scan_level,
+                        const sm_region_filter_t *filter)
+{
+    unsigned int code_regions = 0, exe_regions = 0;
+    unsigned long prev_end = 0, load_addr = 0, exe_load = 0;
+    bool is_exe = false;
+    char binname[MAX_LINKBUF_SIZE];
+
+    /* read every mapping */
+    for (; ret > 0; ret = next_mapping(rd, m)) {
+        unsigned long start = m->start, end = m->end;
+        char read = m->read, write = m->write, exec = m->exec, cow = m->cow;
+        const char *filename = m->filename;
+        region_t map;
+        region_type_t type = REGION_TYPE_MISC;
+
+        /*
+         * get the load address for regions of the same ELF file
+         *
+         * When the ELF loader loads an executable or a library into
+         * memory, there is one region per ELF segment created:
+         * .text (r-x), .rodata (r--), .data (rw-) and .bss (rw-). The
+         * 'x' permission of .text is used to detect the load address
+         * (region start) and the end of the ELF file in memory. All
+         * these regions have the same filename. The only exception
+         * is the .bss region. Its filename is empty and it is
+         * consecutive with the .data region. But the regions .bss and
+         * .rodata may not be present with some ELF files. This is why
+         * we can't rely on other regions to be consecutive in memory.
+         * There should never be more than these four regions.
+         * The data regions use their variables relative to the load
+         * address. So determining it makes sense as we can get the
+         * variable address used within the ELF file with it.
+         * But for the executable there is the special case that there
+         * is a gap between .text and .rodata. Other regions might be
+         * loaded via mmap() to it. So we have to count the number of
+         * regions belonging to the exe separately to handle that.
+         * References:
+         * http://en.wikipedia.org/wiki/Executable_and_Linkable_Format
+         * http://wiki.osdev.org/ELF
+         * http://lwn.net/Articles/531148/
+         */
+
+        /* detect further regions of the same ELF file and its end */
+        if (code_regions > 0) {
+            if (exec == 'x' || (strncmp(filename, binname,
+              MAX_LINKBUF_SIZE) != 0 && (filename[0] != '\0' ||
+              start != prev_end)) || code_regions >= 4) {
+                code_regions = 0;
+                is_exe = false;
+                /* exe with .text and without .data is impossible */
+                if (exe_regions > 1)
+                    exe_regions = 0;
+            } else {
+                code_regions++;
+                if (is_exe)
+                    exe_regions++;
             }
-            if (code_regions == 0) {
-                /* detect the first region belonging to an ELF file */
-                if (exec == 'x' && filename[0] != '\0') {
-                    code_regions++;
-                    if (strncmp(filename, exename, MAX_LINKBUF_SIZE) == 0) {
-                        exe_regions = 1;
-                        exe_load = start;
-                        is_exe = true;
-                    }
-                    strncpy(binname, filename, MAX_LINKBUF_SIZE);
-                    binname[MAX_LINKBUF_SIZE - 1] = '\0';  /* just to be sure */
-                /* detect the second region of the exe after skipping regions */
-                } else if (exe_regions == 1 && filename[0] != '\0' &&
-                  strncmp(filename, exename, MAX_LINKBUF_SIZE) == 0) {
-                    code_regions = ++exe_regions;
-                    load_addr = exe_load;
+        }
+        if (code_regions == 0) {
+            /* detect the first region belonging to an ELF file */
+            if (exec == 'x' && filename[0] != '\0') {
+                code_regions++;
+                if (strncmp(filename, exename, MAX_LINKBUF_SIZE) == 0) {
+                    exe_regions = 1;
+                    exe_load = start;
                     is_exe = true;
-                    strncpy(binname, filename, MAX_LINKBUF_SIZE);
-                    binname[MAX_LINKBUF_SIZE - 1] = '\0';  /* just to be sure */
                 }
-                if (exe_regions < 2)
-                    load_addr = start;
+                strncpy(binname, filename, MAX_LINKBUF_SIZE);
+                binname[MAX_LINKBUF_SIZE - 1] = '\0';  /* just to be sure */
+            /* detect the second region of the exe after skipping regions */
+            } else if (exe_regions == 1 && filename[0] != '\0' &&
+              strncmp(filename, exename, MAX_LINKBUF_SIZE) == 0) {
+                code_regions = ++exe_regions;
+                load_addr = exe_load;
+                is_exe = true;
+                strncpy(binname, filename, MAX_LINKBUF_SIZE);
+                binname[MAX_LINKBUF_SIZE - 1] = '\0';  /* just to be sure */
             }
-            prev_end = end;
-
-            /* must have permissions to read and write, and be non-zero size */
-            if ((write == 'w') && (read == 'r') && ((end - start) > 0)) {
-                bool useful = false;
-
-                /* determine region type */
-                if (is_exe)
-                    type = REGION_TYPE_EXE;
-                else if (code_regions > 0)
-                    type = REGION_TYPE_CODE;
-                else if (!strcmp(filename, "[heap]"))
-                    type = REGION_TYPE_HEAP;
-                else if (!strcmp(filename, "[stack]"))
-                    type = REGION_TYPE_STACK;
-
-                /* determine if this region is useful */
+            if (exe_regions < 2)
+                load_addr = start;
+        }
+        prev_end = end;
+
+        /* must have permissions to read, and be non-zero size */
+        if ((read == 'r') && ((end - start) > 0)) {
+            bool useful = false;
+
+            /* determine region type */
+            if (is_exe)
+                type = REGION_TYPE_EXE;
+            else if (code_regions > 0)
+                type = REGION_TYPE_CODE;
+            else if (!strcmp(filename, "[heap]"))
+                type = REGION_TYPE_HEAP;
+            else if (!strcmp(filename, "[stack]"))
+                type = REGION_TYPE_STACK;
+
+            /* initialize this region */
+            memset(&map, 0, sizeof(map));
+            map.flags.read = true;
+            map.flags.write = (write == 'w');
+            map.start = (char *) start;
+            map.size = (unsigned long) (end - start);
+            map.type = type;
+            map.load_addr = load_addr;
+            map.filename = filename;
+
+            /* setup other permissions */
+            map.flags.exec = (exec == 'x');
+            map.flags.shared = (cow == 's');
+            map.flags.private = (cow == 'p');
+
+            /* determine if this region is useful, the scan levels only
+               select writable regions */
+            if (filter) {
+                useful = sm_region_filter_match(filter, &map);
+            } else if (write == 'w') {
                 switch (region_scan_level)
                 {
                     case REGION_ALL:
@@ -211,58 +611,103 @@ bool sm_readmaps(pid_t target, list_t *regions, region_scan_level_t region_scan_
                             useful = true;
                     break;
                 }
+            }
 
-                if (!useful)
-                    continue;
+            if (!useful)
+                continue;
 
-                /* allocate a new region structure */
-                if ((map = calloc(1, sizeof(region_t) + strlen(filename))) == NULL) {
-                    show_error("failed to allocate memory for region.\n");
-                    goto error;
-                }
+            /* add a unique identifier */
+            map.id = regions->size;
 
-                /* initialize this region */
-                map->flags.read = true;
-                map->flags.write = true;
-                map->start = (char *) start;
-                map->size = (unsigned long) (end - start);
-                map->type = type;
-                map->load_addr = load_addr;
-
-                /* setup other permissions */
-                map->flags.exec = (exec == 'x');
-                map->flags.shared = (cow == 's');
-                map->flags.private = (cow == 'p');
-
-                /* save pathname */
-                if (strlen(filename) != 0) {
-                    /* the pathname is concatenated with the structure */
-                    strcpy(map->filename, filename);
-                }
-
-                /* add a unique identifier */
-                map->id = regions->size;
-                
-                /* okay, add this guy to our list */
-                if (l_append(regions, regions->tail, map) == -1) {
-                    show_error("failed to save region.\n");
-                    goto error;
-                }
+            /* okay, add this guy to our array, with a copy of its pathname */
+            if (sm_regions_add(regions, &map, filename) == NULL) {
+                show_error("failed to save region.\n");
+                return -2;
             }
         }
     }
+    return ret;
+}
+
+bool sm_readmaps(pid_t target, regions_t *regions, region_scan_level_t region_scan_level,
+                 const sm_region_filter_t *filter)
+{
+    maps_reader_t rd;
+    mapping_t m;
+    char name[128];
+    char exelink[128];
+    int ret;
+
+    char linkbuf[MAX_LINKBUF_SIZE], *exename = linkbuf;
+    int linkbuf_size;
+
+    /* check if target is valid */
+    if (target == 0)
+        return false;
 
-    show_info("%d suitable regions found.\n", regions->size);
-    
-    /* release memory allocated */
-    free(line);
-    fclose(maps);
+    /* construct the maps filename */
+    snprintf(name, sizeof(name), "/proc/%u/maps", target);
+
+    /* attempt to open the maps file */
+    if ((rd.fd = open(name, O_RDONLY | O_CLOEXEC)) == -1) {
+        show_error("failed to open maps file %s.\n", name);
+        return false;
+    }
+
+    show_info("maps file located at %s opened.\n", name);
+
+    /* use PROCMAP_QUERY if the first query works, even if there's no mapping */
+    rd.image = NULL;
+    rd.query = true;
+    rd.next_addr = 0;
+    if ((ret = query_mapping(&rd, &m)) < 0) {
+        rd.query = false;
+        rd.pos = rd.len = 0;
+        rd.eof = false;
+        ret = parse_mapping(&rd, &m);
+    }
+    show_debug("reading the mappings with %s.\n", rd.query ? "PROCMAP_QUERY" : "the maps file");
 
+    /* get executable name */
+    snprintf(exelink, sizeof(exelink), "/proc/%u/exe", target);
+    linkbuf_size = readlink(exelink, exename, MAX_LINKBUF_SIZE - 1);
+    if (linkbuf_size > 0)
+    {
+        exename[linkbuf_size] = 0;
+    } else {
+        /* readlink may fail for special processes, just treat as empty in
+           order not to miss those regions */
+        exename[0] = 0;
+    }
+
+    ret = add_mappings(&rd, &m, ret, exename, regions, region_scan_level, filter);
+    close(rd.fd);
+
+    if (ret == -1)
+        show_error("failed to read the mappings of %u.\n", target);
+    if (ret < 0)
+        return false;
+
+    show_info("%lu suitable regions found.\n", (unsigned long) regions->size);
     return true;
+}
 
-error:
-    free(line);
-    fclose(maps);
+bool sm_readmaps_image(const sm_image_t *image, regions_t *regions,
+                       region_scan_level_t region_scan_level, const sm_region_filter_t *filter)
+{
+    maps_reader_t rd;
+    mapping_t m;
+    int ret;
+
+    rd.fd = -1;
+    rd.image = image;
+    rd.next_segment = 0;
+    ret = image_mapping(&rd, &m);
 
-    return false;
+    if (add_mappings(&rd, &m, ret, sm_image_exename(image), regions,
+                     region_scan_level, filter) < 0)
+        return false;
+
+    show_info("%lu suitable regions found.\n", (unsigned long) regions->size);
+    return true;
 }
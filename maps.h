@@ -1,5 +1,5 @@
 /*
-    Reading the data from /proc/pid/maps into a regions list.
+    Reading the data from /proc/pid/maps into an array of regions.
 
     Copyright (C) 2006,2007,2009 Tavis Ormandy <taviso@sdf.lonestar.org>
     Copyright (C) 2009           Eli Dupree <elidupree@charter.net>
@@ -26,10 +26,9 @@
 #define MAPS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <sys/types.h>
 
-#include "list.h"
-
 /* determine which regions we need */
 typedef enum {
     REGION_ALL,                            /* each of them */
@@ -62,9 +61,64 @@ typedef struct {
         unsigned shared:1;
         unsigned private:1;
     } flags;
-    char filename[1];           /* associated file, must be last */
+    const char *filename;       /* associated file, "" if none */
 } region_t;
 
-bool sm_readmaps(pid_t target, list_t *regions, region_scan_level_t region_scan_level);
+/* the regions of a target, in one array sorted by address, with the ids
+ * given in the same order */
+typedef struct {
+    size_t size;                /* number of regions */
+    size_t capacity;
+    region_t *array;
+    struct region_names *names; /* storage of the file names, which never moves */
+} regions_t;
+
+regions_t *sm_regions_new(void);
+void sm_regions_free(regions_t *regions);
+
+/* a copy of `regions`, with their own file names, NULL on error */
+regions_t *sm_regions_copy(const regions_t *regions);
+
+/* add a copy of `region` with its own copy of `filename`, at its place by
+ * address, NULL on error */
+region_t *sm_regions_add(regions_t *regions, const region_t *region, const char *filename);
+void sm_regions_remove(regions_t *regions, size_t index);
+
+/* index of the first region ending after `address`, `size` if none */
+size_t sm_regions_lower_bound(const regions_t *regions, const void *address);
+
+/* the region containing `address`, or NULL */
+region_t *sm_regions_find(const regions_t *regions, const void *address);
+
+/* the region with the id `id`, or NULL */
+region_t *sm_regions_find_id(const regions_t *regions, unsigned id);
+
+/* the file name, without the directory, of the ELF file of an exe or code
+ * region, "unassociated" if unknown, NULL for other regions */
+const char *sm_regions_module(const regions_t *regions, const region_t *r);
+
+/* a module name as a single word, with the spaces, control characters and
+ * backslashes written as \xNN: returns its length and writes at most `size`
+ * bytes of it to `buf`, like snprintf() */
+size_t sm_module_escape(const char *name, char *buf, size_t size);
+
+/* undo sm_module_escape() in place, false if an escape is malformed */
+bool sm_module_unescape(char *name);
+
+/* an expression selecting regions, see regionfilter.h */
+typedef struct sm_region_filter sm_region_filter_t;
+
+/* append the regions of `target`, from the PROCMAP_QUERY ioctl if the kernel
+ * has it, otherwise by parsing /proc/pid/maps. If `filter` isn't NULL, it
+ * selects the readable regions to keep instead of `region_scan_level`. */
+bool sm_readmaps(pid_t target, regions_t *regions, region_scan_level_t region_scan_level,
+                 const sm_region_filter_t *filter);
+
+/* a core file or a raw image, see image.h */
+typedef struct sm_image sm_image_t;
+
+/* append the regions of the segments of `image`, the same way */
+bool sm_readmaps_image(const sm_image_t *image, regions_t *regions,
+                       region_scan_level_t region_scan_level, const sm_region_filter_t *filter);
 
 #endif /* MAPS_H */
@@ -0,0 +1,885 @@
+/*
+    Regular expression search of target memory.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The pattern is compiled into a Thompson NFA, whose sets of states become
+ * the states of a DFA as they are reached during the search. The DFA states
+ * are kept in a cache of limited size, which is flushed when it's full.
+ *
+ * The matches are searched in a single pass: the reversed pattern, after
+ * a loop on any byte, is run backwards over the data, its DFA accepts at
+ * every offset where a match starts. Only those are tried with the forward
+ * DFA, which gives the length of the match.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include "common.h"
+#include "memregex.h"
+#include "show_message.h"
+
+#define MAX_NFA_STATES (1 << 14)
+#define MAX_DFA_STATES (1 << 12)
+#define DFA_HASH_SIZE (2 * MAX_DFA_STATES)
+#define MAX_REPEAT (1000)
+
+#define DEAD_STATE (0)
+#define UNKNOWN_STATE (-1)
+
+typedef enum {
+    NFA_EPSILON,                /* to `out` */
+    NFA_SPLIT,                  /* to both `out` and `out1` */
+    NFA_CLASS,                  /* to `out` on a byte of class `cls` */
+    NFA_MATCH
+} nfa_type_t;
+
+typedef struct {
+    nfa_type_t type;
+    int out, out1;
+    int cls;
+} nfa_state_t;
+
+typedef struct {
+    uint64_t bits[4];
+} byteclass_t;
+
+/* a set of NFA states, sorted, and its transitions */
+typedef struct {
+    int *states;
+    size_t count;
+    bool accepting;
+    int next[256];              /* UNKNOWN_STATE until computed */
+} dfa_state_t;
+
+struct sm_regex {
+    nfa_state_t *nfa;
+    size_t nnfa;
+    byteclass_t *classes;
+    size_t nclasses;
+    int nfa_start;
+    bool ignore_case;
+
+    dfa_state_t **dfa;          /* DEAD_STATE is the empty set */
+    size_t ndfa;
+    int *table;                 /* hash table of the DFA states */
+    int dfa_start;
+    int *start_states;          /* the set of `dfa_start`, to add it back */
+    size_t nstart_states;
+    unsigned flushes;
+
+    /* scratch space for the epsilon closures */
+    unsigned *marks;
+    unsigned generation;
+    int *stack;
+    int *set;
+
+    bool first[256];            /* bytes which can start a match */
+    int first_byte;             /* the only one, or -1 */
+
+    struct sm_regex *reverse;   /* the reversed pattern, unanchored */
+    uint64_t *starts;           /* bitmap of the match starts in [starts_from, starts_end) */
+    size_t starts_words;
+    size_t starts_from, starts_end;
+};
+
+/* fragments of NFA being built, with a single dangling NFA_EPSILON at the end */
+typedef struct {
+    int start, end;
+} frag_t;
+
+typedef struct {
+    sm_regex_t *re;
+    const char *p;
+    const char *error;
+    bool reverse;               /* build the NFA of the reversed pattern */
+} parser_t;
+
+static inline void class_set(byteclass_t *c, unsigned b)
+{
+    c->bits[b / 64] |= (uint64_t) 1 << (b % 64);
+}
+
+static inline bool class_has(const byteclass_t *c, unsigned b)
+{
+    return (c->bits[b / 64] >> (b % 64)) & 1;
+}
+
+/* add the other case of the ASCII letters of `cls`, done before a class is
+ * negated so that e.g. [^a] doesn't match A */
+static void class_fold(byteclass_t *cls)
+{
+    unsigned b;
+
+    for (b = 'A'; b <= 'Z'; b++) {
+        if (class_has(cls, b) || class_has(cls, tolower(b))) {
+            class_set(cls, b);
+            class_set(cls, tolower(b));
+        }
+    }
+}
+
+static int add_state(parser_t *ps, nfa_type_t type, int out, int out1)
+{
+    sm_regex_t *re = ps->re;
+
+    if (re->nnfa == MAX_NFA_STATES) {
+        ps->error = "the expression is too complex";
+        return -1;
+    }
+    re->nfa[re->nnfa].type = type;
+    re->nfa[re->nnfa].out = out;
+    re->nfa[re->nnfa].out1 = out1;
+    re->nfa[re->nnfa].cls = -1;
+    return re->nnfa++;
+}
+
+static bool frag_empty(parser_t *ps, frag_t *f)
+{
+    f->start = f->end = add_state(ps, NFA_EPSILON, -1, -1);
+    return f->start >= 0;
+}
+
+static bool frag_class(parser_t *ps, const byteclass_t *cls, frag_t *f)
+{
+    sm_regex_t *re = ps->re;
+    byteclass_t *c;
+    int end;
+
+    if ((end = add_state(ps, NFA_EPSILON, -1, -1)) < 0 ||
+        (f->start = add_state(ps, NFA_CLASS, end, -1)) < 0)
+        return false;
+    f->end = end;
+
+    if ((c = realloc(re->classes, (re->nclasses + 1) * sizeof(byteclass_t))) == NULL) {
+        ps->error = "out of memory";
+        return false;
+    }
+    re->classes = c;
+    re->classes[re->nclasses] = *cls;
+    /* the negated classes are folded already, folding them again is harmless */
+    if (re->ignore_case)
+        class_fold(&re->classes[re->nclasses]);
+    re->nfa[f->start].cls = re->nclasses++;
+    return true;
+}
+
+static void frag_concat(parser_t *ps, frag_t *a, const frag_t *b)
+{
+    ps->re->nfa[a->end].out = b->start;
+    a->end = b->end;
+}
+
+/* append `b` to `a`, or prepend it for the reversed pattern */
+static void frag_append(parser_t *ps, frag_t *a, const frag_t *b)
+{
+    if (ps->reverse) {
+        ps->re->nfa[b->end].out = a->start;
+        a->start = b->start;
+    }
+    else {
+        frag_concat(ps, a, b);
+    }
+}
+
+static int hexdigit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* parse the escape after a backslash into `cls` */
+static bool parse_escape(parser_t *ps, byteclass_t *cls)
+{
+    char c = *ps->p++;
+    unsigned b;
+    bool negate = false;
+
+    memset(cls, 0, sizeof(*cls));
+    switch (c) {
+    case '\0':
+        ps->p--;
+        ps->error = "trailing backslash";
+        return false;
+    case 'D': negate = true; /* fall through */
+    case 'd':
+        for (b = '0'; b <= '9'; b++)
+            class_set(cls, b);
+        break;
+    case 'W': negate = true; /* fall through */
+    case 'w':
+        for (b = 0; b < 256; b++)
+            if (b < 0x80 && (isalnum(b) || b == '_'))
+                class_set(cls, b);
+        break;
+    case 'S': negate = true; /* fall through */
+    case 's':
+        for (b = 0; b < 256; b++)
+            if (b < 0x80 && isspace(b))
+                class_set(cls, b);
+        break;
+    case 'n': class_set(cls, '\n'); break;
+    case 't': class_set(cls, '\t'); break;
+    case 'r': class_set(cls, '\r'); break;
+    case '0': class_set(cls, '\0'); break;
+    case 'x':
+        if (hexdigit(ps->p[0]) < 0 || hexdigit(ps->p[1]) < 0) {
+            ps->error = "\\x needs two hexadecimal digits";
+            return false;
+        }
+        class_set(cls, hexdigit(ps->p[0]) * 16 + hexdigit(ps->p[1]));
+        ps->p += 2;
+        break;
+    default:
+        if (isalnum(c)) {
+            ps->error = "unknown escape";
+            return false;
+        }
+        class_set(cls, (unsigned char) c);
+        break;
+    }
+    if (negate) {
+        if (ps->re->ignore_case)
+            class_fold(cls);
+        for (b = 0; b < 4; b++)
+            cls->bits[b] = ~cls->bits[b];
+    }
+    return true;
+}
+
+/* parse a [...] class, after the opening bracket */
+static bool parse_bracket(parser_t *ps, byteclass_t *cls)
+{
+    bool negate = false;
+    unsigned b;
+
+    memset(cls, 0, sizeof(*cls));
+    if (*ps->p == '^') {
+        negate = true;
+        ps->p++;
+    }
+    /* a leading ] is a literal */
+    do {
+        byteclass_t item;
+        int lo, hi;
+
+        if (*ps->p == '\0') {
+            ps->error = "missing ]";
+            return false;
+        }
+        if (*ps->p == '\\') {
+            ps->p++;
+            if (!parse_escape(ps, &item))
+                return false;
+            for (b = 0; b < 4; b++)
+                cls->bits[b] |= item.bits[b];
+            continue;
+        }
+        lo = (unsigned char) *ps->p++;
+        hi = lo;
+        if (ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0') {
+            ps->p++;
+            if (*ps->p == '\\') {
+                ps->p++;
+                if (!parse_escape(ps, &item))
+                    return false;
+                for (hi = 0; hi < 256 && !class_has(&item, hi); hi++)
+                    ;
+            }
+            else {
+                hi = (unsigned char) *ps->p++;
+            }
+            if (hi < lo) {
+                ps->error = "invalid range";
+                return false;
+            }
+        }
+        for (b = lo; b <= (unsigned) hi; b++)
+            class_set(cls, b);
+    } while (*ps->p != ']');
+    ps->p++;
+
+    if (negate) {
+        if (ps->re->ignore_case)
+            class_fold(cls);
+        for (b = 0; b < 4; b++)
+            cls->bits[b] = ~cls->bits[b];
+    }
+    return true;
+}
+
+static bool parse_alternation(parser_t *ps, frag_t *f);
+
+static bool parse_atom(parser_t *ps, frag_t *f)
+{
+    byteclass_t cls;
+    unsigned b;
+
+    memset(&cls, 0, sizeof(cls));
+    switch (*ps->p) {
+    case '(':
+        ps->p++;
+        if (ps->p[0] == '?' && ps->p[1] == ':')
+            ps->p += 2;
+        if (!parse_alternation(ps, f))
+            return false;
+        if (*ps->p != ')') {
+            ps->error = "missing )";
+            return false;
+        }
+        ps->p++;
+        return true;
+    case '[':
+        ps->p++;
+        if (!parse_bracket(ps, &cls))
+            return false;
+        break;
+    case '.':
+        ps->p++;
+        for (b = 0; b < 256; b++)
+            if (b != '\0' && b != '\n')
+                class_set(&cls, b);
+        break;
+    case '\\':
+        ps->p++;
+        if (!parse_escape(ps, &cls))
+            return false;
+        break;
+    case '*': case '+': case '?': case '{':
+        ps->error = "nothing to repeat";
+        return false;
+    case '^': case '$':
+        ps->error = "anchors are not supported";
+        return false;
+    default:
+        class_set(&cls, (unsigned char) *ps->p++);
+        break;
+    }
+    return frag_class(ps, &cls, f);
+}
+
+/* parse the `{m}`, `{m,}` or `{m,n}` after an atom, -1 for no maximum */
+static bool parse_bounds(parser_t *ps, long *min, long *max)
+{
+    char *end;
+
+    *min = strtol(ps->p + 1, &end, 10);
+    if (end == ps->p + 1 || *min < 0 || *min > MAX_REPEAT)
+        goto bad;
+    *max = *min;
+    if (*end == ',') {
+        const char *n = end + 1;
+        *max = (*n == '}') ? -1 : strtol(n, &end, 10);
+        if (*max != -1 && (end == n || *max < *min || *max > MAX_REPEAT))
+            goto bad;
+        if (*max == -1)
+            end = (char *) n;
+    }
+    if (*end != '}')
+        goto bad;
+    ps->p = end + 1;
+    return true;
+
+bad:
+    ps->error = "invalid repetition";
+    return false;
+}
+
+static bool parse_repetition(parser_t *ps, frag_t *f)
+{
+    const char *atom = ps->p;
+    sm_regex_t *re = ps->re;
+    frag_t copy;
+    int split, end;
+    bool repeated = false;
+
+    if (!parse_atom(ps, f))
+        return false;
+
+    while (*ps->p == '*' || *ps->p == '+' || *ps->p == '?' || *ps->p == '{') {
+        char q = *ps->p;
+
+        if (q == '{') {
+            const char *after;
+            long min, max, i;
+            parser_t sub = *ps;
+
+            if (repeated) {
+                ps->error = "nested repetition";
+                return false;
+            }
+            if (!parse_bounds(ps, &min, &max))
+                return false;
+            after = ps->p;
+
+            /* the atom is parsed again for every copy */
+            if (!frag_empty(ps, f))
+                return false;
+            for (i = 0; i < min || (max == -1 && i == min) || i < max; i++) {
+                sub.p = atom;
+                if (!parse_atom(&sub, &copy)) {
+                    ps->error = sub.error;
+                    return false;
+                }
+                if (i >= min) {
+                    /* optional copies, or a star for no maximum */
+                    if ((end = add_state(ps, NFA_EPSILON, -1, -1)) < 0 ||
+                        (split = add_state(ps, NFA_SPLIT, copy.start, end)) < 0)
+                        return false;
+                    re->nfa[copy.end].out = (max == -1) ? split : end;
+                    copy.start = split;
+                    copy.end = end;
+                }
+                frag_append(ps, f, &copy);
+                if (max == -1 && i == min)
+                    break;
+            }
+            ps->p = after;
+            repeated = true;
+            continue;
+        }
+
+        ps->p++;
+        if ((end = add_state(ps, NFA_EPSILON, -1, -1)) < 0 ||
+            (split = add_state(ps, NFA_SPLIT, f->start, end)) < 0)
+            return false;
+        switch (q) {
+        case '*':
+            re->nfa[f->end].out = split;
+            f->start = split;
+            break;
+        case '+':
+            re->nfa[f->end].out = split;
+            break;
+        case '?':
+            re->nfa[f->end].out = end;
+            f->start = split;
+            break;
+        }
+        f->end = end;
+        repeated = true;
+    }
+    return true;
+}
+
+static bool parse_concatenation(parser_t *ps, frag_t *f)
+{
+    frag_t next;
+
+    if (!frag_empty(ps, f))
+        return false;
+    while (*ps->p != '\0' && *ps->p != '|' && *ps->p != ')') {
+        if (!parse_repetition(ps, &next))
+            return false;
+        frag_append(ps, f, &next);
+    }
+    return true;
+}
+
+static bool parse_alternation(parser_t *ps, frag_t *f)
+{
+    frag_t other;
+    int split, end;
+
+    if (!parse_concatenation(ps, f))
+        return false;
+    while (*ps->p == '|') {
+        ps->p++;
+        if (!parse_concatenation(ps, &other))
+            return false;
+        if ((end = add_state(ps, NFA_EPSILON, -1, -1)) < 0 ||
+            (split = add_state(ps, NFA_SPLIT, f->start, other.start)) < 0)
+            return false;
+        ps->re->nfa[f->end].out = end;
+        ps->re->nfa[other.end].out = end;
+        f->start = split;
+        f->end = end;
+    }
+    return true;
+}
+
+/*
+ * The lazy DFA
+ */
+
+static int compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *) a, y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+/* add to re->set the NFA_CLASS and NFA_MATCH states reachable from `state` */
+static void add_closure(sm_regex_t *re, int state, size_t *count)
+{
+    size_t top = 0;
+
+    re->stack[top++] = state;
+    while (top > 0) {
+        int s = re->stack[--top];
+        const nfa_state_t *n;
+
+        if (s < 0 || re->marks[s] == re->generation)
+            continue;
+        re->marks[s] = re->generation;
+        n = &re->nfa[s];
+        switch (n->type) {
+        case NFA_EPSILON:
+            re->stack[top++] = n->out;
+            break;
+        case NFA_SPLIT:
+            re->stack[top++] = n->out1;
+            re->stack[top++] = n->out;
+            break;
+        case NFA_CLASS:
+        case NFA_MATCH:
+            re->set[(*count)++] = s;
+            break;
+        }
+    }
+}
+
+static inline void new_generation(sm_regex_t *re)
+{
+    if (++re->generation == 0) {
+        memset(re->marks, 0, re->nnfa * sizeof(unsigned));
+        re->generation = 1;
+    }
+}
+
+static size_t hash_set(const int *states, size_t count)
+{
+    size_t h = 14695981039346656037UL, i;
+
+    for (i = 0; i < count; i++)
+        h = (h ^ (size_t) states[i]) * 1099511628211UL;
+    return h;
+}
+
+static void flush_dfa(sm_regex_t *re)
+{
+    size_t i;
+
+    for (i = 1; i < re->ndfa; i++) {
+        free(re->dfa[i]->states);
+        free(re->dfa[i]);
+    }
+    re->ndfa = 1;
+    for (i = 0; i < DFA_HASH_SIZE; i++)
+        re->table[i] = -1;
+    re->flushes++;
+}
+
+static int add_dfa_state(sm_regex_t *re, const int *states, size_t count);
+
+/* the DFA state of the sorted set of NFA states, added if needed, -1 on error */
+static int lookup_dfa_state(sm_regex_t *re, const int *states, size_t count)
+{
+    size_t h;
+
+    if (count == 0)
+        return DEAD_STATE;
+    for (h = hash_set(states, count) % DFA_HASH_SIZE; re->table[h] != -1; h = (h + 1) % DFA_HASH_SIZE) {
+        const dfa_state_t *d = re->dfa[re->table[h]];
+        if (d->count == count && memcmp(d->states, states, count * sizeof(int)) == 0)
+            return re->table[h];
+    }
+
+    if (re->ndfa == MAX_DFA_STATES) {
+        flush_dfa(re);
+        re->dfa_start = add_dfa_state(re, re->start_states, re->nstart_states);
+        if (re->dfa_start < 0)
+            return -1;
+    }
+    return add_dfa_state(re, states, count);
+}
+
+static int add_dfa_state(sm_regex_t *re, const int *states, size_t count)
+{
+    dfa_state_t *d;
+    size_t h, i;
+
+    if ((d = malloc(sizeof(dfa_state_t))) == NULL ||
+        (d->states = malloc(count * sizeof(int))) == NULL) {
+        free(d);
+        return -1;
+    }
+    memcpy(d->states, states, count * sizeof(int));
+    d->count = count;
+    d->accepting = false;
+    for (i = 0; i < count; i++)
+        d->accepting |= (re->nfa[states[i]].type == NFA_MATCH);
+    for (i = 0; i < 256; i++)
+        d->next[i] = UNKNOWN_STATE;
+
+    for (h = hash_set(states, count) % DFA_HASH_SIZE; re->table[h] != -1; h = (h + 1) % DFA_HASH_SIZE)
+        ;
+    re->table[h] = re->ndfa;
+    re->dfa[re->ndfa] = d;
+    return re->ndfa++;
+}
+
+/* compute the transition of `state` on `byte`, DEAD_STATE on error */
+static int compute_transition(sm_regex_t *re, int state, uint8_t byte)
+{
+    const dfa_state_t *d = re->dfa[state];
+    unsigned flushes = re->flushes;
+    size_t i, count = 0;
+    int next;
+
+    new_generation(re);
+    for (i = 0; i < d->count; i++) {
+        const nfa_state_t *n = &re->nfa[d->states[i]];
+        if (n->type == NFA_CLASS && class_has(&re->classes[n->cls], byte))
+            add_closure(re, n->out, &count);
+    }
+    qsort(re->set, count, sizeof(int), compare_ints);
+
+    if ((next = lookup_dfa_state(re, re->set, count)) < 0)
+        return DEAD_STATE;
+    /* `d` is gone if the cache was flushed */
+    if (re->flushes == flushes)
+        re->dfa[state]->next[byte] = next;
+    return next;
+}
+
+static inline int step(sm_regex_t *re, int state, uint8_t byte)
+{
+    int next = re->dfa[state]->next[byte];
+    return (next != UNKNOWN_STATE) ? next : compute_transition(re, state, byte);
+}
+
+/* compile `pattern`, or its reversal after a loop on any byte */
+static sm_regex_t *compile(const char *pattern, bool ignore_case, bool reverse)
+{
+    sm_regex_t *re;
+    parser_t ps;
+    frag_t f;
+    size_t count = 0, i;
+    int match, nfirst = 0;
+
+    if ((re = calloc(1, sizeof(sm_regex_t))) == NULL ||
+        (re->nfa = malloc(MAX_NFA_STATES * sizeof(nfa_state_t))) == NULL ||
+        (re->dfa = malloc(MAX_DFA_STATES * sizeof(dfa_state_t *))) == NULL ||
+        (re->table = malloc(DFA_HASH_SIZE * sizeof(int))) == NULL ||
+        (re->dfa[0] = calloc(1, sizeof(dfa_state_t))) == NULL) {
+        show_error("memory allocation for the regex failed.\n");
+        sm_regex_free(re);
+        return NULL;
+    }
+    re->ignore_case = ignore_case;
+    re->ndfa = 1;
+    for (i = 0; i < DFA_HASH_SIZE; i++)
+        re->table[i] = -1;
+
+    /* the dead state goes nowhere */
+    for (i = 0; i < 256; i++)
+        re->dfa[0]->next[i] = DEAD_STATE;
+
+    ps.re = re;
+    ps.p = pattern;
+    ps.error = NULL;
+    ps.reverse = reverse;
+    if (!parse_alternation(&ps, &f) || *ps.p != '\0' ||
+        (match = add_state(&ps, NFA_MATCH, -1, -1)) < 0) {
+        if (ps.error == NULL)
+            ps.error = "unmatched )";
+        show_error("%s at offset %ld of the regex.\n", ps.error, (long) (ps.p - pattern));
+        sm_regex_free(re);
+        return NULL;
+    }
+    re->nfa[f.end].out = match;
+    re->nfa_start = f.start;
+
+    if (reverse) {
+        byteclass_t any;
+        frag_t loop;
+        int split;
+
+        memset(&any, 0xff, sizeof(any));
+        if (!frag_class(&ps, &any, &loop) ||
+            (split = add_state(&ps, NFA_SPLIT, loop.start, f.start)) < 0) {
+            show_error("%s in the regex.\n", ps.error);
+            sm_regex_free(re);
+            return NULL;
+        }
+        re->nfa[loop.end].out = split;
+        re->nfa_start = split;
+    }
+
+    if ((re->marks = calloc(re->nnfa, sizeof(unsigned))) == NULL ||
+        (re->stack = malloc((2 * re->nnfa + 1) * sizeof(int))) == NULL ||
+        (re->set = malloc(re->nnfa * sizeof(int))) == NULL) {
+        show_error("memory allocation for the regex failed.\n");
+        sm_regex_free(re);
+        return NULL;
+    }
+
+    /* the start state, kept to add it back when the cache is flushed */
+    new_generation(re);
+    add_closure(re, re->nfa_start, &count);
+    qsort(re->set, count, sizeof(int), compare_ints);
+    if ((re->start_states = malloc(count * sizeof(int))) == NULL ||
+        (re->dfa_start = add_dfa_state(re, re->set, count)) < 0) {
+        show_error("memory allocation for the regex failed.\n");
+        sm_regex_free(re);
+        return NULL;
+    }
+    memcpy(re->start_states, re->set, count * sizeof(int));
+    re->nstart_states = count;
+
+    /* the bytes a match can start with, to skip to them */
+    re->first_byte = -1;
+    for (i = 0; i < 256; i++) {
+        re->first[i] = (step(re, re->dfa_start, i) != DEAD_STATE);
+        if (re->first[i]) {
+            re->first_byte = i;
+            nfirst++;
+        }
+    }
+    if (nfirst != 1)
+        re->first_byte = -1;
+    return re;
+}
+
+sm_regex_t *sm_regex_compile(const char *pattern, bool ignore_case)
+{
+    sm_regex_t *re;
+
+    if ((re = compile(pattern, ignore_case, false)) == NULL)
+        return NULL;
+    if ((re->reverse = compile(pattern, ignore_case, true)) == NULL) {
+        sm_regex_free(re);
+        return NULL;
+    }
+    return re;
+}
+
+void sm_regex_free(sm_regex_t *re)
+{
+    size_t i;
+
+    if (re == NULL)
+        return;
+    if (re->dfa) {
+        for (i = 0; i < re->ndfa; i++) {
+            free(re->dfa[i]->states);
+            free(re->dfa[i]);
+        }
+        free(re->dfa);
+    }
+    free(re->nfa);
+    free(re->classes);
+    free(re->table);
+    free(re->start_states);
+    free(re->marks);
+    free(re->stack);
+    free(re->set);
+    free(re->starts);
+    sm_regex_free(re->reverse);
+    free(re);
+}
+
+size_t sm_regex_match(sm_regex_t *re, const uint8_t *data, size_t size)
+{
+    int state = re->dfa_start;
+    size_t i, length = 0;
+
+    size = MIN(size, MAX_REGEX_MATCH);
+    for (i = 0; i < size; i++) {
+        state = step(re, state, data[i]);
+        if (state == DEAD_STATE)
+            break;
+        if (re->dfa[state]->accepting)
+            length = i + 1;
+    }
+    return length;
+}
+
+void sm_regex_begin(sm_regex_t *re)
+{
+    re->starts_from = re->starts_end = 0;
+}
+
+/* mark the offsets of [from, end) where a match starts, in one backward pass
+ * from the last byte a match starting before `end` can reach */
+static bool mark_starts(sm_regex_t *re, const uint8_t *data, size_t size,
+                        size_t from, size_t end)
+{
+    sm_regex_t *rev = re->reverse;
+    size_t words = (end - from + 63) / 64, pos;
+    int state = rev->dfa_start;
+
+    if (words > re->starts_words) {
+        uint64_t *starts = realloc(re->starts, words * sizeof(uint64_t));
+        if (starts == NULL)
+            return false;
+        re->starts = starts;
+        re->starts_words = words;
+    }
+    memset(re->starts, 0, words * sizeof(uint64_t));
+
+    for (pos = MIN(size, end - 1 + MAX_REGEX_MATCH); pos-- > from; ) {
+        state = step(rev, state, data[pos]);
+        if (pos < end && rev->dfa[state]->accepting)
+            re->starts[(pos - from) / 64] |= (uint64_t) 1 << ((pos - from) % 64);
+    }
+    re->starts_from = from;
+    re->starts_end = end;
+    return true;
+}
+
+size_t sm_regex_next(sm_regex_t *re, const uint8_t *data, size_t size,
+                     size_t from, size_t limit)
+{
+    size_t pos, end = MIN(limit, size);
+
+    if (from >= end)
+        return limit;
+    if (re->first_byte >= 0 && memchr(data + from, re->first_byte, end - from) == NULL)
+        return limit;
+    if ((from < re->starts_from || end > re->starts_end) &&
+        !mark_starts(re, data, size, from, end)) {
+        show_error("memory allocation for the regex failed.\n");
+        return limit;
+    }
+
+    for (pos = from; pos < end; pos++) {
+        size_t bit = pos - re->starts_from;
+        uint64_t word = re->starts[bit / 64] >> (bit % 64);
+
+        /* skip to the next start */
+        if (word == 0) {
+            pos += 63 - bit % 64;
+            continue;
+        }
+        pos += __builtin_ctzll(word);
+        if (pos >= end)
+            break;
+        /* a match longer than MAX_REGEX_MATCH isn't one */
+        if (sm_regex_match(re, data + pos, size - pos) > 0)
+            return pos;
+    }
+    return limit;
+}
@@ -0,0 +1,62 @@
+/*
+    Regular expression search of target memory.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MEMREGEX_H
+#define MEMREGEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "value.h"
+
+/* matches are recorded as strings, whose length is limited */
+#define MAX_REGEX_MATCH ((uint16_t)(-1))
+
+/*
+ * Compile `pattern`, an extended regular expression on bytes:
+ *     .  [abc]  [^a-z]  \d \w \s \D \W \S  \n \t \r \0 \xHH
+ *     (...)  (?:...)  a|b  *  +  ?  {m}  {m,}  {m,n}
+ * `.` matches any byte but NUL and newline. There are no anchors nor
+ * backreferences. The DFA is built lazily while searching, so a compiled
+ * expression must not be used by several threads at once.
+ */
+sm_regex_t *sm_regex_compile(const char *pattern, bool ignore_case);
+void sm_regex_free(sm_regex_t *re);
+
+/* Return the length of the longest match at the start of `data`, 0 for none. */
+size_t sm_regex_match(sm_regex_t *re, const uint8_t *data, size_t size);
+
+/*
+ * Start the search of a new buffer: the match starts found in a single pass
+ * over the buffer are kept between the calls of sm_regex_next().
+ */
+void sm_regex_begin(sm_regex_t *re);
+
+/*
+ * Return the offset of the first match in the `size` bytes of `data` which
+ * starts in [from, limit), or `limit` if there is none. `data` and `size`
+ * must be the same since sm_regex_begin().
+ */
+size_t sm_regex_next(sm_regex_t *re, const uint8_t *data, size_t size,
+                     size_t from, size_t limit);
+
+#endif /* MEMREGEX_H */
@@ -46,6 +46,7 @@
 #include <stdbool.h>
 #include <limits.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 
 // dirty hack for FreeBSD
 #if defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
@@ -55,7 +56,11 @@
 #define PTRACE_POKEDATA PT_WRITE_D
 #endif
 
+#include "bytesearch.h"
+#include "memregex.h"
+#include "signatures.h"
 #include "common.h"
+#include "image.h"
 #include "value.h"
 #include "scanroutines.h"
 #include "scanmem.h"
@@ -71,23 +76,101 @@
 #endif
 #define SAMPLES_PER_DOT (NUM_SAMPLES / NUM_DOTS)
 #define PROGRESS_PER_SAMPLE (MAX_PROGRESS / NUM_SAMPLES)
+/* the stop flag is also checked every this many bytes (power of two),
+ * so that cancelling doesn't take 1% of a huge scan */
+#define STOP_CHECK_INTERVAL (1 << 20)
+/* with a memory budget, the smallest slice a region is read in: with less
+ * room left for the buffer, the budget is reached */
+#define MIN_SLICE_SIZE (1 << 16)
 
 /* ptrace peek buffer, used by peekdata() as a mirror of the process memory.
  * Max size is the maximum allowed rounded VLT scan length, aka UINT16_MAX,
  * plus a `long` for shifting efficiency */
 #define MAX_PEEKBUF_SIZE ((1<<16) + sizeof(long))
-static struct {
+struct sm_peekbuf {
     uint8_t cache[MAX_PEEKBUF_SIZE];  /* read from ptrace()  */
     unsigned size;              /* number of entries (in bytes) */
     const char *base;           /* base address of cached region */
     pid_t pid;                  /* what pid this applies to */
-} peekbuf;
+};
 
+/* the peek buffer of a session, allocated on first use */
+static sm_peekbuf_t *get_peekbuf(globals_t *vars)
+{
+    if (vars->peekbuf == NULL) {
+        if ((vars->peekbuf = malloc(sizeof(sm_peekbuf_t))) == NULL) {
+            show_error("sorry, there was a memory allocation error.\n");
+            return NULL;
+        }
+        vars->peekbuf->size = 0;
+        vars->peekbuf->pid = 0;
+    }
+    return vars->peekbuf;
+}
 
-bool sm_attach(pid_t target)
+void sm_free_peekbuf(globals_t *vars)
+{
+    free(vars->peekbuf);
+    vars->peekbuf = NULL;
+}
+
+/* the monotonic clock in seconds, for the phases of the stats */
+static inline double stats_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* add_element(), counting the growths of the matches array */
+static inline matches_and_old_values_swath *record_element(globals_t *vars, matches_and_old_values_swath *swath,
+                                                           char *remote_address, uint8_t new_byte, match_flags new_flags)
+{
+    size_t allocated = vars->matches->bytes_allocated;
+
+    swath = add_element(&vars->matches, swath, remote_address, new_byte, new_flags);
+    /* the matches are NULL if the reallocation failed */
+    if (UNLIKELY(vars->matches && vars->matches->bytes_allocated != allocated)) {
+        vars->stats.reallocs++;
+        vars->stats.matches_peak = MAX(vars->stats.matches_peak, vars->matches->bytes_allocated);
+    }
+    return swath;
+}
+
+/* whether a match of `length` bytes and the null swath ending the matches
+ * fit in max_needed_bytes, without a reallocation beyond it */
+static inline bool room_for_match(const matches_and_old_values_array *array,
+                                  matches_and_old_values_swath *swath, size_t length)
+{
+    char *end = swath->number_of_bytes ? (char *)local_address_beyond_last_element(swath) :
+                                         (char *)swath->data;
+
+    return (size_t)(end - (const char *)array) + 2 * sizeof(matches_and_old_values_swath) +
+           length * sizeof(old_value_and_match_info) <= array->max_needed_bytes;
+}
+
+/* null_terminate() the matches, counting its reallocation */
+static bool terminate_matches(globals_t *vars, matches_and_old_values_swath *swath)
+{
+    size_t allocated = vars->matches->bytes_allocated;
+
+    if (!(vars->matches = null_terminate(vars->matches, swath))) {
+        show_error("memory allocation error while reducing matches-array size\n");
+        return false;
+    }
+    if (vars->matches->bytes_allocated != allocated)
+        vars->stats.reallocs++;
+    return true;
+}
+
+static bool attach(sm_stats_t *stats, pid_t target)
 {
     int status;
+    double start = stats_clock();
 
+    stats->attaches++;
+    stats->syscalls++;
     /* attach to the target application, which should cause a SIGSTOP */
     if (ptrace(PTRACE_ATTACH, target, NULL, NULL) == -1L) {
         show_error("failed to attach to %d, %s\n", target, strerror(errno));
@@ -95,92 +178,139 @@ bool sm_attach(pid_t target)
     }
 
     /* wait for the SIGSTOP to take place. */
+    stats->syscalls++;
     if (waitpid(target, &status, 0) == -1 || !WIFSTOPPED(status)) {
         show_error("there was an error waiting for the target to stop.\n");
         show_info("%s\n", strerror(errno));
         return false;
     }
-
-    /* flush the peek buffer */
-    memset(&peekbuf, 0x00, sizeof(peekbuf));
+    stats->seconds[SM_PHASE_ATTACH] += stats_clock() - start;
 
     /* everything looks okay */
     return true;
 
 }
 
-bool sm_detach(pid_t target)
+static bool detach(sm_stats_t *stats, pid_t target)
 {
+    double start = stats_clock();
+    bool ok;
+
     // addr is ignored on Linux, but should be 1 on FreeBSD in order to let the child process continue execution where it had been interrupted
-    return ptrace(PTRACE_DETACH, target, 1, 0) == 0;
+    ok = (ptrace(PTRACE_DETACH, target, 1, 0) == 0);
+    stats->syscalls++;
+    stats->seconds[SM_PHASE_DETACH] += stats_clock() - start;
+    return ok;
+}
+
+/* attach to the target of the session and flush its peek buffer, an image
+ * is always there */
+bool sm_session_attach(globals_t *vars)
+{
+    if (vars->image)
+        return true;
+    if (attach(&vars->stats, vars->target) == false)
+        return false;
+    if (vars->peekbuf)
+        vars->peekbuf->size = 0;
+    return true;
+}
+
+bool sm_session_detach(globals_t *vars)
+{
+    if (vars->image)
+        return true;
+    return detach(&vars->stats, vars->target);
+}
+
+bool sm_attach(pid_t target)
+{
+    if (attach(&sm_globals.stats, target) == false)
+        return false;
+
+    /* flush the peek buffer of the default session */
+    if (sm_globals.peekbuf)
+        sm_globals.peekbuf->size = 0;
+    return true;
+}
+
+bool sm_detach(pid_t target)
+{
+    return detach(&sm_globals.stats, target);
 }
 
 
 /*
- * sm_peekdata - caches overlapping ptrace reads to improve performance.
+ * peekdata - caches overlapping ptrace reads to improve performance.
  * 
  * This routine calls `ptrace(PEEKDATA, ...)`, and fills the peekbuf cache,
  * to make a local mirror of the process memory we're interested in.
  */
 
-extern inline bool sm_peekdata(pid_t pid, const char *addr, uint16_t length, const mem64_t **result_ptr, size_t *memlength)
+static inline bool peekdata(sm_stats_t *stats, sm_peekbuf_t *pb, pid_t pid, const char *addr, uint16_t length, const mem64_t **result_ptr, size_t *memlength)
 {
     const char *reqaddr = addr;
     int i, j;
     unsigned int missing_bytes = 0;
+    double start;
 
-    assert(peekbuf.size <= MAX_PEEKBUF_SIZE);
+    assert(pb->size <= MAX_PEEKBUF_SIZE);
     assert(result_ptr != NULL);
     assert(memlength != NULL);
 
     /* check if we have a cache hit */
-    if (pid == peekbuf.pid &&
-        reqaddr >= peekbuf.base &&
-        (unsigned long) (reqaddr + length - peekbuf.base) <= peekbuf.size)
+    if (pid == pb->pid &&
+        reqaddr >= pb->base &&
+        (unsigned long) (reqaddr + length - pb->base) <= pb->size)
     {
-        *result_ptr = (mem64_t*)&peekbuf.cache[reqaddr - peekbuf.base];
-        *memlength = peekbuf.base - reqaddr + peekbuf.size;
+        *result_ptr = (mem64_t*)&pb->cache[reqaddr - pb->base];
+        *memlength = pb->base - reqaddr + pb->size;
+        stats->peek_hits++;
         return true;
     }
-    else if (pid == peekbuf.pid &&
-             reqaddr >= peekbuf.base &&
-             (unsigned long) (reqaddr - peekbuf.base) < peekbuf.size)
+    else if (pid == pb->pid &&
+             reqaddr >= pb->base &&
+             (unsigned long) (reqaddr - pb->base) < pb->size)
     {
 
-        assert(peekbuf.size != 0);
+        assert(pb->size != 0);
 
         /* partial hit, we have some of the data but not all, so remove old entries - shift the frame by as far as is necessary */
         /* missing bytes: round up to nearest long size for ptrace efficiency */
-        missing_bytes = (reqaddr + length) - (peekbuf.base + peekbuf.size);
+        missing_bytes = (reqaddr + length) - (pb->base + pb->size);
         missing_bytes = sizeof(long) * (1 + (missing_bytes-1) / sizeof(long));
 
         /* head shift if necessary */
-        if (peekbuf.size + missing_bytes > MAX_PEEKBUF_SIZE)
+        if (pb->size + missing_bytes > MAX_PEEKBUF_SIZE)
         {
-            int shift_size = reqaddr-peekbuf.base;
+            int shift_size = reqaddr-pb->base;
             shift_size = sizeof(long) * (shift_size / sizeof(long));
 
-            memmove(peekbuf.cache, &peekbuf.cache[shift_size], peekbuf.size-shift_size);
+            memmove(pb->cache, &pb->cache[shift_size], pb->size-shift_size);
 
-            peekbuf.size -= shift_size;
-            peekbuf.base += shift_size;
+            pb->size -= shift_size;
+            pb->base += shift_size;
         }
     }
     else {
         /* cache miss, invalidate the cache */
         missing_bytes = length;
-        peekbuf.pid = pid;
-        peekbuf.size = 0;
-        peekbuf.base = addr;
+        pb->pid = pid;
+        pb->size = 0;
+        pb->base = addr;
     }
     /* we need a ptrace() to complete the request */
+    stats->peek_misses++;
+    start = stats_clock();
     errno = 0;
     
     for (i = 0; i < missing_bytes; i += sizeof(long))
     {
-        const char *ptrace_address = peekbuf.base + peekbuf.size;
+        const char *ptrace_address = pb->base + pb->size;
         long ptraced_long = ptrace(PTRACE_PEEKDATA, pid, ptrace_address, NULL);
 
+        stats->syscalls++;
+
         /* check if ptrace() succeeded */
         if (UNLIKELY(ptraced_long == -1L && errno != 0)) {
             /* it's possible i'm trying to read partially oob */
@@ -190,21 +320,23 @@ extern inline bool sm_peekdata(pid_t pid, const char *addr, uint16_t length, con
                 for (j = 1, errno = 0; j < sizeof(long); j++, errno = 0) {
                 
                     /* try for a shifted ptrace - 'continue' (i.e. try an increased shift) if it fails */
+                    stats->syscalls++;
                     if ((ptraced_long = ptrace(PTRACE_PEEKDATA, pid, ptrace_address - j, NULL)) == -1L && 
                         (errno == EIO || errno == EFAULT))
                             continue;
                     
                     /* cache it with the appropriate offset */
-                    if(peekbuf.size >= j)
+                    if(pb->size >= j)
                     {
-                        memcpy(&peekbuf.cache[peekbuf.size - j], &ptraced_long, sizeof(long));
+                        memcpy(&pb->cache[pb->size - j], &ptraced_long, sizeof(long));
                     }
                     else
                     {
-                        memcpy(&peekbuf.cache[0], &ptraced_long, sizeof(long));
-                        peekbuf.base -= j;
+                        memcpy(&pb->cache[0], &ptraced_long, sizeof(long));
+                        pb->base -= j;
                     }
-                    peekbuf.size += sizeof(long) - j;
+                    pb->size += sizeof(long) - j;
+                    stats->bytes_read += sizeof(long) - j;
                     
                     /* interrupt the gathering process */
                     break;
@@ -215,45 +347,82 @@ extern inline bool sm_peekdata(pid_t pid, const char *addr, uint16_t length, con
             }
             
             /* I wont print a message here, would be very noisy if a region is unmapped */
+            stats->seconds[SM_PHASE_READ] += stats_clock() - start;
             *result_ptr = NULL;
             *memlength = 0;
             return false;
         }
         
         /* otherwise, ptrace() worked - cache the data and increase the size */
-        memcpy(&peekbuf.cache[peekbuf.size], &ptraced_long, sizeof(long));
-        peekbuf.size += sizeof(long);
+        memcpy(&pb->cache[pb->size], &ptraced_long, sizeof(long));
+        pb->size += sizeof(long);
+        stats->bytes_read += sizeof(long);
     }
 
 end:
+    stats->seconds[SM_PHASE_READ] += stats_clock() - start;
     /* return result to caller */
-    *result_ptr = (mem64_t*)&peekbuf.cache[reqaddr - peekbuf.base];
-    *memlength = peekbuf.base - reqaddr + peekbuf.size;
+    *result_ptr = (mem64_t*)&pb->cache[reqaddr - pb->base];
+    *memlength = pb->base - reqaddr + pb->size;
     return true;
 }
 
+/* peekdata() of a session, which points into its image if it has one */
+static inline bool session_peekdata(globals_t *vars, sm_peekbuf_t *pb, const char *addr, uint16_t length, const mem64_t **result_ptr, size_t *memlength)
+{
+    if (vars->image) {
+        *result_ptr = (const mem64_t *) sm_image_data(vars->image, addr, memlength);
+        if (*result_ptr == NULL) {
+            *memlength = 0;
+            return false;
+        }
+        return true;
+    }
+    return peekdata(&vars->stats, pb, vars->target, addr, length, result_ptr, memlength);
+}
+
+bool sm_session_peekdata(globals_t *vars, const char *addr, uint16_t length, const mem64_t **result_ptr, size_t *memlength)
+{
+    sm_peekbuf_t *pb = get_peekbuf(vars);
+
+    if (pb == NULL)
+        return false;
+    return session_peekdata(vars, pb, addr, length, result_ptr, memlength);
+}
+
+/* legacy interface, uses the peek buffer of the default session */
+bool sm_peekdata(pid_t pid, const char *addr, uint16_t length, const mem64_t **result_ptr, size_t *memlength)
+{
+    sm_peekbuf_t *pb = get_peekbuf(&sm_globals);
+
+    if (pb == NULL)
+        return false;
+    return peekdata(&sm_globals.stats, pb, pid, addr, length, result_ptr, memlength);
+}
+
 static inline void print_a_dot(void)
 {
     fprintf(stderr, ".");
     fflush(stderr);
 }
 
-static inline uint16_t flags_to_memlength(scan_data_type_t scan_data_type, match_flags flags)
+/* scan_progress and stop_flag are shared with front-end threads */
+static inline void update_progress(globals_t *vars, double progress)
 {
-    switch(scan_data_type)
-    {
-        case BYTEARRAY:
-        case STRING:
-            return flags;
-            break;
-        default: /* numbers */
-                 if (flags & flags_64b) return 8;
-            else if (flags & flags_32b) return 4;
-            else if (flags & flags_16b) return 2;
-            else if (flags & flags_8b ) return 1;
-            else    /* it can't be a variable of any size */ return 0;
-            break;
-    }
+    __atomic_store(&vars->scan_progress, &progress, __ATOMIC_RELAXED);
+    if (vars->callbacks && vars->callbacks->progress)
+        vars->callbacks->progress(progress, vars->callbacks->user_data);
+}
+
+static inline void report_partial(globals_t *vars)
+{
+    if (vars->callbacks && vars->callbacks->partial)
+        vars->callbacks->partial(vars->num_matches, vars->callbacks->user_data);
+}
+
+static inline bool stop_requested(globals_t *vars)
+{
+    return __atomic_load_n(&vars->stop_flag, __ATOMIC_RELAXED);
 }
 
 /* This is the function that handles when you enter a value (or >, <, =) for the second or later time (i.e. when there's already a list of matches);
@@ -272,14 +441,27 @@ bool sm_checkmatches(globals_t *vars,
     unsigned int samples_to_dot = SAMPLES_PER_DOT;
     size_t bytes_at_next_sample;
     size_t bytes_per_sample;
-
-    if (sm_choose_scanroutine(vars->options.scan_data_type, match_type, uservalue, vars->options.reverse_endianness) == false)
+    double progress = 0.0;
+    double scan_start, read_seconds;
+    scan_routine_t scan_routine;
+    sm_peekbuf_t *pb;
+    sm_sigset_t *sigset = uservalue ? uservalue->sigset_value : NULL;
+
+    scan_routine = sm_find_scanroutine(vars->options.scan_data_type, match_type, uservalue, vars->options.reverse_endianness);
+    vars->scan_routine = scan_routine;
+    if (scan_routine == NULL)
     {
         show_error("unsupported scan for current data type.\n");
         return false;
     }
+    vars->stats.checks++;
 
-    assert(sm_scan_routine);
+    /* the signatures of the matches are those of the scan that recorded them */
+    sm_sigset_free(vars->signatures);
+    vars->signatures = NULL;
+
+    if ((pb = get_peekbuf(vars)) == NULL)
+        return false;
 
     while(tmp_swath_index->number_of_bytes)
     {
@@ -298,13 +480,14 @@ bool sm_checkmatches(globals_t *vars,
 
     int required_extra_bytes_to_record = 0;
     vars->num_matches = 0;
-    vars->scan_progress = 0.0;
-    vars->stop_flag = false;
+    update_progress(vars, progress);
 
     /* stop and attach to the target */
-    if (sm_attach(vars->target) == false)
+    if (sm_session_attach(vars) == false)
         return false;
 
+    scan_start = stats_clock();
+    read_seconds = vars->stats.seconds[SM_PHASE_READ];
     while (reading_swath.first_byte_in_child) {
         unsigned int match_length = 0;
         const mem64_t *memory_ptr;
@@ -312,11 +495,12 @@ bool sm_checkmatches(globals_t *vars,
         match_flags checkflags;
 
         match_flags old_flags = reading_swath_index->data[reading_iterator].match_info;
-        uint old_length = flags_to_memlength(vars->options.scan_data_type, old_flags);
+        uint old_length = (uservalue && uservalue->group_value) ? uservalue->group_value->span :
+                          flags_to_memlength(vars->options.scan_data_type, old_flags);
         char *address = reading_swath.first_byte_in_child + reading_iterator;
 
         /* read value from this address */
-        if (UNLIKELY(sm_peekdata(vars->target, address, old_length, &memory_ptr, &memlength) == false))
+        if (UNLIKELY(session_peekdata(vars, pb, address, old_length, &memory_ptr, &memlength) == false))
         {
             /* If we can't look at the data here, just abort the whole recording, something bad happened */
             required_extra_bytes_to_record = 0;
@@ -328,7 +512,7 @@ bool sm_checkmatches(globals_t *vars,
 
             checkflags = flags_empty;
 
-            match_length = (*sm_scan_routine)(memory_ptr, memlength, &old_val, uservalue, &checkflags);
+            match_length = (*scan_routine)(memory_ptr, memlength, &old_val, uservalue, &checkflags);
         }
 
         if (match_length > 0)
@@ -341,8 +525,14 @@ bool sm_checkmatches(globals_t *vars,
                - We can get away with assuming that the pointers will stay valid,
                  because as we never add more data to the array than there was before, it will not reallocate. */
 
-            writing_swath_index = add_element(&(vars->matches), writing_swath_index, address,
+            writing_swath_index = record_element(vars, writing_swath_index, address,
                                               get_u8b(memory_ptr), checkflags);
+            if (sigset && !sm_sigset_record(sigset, address)) {
+                show_error("sorry, there was a memory allocation error.\n");
+                terminate_matches(vars, writing_swath_index);
+                sm_session_detach(vars);
+                return false;
+            }
 
             ++vars->num_matches;
 
@@ -350,7 +540,7 @@ bool sm_checkmatches(globals_t *vars,
         }
         else if (required_extra_bytes_to_record)
         {
-            writing_swath_index = add_element(&(vars->matches), writing_swath_index, address,
+            writing_swath_index = record_element(vars, writing_swath_index, address,
                                               get_u8b(memory_ptr), flags_empty);
             --required_extra_bytes_to_record;
         }
@@ -360,16 +550,19 @@ bool sm_checkmatches(globals_t *vars,
             /* handle rounding */
             if (LIKELY(--samples_remaining > 0)) {
                 /* for front-end, update percentage */
-                vars->scan_progress += PROGRESS_PER_SAMPLE;
+                progress += PROGRESS_PER_SAMPLE;
+                update_progress(vars, progress);
+                report_partial(vars);
                 if (UNLIKELY(--samples_to_dot == 0)) {
                     samples_to_dot = SAMPLES_PER_DOT;
                     /* for user, just print a dot */
                     print_a_dot();
                 }
-                /* stop scanning if asked to */
-                if (vars->stop_flag) break;
             }
         }
+        /* stop scanning if asked to */
+        if (UNLIKELY(bytes_scanned % STOP_CHECK_INTERVAL == 0) && stop_requested(vars))
+            break;
         ++bytes_scanned;
         
         /* go on to the next one... */
@@ -384,34 +577,36 @@ bool sm_checkmatches(globals_t *vars,
         }
     }
     
-    if (!(vars->matches = null_terminate(vars->matches, writing_swath_index)))
-    {
-        show_error("memory allocation error while reducing matches-array size\n");
+    if (!terminate_matches(vars, writing_swath_index))
         return false;
-    }
+    /* the peek buffer misses were timed as reads */
+    vars->stats.seconds[SM_PHASE_SCAN] += stats_clock() - scan_start -
+                                          (vars->stats.seconds[SM_PHASE_READ] - read_seconds);
 
     show_user("ok\n");
 
     /* tell front-end we've done */
-    vars->scan_progress = MAX_PROGRESS;
+    update_progress(vars, MAX_PROGRESS);
 
     show_info("we currently have %ld matches.\n", vars->num_matches);
 
     /* okay, detach */
-    return sm_detach(vars->target);
+    return sm_session_detach(vars);
 }
 
 /* read region using /proc/pid/mem */
-static inline ssize_t readregion(pid_t target, void *buf, size_t count, unsigned long offset)
+static inline ssize_t readregion(sm_stats_t *stats, pid_t target, void *buf, size_t count, unsigned long offset)
 {
     char mem[32];
     int fd;
     ssize_t len;
+    double start = stats_clock();
     
     /* print the path to mem file */
     snprintf(mem, sizeof(mem), "/proc/%d/mem", target);
     
     /* attempt to open the file */
+    stats->syscalls++;
     if ((fd = open(mem, O_RDONLY)) == -1) {
         show_error("unable to open %s.\n", mem);
         return -1;
@@ -423,10 +618,57 @@ static inline ssize_t readregion(pid_t target, void *buf, size_t count, unsigned
     /* clean up */
     close(fd);
     
+    stats->syscalls += 2;
+    if (len > 0)
+        stats->bytes_read += len;
+    stats->seconds[SM_PHASE_READ] += stats_clock() - start;
     return len;
 }
     
 
+/* read as much as possible of region `r` of an attached target into `buf`,
+ * returns the number of bytes read */
+static size_t read_region(sm_stats_t *stats, pid_t target, const region_t *r, unsigned char *buf)
+{
+    size_t nread = 0;
+
+#if HAVE_PROCMEM
+    ssize_t len = 0;
+    /* keep reading until completed */
+    while (nread < r->size) {
+        if ((len = readregion(stats, target, buf+nread, r->size-nread, (unsigned long)(r->start+nread))) == -1) {
+            /* no, continue with whatever data was read */
+            break;
+        } else {
+            /* some data was read */
+            nread += len;
+        }
+    }
+
+#else
+    /* Read the region with `ptrace()`: the API specifies that `ptrace()` returns a `long`, which
+     * is the size of a word for the current architecture, so this section will deal in `long`s */
+    double start = stats_clock();
+    for (nread = 0; nread < r->size; nread += sizeof(long)) {
+        const char *ptrace_address = r->start + nread;
+        long ptraced_long = ptrace(PTRACE_PEEKDATA, target, ptrace_address, NULL);
+
+        /* check if ptrace() succeeded */
+        stats->syscalls++;
+        if (UNLIKELY(ptraced_long == -1L && errno != 0)) {
+            /* interrupt the gathering process */
+            break;
+        }
+
+        /* otherwise, ptrace() worked - store the data */
+        memcpy(buf+nread, &ptraced_long, sizeof(long));
+    }
+    stats->bytes_read += nread;
+    stats->seconds[SM_PHASE_READ] += stats_clock() - start;
+#endif
+    return nread;
+}
+
 /* sm_searchregions() performs an initial search of the process for values matching `uservalue` */
 bool sm_searchregions(globals_t *vars, scan_match_type_t match_type, const uservalue_t *uservalue)
 {
@@ -434,21 +676,33 @@ bool sm_searchregions(globals_t *vars, scan_match_type_t match_type, const userv
     int required_extra_bytes_to_record = 0;
     unsigned long total_size = 0;
     unsigned regnum = 0;
-    element_t *n = vars->regions->head;
+    size_t n;
     region_t *r;
     unsigned long total_scan_bytes = 0;
-    unsigned char *data = NULL;
-
-    if (sm_choose_scanroutine(vars->options.scan_data_type, match_type, uservalue, vars->options.reverse_endianness) == false)
+    const unsigned char *data = NULL;
+    unsigned char *buffer = NULL;   /* of the region read from the target */
+    double progress = 0.0;
+    scan_routine_t scan_routine;
+    sm_bytesearch_t *searcher = NULL;
+    sm_regex_t *regex = NULL;
+    sm_sigset_t *sigset = NULL;
+    size_t budget = vars->options.memory_budget;
+    bool budget_reached = false;
+    /* the bytes a value may span beyond its first one */
+    size_t overlap = (uservalue && uservalue->group_value) ? uservalue->group_value->span - 1 :
+                     sizeof(mem64_t) - 1;
+
+    scan_routine = sm_find_scanroutine(vars->options.scan_data_type, match_type, uservalue, vars->options.reverse_endianness);
+    vars->scan_routine = scan_routine;
+    if (scan_routine == NULL)
     {
         show_error("unsupported scan for current data type.\n"); 
         return false;
     }
-
-    assert(sm_scan_routine);
+    vars->stats.searches++;
 
     /* stop and attach to the target */
-    if (sm_attach(vars->target) == false)
+    if (sm_session_attach(vars) == false)
         return false;
 
    
@@ -456,15 +710,13 @@ bool sm_searchregions(globals_t *vars, scan_match_type_t match_type, const userv
     if (vars->regions->size == 0) {
         show_warn("no regions defined, perhaps you deleted them all?\n");
         show_info("use the \"reset\" command to refresh regions.\n");
-        return sm_detach(vars->target);
+        return sm_session_detach(vars);
     }
     
     total_size = sizeof(matches_and_old_values_array);
 
-    while (n) {
-        total_size += ((region_t *)(n->data))->size * sizeof(old_value_and_match_info) + sizeof(matches_and_old_values_swath);
-        n = n->next;
-    }
+    for (n = 0; n < vars->regions->size; n++)
+        total_size += vars->regions->array[n].size * sizeof(old_value_and_match_info) + sizeof(matches_and_old_values_swath);
     
     total_size += sizeof(matches_and_old_values_swath); /* for null terminate */
     
@@ -475,6 +727,27 @@ bool sm_searchregions(globals_t *vars, scan_match_type_t match_type, const userv
         show_error("could not allocate match array\n");
         return false;
     }
+    vars->stats.reallocs++;
+
+    /* the signatures of the matches are those of the scan that recorded them */
+    sm_sigset_free(vars->signatures);
+    vars->signatures = NULL;
+
+    /* byte arrays, strings, regexes and signatures are searched as a whole,
+     * instead of at every offset; the searcher is built last
+     * so that the returns above don't have to free it */
+    if (match_type == MATCHEQUALTO && uservalue) {
+        if (uservalue->regex_value)
+            regex = uservalue->regex_value;
+        else if (uservalue->sigset_value)
+            sigset = uservalue->sigset_value;
+        else if (uservalue->wildcard_value)  /* bytearrays and strings regardless of case */
+            searcher = sm_bytesearch_new(uservalue->bytearray_value, uservalue->wildcard_value,
+                                         uservalue->flags);
+        else if (vars->options.scan_data_type == STRING && uservalue->string_value)
+            searcher = sm_bytesearch_new((const uint8_t *) uservalue->string_value, NULL,
+                                         uservalue->flags);
+    }
     
     writing_swath_index = vars->matches->swaths;
     
@@ -482,152 +755,268 @@ bool sm_searchregions(globals_t *vars, scan_match_type_t match_type, const userv
     writing_swath_index->number_of_bytes = 0;
     
     /* get total number of bytes */
-    for(n = vars->regions->head; n; n = n->next)
-        total_scan_bytes += ((region_t *)n->data)->size;
+    for (n = 0; n < vars->regions->size; n++)
+        total_scan_bytes += vars->regions->array[n].size;
 
-    vars->scan_progress = 0.0;
-    vars->stop_flag = false;
-    n = vars->regions->head;
+    update_progress(vars, progress);
 
     /* check every memory region */
-    while (n) {
-        size_t nread = 0;
+    for (n = 0; n < vars->regions->size; n++) {
+        size_t nread = 0, base, slice;
         int dots_remaining = NUM_DOTS;
         size_t bytes_at_next_dot;
         size_t bytes_per_dot;
         double progress_per_dot;
 
         /* load the next region */
-        r = n->data;
+        r = &vars->regions->array[n];
         bytes_per_dot = r->size / NUM_DOTS;
         bytes_at_next_dot = bytes_per_dot;
         progress_per_dot = (double)bytes_per_dot / total_scan_bytes;
 
-        /* allocate data array */
-        if ((data = malloc(r->size * sizeof(char))) == NULL) {
-            show_error("sorry, there was a memory allocation error.\n");
-            return false;
-        }
-
         /* print a progress meter so user knows we haven't crashed */
         /* cannot use show_info here because it'll append a '\n' */
         show_user("%02u/%02u searching %#10lx - %#10lx", ++regnum,
                 vars->regions->size, (unsigned long)r->start, (unsigned long)r->start + r->size);
         fflush(stderr);
 
-#if HAVE_PROCMEM
-        ssize_t len = 0;
-        /* keep reading until completed */
-        while (nread < r->size) {
-            if ((len = readregion(vars->target, data+nread, r->size-nread, (unsigned long)(r->start+nread))) == -1) {
-                /* no, continue with whatever data was read */
-                break;
-            } else {
-                /* some data was read */
-                nread += len;
+        /* The buffer and the matches share the budget: the buffer gets at
+         * most half of what is left, a region larger than that is read in
+         * slices, each with the start of the next one for the values
+         * crossing them. The matches may grow up to the rest. */
+        slice = r->size;
+        if (budget && !vars->image) {
+            size_t used = vars->matches->bytes_allocated;
+            size_t left = (budget > used) ? (budget - used) / 2 : 0;
+
+            if (r->size > left && (searcher || regex || sigset)) {
+                /* a match may be anywhere in the region, it is read at once */
+                show_user("\n");
+                show_warn("the region is larger than the memory budget allows, skipped.\n");
+                progress += (double)r->size / total_scan_bytes;
+                update_progress(vars, progress);
+                continue;
+            }
+            if (r->size > left) {
+                if (left < MIN_SLICE_SIZE + overlap) {
+                    show_user("\n");
+                    budget_reached = true;
+                    break;
+                }
+                slice = left - overlap;
             }
+            vars->matches->max_needed_bytes = MIN(total_size, budget - MIN(r->size, slice + overlap));
+        } else if (budget) {
+            vars->matches->max_needed_bytes = MIN(total_size, budget);
         }
 
-#else
-        /* Read the region with `ptrace()`: the API specifies that `ptrace()` returns a `long`, which
-         * is the size of a word for the current architecture, so this section will deal in `long`s */
-        for (nread = 0; nread < r->size; nread += sizeof(long)) {
-            const char *ptrace_address = r->start + nread;
-            long ptraced_long = ptrace(PTRACE_PEEKDATA, vars->target, ptrace_address, NULL);
+        for (base = 0; base < r->size; base += slice) {
+            size_t length = MIN(r->size - base, slice + overlap);
+            size_t memlength, offset, end;
+            double scan_start;
 
-            /* check if ptrace() succeeded */
-            if (UNLIKELY(ptraced_long == -1L && errno != 0)) {
-                /* interrupt the gathering process */
-                break;
+            if (vars->image) {
+                /* the image is mapped, search it in place */
+                if ((data = sm_image_data(vars->image, r->start, &nread)) == NULL)
+                    nread = 0;
+                nread = MIN(nread, r->size);
+            } else {
+                region_t part = *r;
+
+                /* allocate data array, the first slice is the largest */
+                if (buffer == NULL && (buffer = malloc(length)) == NULL) {
+                    show_error("sorry, there was a memory allocation error.\n");
+                    sm_bytesearch_free(searcher);
+                    return false;
+                }
+                vars->stats.buffer_peak = MAX(vars->stats.buffer_peak, length);
+                part.start += base;
+                part.size = length;
+                nread = read_region(&vars->stats, vars->target, &part, buffer);
+                data = buffer;
             }
 
-            /* otherwise, ptrace() worked - store the data */
-            memcpy(data+nread, &ptraced_long, sizeof(long));
-        }
-#endif
-        /* region has been read, tell user */
-        print_a_dot();
-
-        /* For every offset, check if we have a match.
-         * Testing `memlength > 0` is much faster than `offset < nread` */
-        size_t memlength, offset;
-        for (memlength = nread, offset = 0; memlength > 0; memlength--, offset++) {
-            unsigned int match_length;
-            const mem64_t* memory_ptr = (mem64_t*)(data+offset);
-            match_flags checkflags;
-
-            /* initialize checkflags */
-            checkflags = flags_empty;
+            /* region has been read, tell user */
+            if (base == 0)
+                print_a_dot();
 
-            /* check if we have a match */
-            match_length = (*sm_scan_routine)(memory_ptr, memlength, NULL, uservalue, &checkflags);
-            if (UNLIKELY(match_length > 0))
-            {
-                assert(match_length <= memlength);
-                writing_swath_index = add_element(&(vars->matches), writing_swath_index, r->start+offset,
-                                                  get_u8b(memory_ptr), checkflags);
-                
-                ++vars->num_matches;
-                
-                required_extra_bytes_to_record = match_length - 1;
+            /* the values starting in the overlap are scanned with the next slice */
+            end = (nread < length) ? nread : MIN(slice, nread);
+            scan_start = stats_clock();
+
+            if (sigset && !sm_sigset_begin(sigset, nread)) {
+                show_error("sorry, there was a memory allocation error.\n");
+                free(buffer);
+                return false;
             }
-            else if (required_extra_bytes_to_record)
-            {
-                writing_swath_index = add_element(&(vars->matches), writing_swath_index, r->start+offset,
-                                                  get_u8b(memory_ptr), flags_empty);
-                --required_extra_bytes_to_record;
+            if (regex)
+                sm_regex_begin(regex);
+
+            /* Jump from match to match, checking for a stop at every slice */
+            if (searcher || regex || sigset) {
+                size_t limit, resume = 0;
+
+                for (offset = 0; offset < nread; offset = limit) {
+                    limit = MIN(nread, offset + STOP_CHECK_INTERVAL);
+                    while (offset < limit) {
+                        size_t next;
+                        unsigned int match_length;
+                        match_flags checkflags = flags_empty;
+
+                        if (regex)
+                            next = sm_regex_next(regex, data, nread, MAX(offset, resume), limit);
+                        else if (sigset)
+                            next = sm_sigset_next(sigset, data, nread, offset, limit);
+                        else
+                            next = sm_bytesearch_next(searcher, data, nread, offset, limit);
+
+                        /* record the bytes still needed by the previous match */
+                        for (; required_extra_bytes_to_record && offset < next; offset++) {
+                            writing_swath_index = record_element(vars, writing_swath_index, r->start+base+offset,
+                                                              data[offset], flags_empty);
+                            --required_extra_bytes_to_record;
+                        }
+                        if (next == limit)
+                            break;
+
+                        offset = next;
+                        match_length = (*scan_routine)((mem64_t*)(data+offset), nread-offset, NULL, uservalue, &checkflags);
+                        assert(match_length > 0 && match_length <= nread-offset);
+                        if (UNLIKELY(budget && !room_for_match(vars->matches, writing_swath_index, match_length))) {
+                            budget_reached = true;
+                            break;
+                        }
+                        writing_swath_index = record_element(vars, writing_swath_index, r->start+base+offset,
+                                                          data[offset], checkflags);
+                        if (sigset && !sm_sigset_record(sigset, r->start+base+offset)) {
+                            show_error("sorry, there was a memory allocation error.\n");
+                            free(buffer);
+                            return false;
+                        }
+                        ++vars->num_matches;
+                        required_extra_bytes_to_record = match_length - 1;
+                        /* regex matches don't overlap, or every suffix would match too */
+                        resume = offset + match_length;
+                        offset++;
+                    }
+
+                    /* print a simple progress meter */
+                    while (bytes_at_next_dot < limit && dots_remaining > 1) {
+                        bytes_at_next_dot += bytes_per_dot;
+                        --dots_remaining;
+                        print_a_dot();
+                        progress += progress_per_dot;
+                        update_progress(vars, progress);
+                    }
+                    /* stop scanning if asked to */
+                    if (budget_reached || stop_requested(vars))
+                        break;
+                }
             }
+            else {
+                /* For every offset, check if we have a match.
+                 * Testing `memlength > nread - end` is much faster than `offset < end` */
+                for (memlength = nread, offset = 0; memlength > nread - end; memlength--, offset++) {
+                    unsigned int match_length;
+                    const mem64_t* memory_ptr = (mem64_t*)(data+offset);
+                    match_flags checkflags;
+
+                    /* initialize checkflags */
+                    checkflags = flags_empty;
+
+                    /* check if we have a match */
+                    match_length = (*scan_routine)(memory_ptr, memlength, NULL, uservalue, &checkflags);
+                    if (UNLIKELY(match_length > 0))
+                    {
+                        assert(match_length <= memlength);
+                        if (UNLIKELY(budget && !room_for_match(vars->matches, writing_swath_index, match_length))) {
+                            budget_reached = true;
+                            break;
+                        }
+                        writing_swath_index = record_element(vars, writing_swath_index, r->start+base+offset,
+                                                          get_u8b(memory_ptr), checkflags);
 
-            /* print a simple progress meter */
-            if (UNLIKELY(offset >= bytes_at_next_dot)) {
-                bytes_at_next_dot += bytes_per_dot;
-                /* handle rounding */
-                if (LIKELY(--dots_remaining > 0)) {
-                    /* for user, just print a dot */
-                    print_a_dot();
-                    /* for front-end, update percentage */
-                    vars->scan_progress += progress_per_dot;
+                        ++vars->num_matches;
+
+                        required_extra_bytes_to_record = match_length - 1;
+                    }
+                    else if (required_extra_bytes_to_record)
+                    {
+                        writing_swath_index = record_element(vars, writing_swath_index, r->start+base+offset,
+                                                          get_u8b(memory_ptr), flags_empty);
+                        --required_extra_bytes_to_record;
+                    }
+
+                    /* print a simple progress meter */
+                    if (UNLIKELY(base + offset >= bytes_at_next_dot)) {
+                        bytes_at_next_dot += bytes_per_dot;
+                        /* handle rounding */
+                        if (LIKELY(--dots_remaining > 0)) {
+                            /* for user, just print a dot */
+                            print_a_dot();
+                            /* for front-end, update percentage */
+                            progress += progress_per_dot;
+                            update_progress(vars, progress);
+                        }
+                    }
                     /* stop scanning if asked to */
-                    if (vars->stop_flag) break;
+                    if (UNLIKELY(offset % STOP_CHECK_INTERVAL == 0) && stop_requested(vars))
+                        break;
                 }
             }
+
+            vars->stats.seconds[SM_PHASE_SCAN] += stats_clock() - scan_start;
+            /* the rest of the region couldn't be read */
+            if (nread < length || budget_reached || stop_requested(vars))
+                break;
         }
 
-        free(data);
-        vars->scan_progress += progress_per_dot;
+        free(buffer);
+        buffer = NULL;
+        progress += progress_per_dot;
+        update_progress(vars, progress);
+        report_partial(vars);
         /* stop scanning if asked to */
-        if (vars->stop_flag) break;
-        n = n->next;
+        if (stop_requested(vars)) break;
+        if (budget_reached) {
+            show_user("\n");
+            break;
+        }
         show_user("ok\n");
     }
 
+    if (budget_reached)
+        show_warn("the memory budget is reached, the search stopped early.\n");
+
+    sm_bytesearch_free(searcher);
+
     /* tell front-end we've finished */
-    vars->scan_progress = MAX_PROGRESS;
+    update_progress(vars, MAX_PROGRESS);
     
-    if (!(vars->matches = null_terminate(vars->matches, writing_swath_index)))
-    {
-        show_error("memory allocation error while reducing matches-array size\n");
+    if (!terminate_matches(vars, writing_swath_index))
         return false;
-    }
 
     show_info("we currently have %ld matches.\n", vars->num_matches);
 
     /* okay, detach */
-    return sm_detach(vars->target);
+    return sm_session_detach(vars);
 }
 
 /* Needs to support only ANYNUMBER types */
-bool sm_setaddr(pid_t target, char *addr, const value_t *to)
+static bool setaddr(sm_stats_t *stats, sm_peekbuf_t *pb, pid_t target, char *addr, const value_t *to)
 {
     unsigned int i;
     const mem64_t *memory_ptr;
     size_t memlength;
+    double start;
 
-    if (sm_attach(target) == false) {
+    stats->sets++;
+    if (pb == NULL || attach(stats, target) == false) {
         return false;
     }
+    pb->size = 0;
 
-    if (sm_peekdata(target, addr, sizeof(uint64_t), &memory_ptr, &memlength) == false) {
+    if (peekdata(stats, pb, target, addr, sizeof(uint64_t), &memory_ptr, &memlength) == false) {
         show_error("couldn't access the target address %10p\n", addr);
         return false;
     }
@@ -646,19 +1035,37 @@ bool sm_setaddr(pid_t target, char *addr, const value_t *to)
     }
 
     /* TODO: may use /proc/<pid>/mem here */
+    start = stats_clock();
     for (i = 0; i < sizeof(uint64_t)/sizeof(long); i++)
     {
+        stats->syscalls++;
         if (ptrace(PTRACE_POKEDATA, target, addr + i*sizeof(long), memarray[i]) == -1L) {
             return false;
         }
     }
+    stats->seconds[SM_PHASE_WRITE] += stats_clock() - start;
 
-    return sm_detach(target);
+    return detach(stats, target);
 }
 
-bool sm_read_array(pid_t target, const char *addr, char *buf, int len)
+bool sm_session_setaddr(globals_t *vars, char *addr, const value_t *to)
+{
+    if (vars->image) {
+        show_error("%s is read-only.\n", sm_image_path(vars->image));
+        return false;
+    }
+    return setaddr(&vars->stats, get_peekbuf(vars), vars->target, addr, to);
+}
+
+bool sm_setaddr(pid_t target, char *addr, const value_t *to)
 {
-    if (sm_attach(target) == false) {
+    return setaddr(&sm_globals.stats, get_peekbuf(&sm_globals), target, addr, to);
+}
+
+static bool read_array(sm_stats_t *stats, pid_t target, const char *addr, char *buf, int len)
+{
+    stats->reads++;
+    if (attach(stats, target) == false) {
         return false;
     }
 
@@ -666,7 +1073,7 @@ bool sm_read_array(pid_t target, const char *addr, char *buf, int len)
     unsigned nread=0;
     ssize_t tmpl;
     while (nread < len) {
-        if ((tmpl = readregion(target, buf+nread, len-nread, (unsigned long)(addr+nread))) == -1) {
+        if ((tmpl = readregion(stats, target, buf+nread, len-nread, (unsigned long)(addr+nread))) == -1) {
             /* no, continue with whatever data was read */
             break;
         } else {
@@ -677,40 +1084,284 @@ bool sm_read_array(pid_t target, const char *addr, char *buf, int len)
 
     if (nread < len)
     {
-        sm_detach(target);
+        detach(stats, target);
         return false;
     }
 
-    return sm_detach(target);
+    return detach(stats, target);
 #else
     int i;
+    double start = stats_clock();
     /* here we just read long by long, this should be ok for most of time */
     /* partial hit is not handled */
     for(i = 0; i < len; i += sizeof(long))
     {
         errno = 0;
+        stats->syscalls++;
         *((long *)(buf+i)) = ptrace(PTRACE_PEEKDATA, target, addr+i, NULL);
         if (UNLIKELY((*((long *)(buf+i)) == -1L) && (errno != 0))) {
-            sm_detach(target);
+            stats->seconds[SM_PHASE_READ] += stats_clock() - start;
+            detach(stats, target);
             return false;
         }
+        stats->bytes_read += sizeof(long);
     }
-    return sm_detach(target);
+    stats->seconds[SM_PHASE_READ] += stats_clock() - start;
+    return detach(stats, target);
 #endif
 }
 
-/* TODO: may use /proc/<pid>/mem here */
-bool sm_write_array(pid_t target, char *addr, const char *data, int len)
+bool sm_read_array(pid_t target, const char *addr, char *buf, int len)
 {
-    int i,j;
-    long peek_value;
+    return read_array(&sm_globals.stats, target, addr, buf, len);
+}
+
+/* copy up to `len` bytes at `addr` of an image, across adjacent segments,
+ * returns the number of bytes copied */
+static size_t read_image(const sm_image_t *image, const char *addr, char *buf, size_t len)
+{
+    size_t nread = 0, available;
+    const uint8_t *data;
+
+    while (nread < len && (data = sm_image_data(image, addr + nread, &available)) != NULL) {
+        available = MIN(available, len - nread);
+        memcpy(buf + nread, data, available);
+        nread += available;
+    }
+    return nread;
+}
+
+/* read up to `len` bytes of the attached target of a session, returns the
+ * number of bytes read */
+size_t sm_session_read(globals_t *vars, const char *addr, char *buf, size_t len)
+{
+    size_t nread = 0;
+
+    if (vars->image)
+        return read_image(vars->image, addr, buf, len);
+
+#if HAVE_PROCMEM
+    ssize_t tmpl;
+    while (nread < len) {
+        if ((tmpl = readregion(&vars->stats, vars->target, buf+nread, len-nread, (unsigned long)(addr+nread))) <= 0)
+            break;
+        nread += tmpl;
+    }
+#else
+    double start = stats_clock();
+    for (; nread + sizeof(long) <= len; nread += sizeof(long)) {
+        long ptraced_long;
+        errno = 0;
+        vars->stats.syscalls++;
+        ptraced_long = ptrace(PTRACE_PEEKDATA, vars->target, addr + nread, NULL);
+        if (UNLIKELY(ptraced_long == -1L && errno != 0))
+            break;
+        memcpy(buf + nread, &ptraced_long, sizeof(long));
+    }
+    vars->stats.bytes_read += nread;
+    vars->stats.seconds[SM_PHASE_READ] += stats_clock() - start;
+#endif
+    return nread;
+}
+
+bool sm_session_read_array(globals_t *vars, const char *addr, char *buf, int len)
+{
+    if (vars->image)
+        return read_image(vars->image, addr, buf, len) == (size_t) len;
+    return read_array(&vars->stats, vars->target, addr, buf, len);
+}
+
+/* fall back to reading the requests one by one, with only one open() of the mem file */
+static void read_multi_onebyone(sm_stats_t *stats, pid_t target, sm_read_request_t *requests, size_t count, char *buf)
+{
+    size_t i;
+#if HAVE_PROCMEM
+    char mem[32];
+    int fd;
+
+    snprintf(mem, sizeof(mem), "/proc/%d/mem", target);
+    stats->syscalls++;
+    if ((fd = open(mem, O_RDONLY)) == -1) {
+        show_error("unable to open %s.\n", mem);
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        size_t nread = 0;
+        ssize_t len;
+
+        while (nread < requests[i].len) {
+            stats->syscalls++;
+            len = pread(fd, buf + nread, requests[i].len - nread,
+                        (unsigned long)(requests[i].addr + nread));
+            if (len <= 0)
+                break;
+            nread += len;
+        }
+        requests[i].ok = (nread == requests[i].len);
+        buf += requests[i].len;
+    }
+
+    close(fd);
+    stats->syscalls++;
+#else
+    for (i = 0; i < count; i++) {
+        size_t nread;
+        long ptraced_long;
+
+        requests[i].ok = true;
+        for (nread = 0; nread < requests[i].len; nread += sizeof(long)) {
+            errno = 0;
+            stats->syscalls++;
+            ptraced_long = ptrace(PTRACE_PEEKDATA, target, requests[i].addr + nread, NULL);
+            if (UNLIKELY(ptraced_long == -1L && errno != 0)) {
+                requests[i].ok = false;
+                break;
+            }
+            memcpy(buf + nread, &ptraced_long, MIN(sizeof(long), requests[i].len - nread));
+        }
+        buf += requests[i].len;
+    }
+#endif
+}
+
+#if HAVE_PROCESS_VM_READV
+/* Max number of iovec's per process_vm_readv() call, the kernel refuses more */
+#define MAX_READ_IOVECS (1024)
+
+/* Read all the requests with vectored reads. Returns false if the syscall is
+ * not usable here at all, so that the caller can fall back to something else. */
+static bool read_multi_vectored(sm_stats_t *stats, pid_t target, sm_read_request_t *requests, size_t count, char *buf)
+{
+    struct iovec local[MAX_READ_IOVECS];
+    struct iovec remote[MAX_READ_IOVECS];
+    size_t first = 0;
+
+    while (first < count) {
+        size_t n, i;
+        char *batch_buf = buf;
+        ssize_t len;
+
+        /* prepare the next batch */
+        for (n = 0; n < MAX_READ_IOVECS && first + n < count; n++) {
+            local[n].iov_base = buf;
+            local[n].iov_len = requests[first + n].len;
+            remote[n].iov_base = (void *)requests[first + n].addr;
+            remote[n].iov_len = requests[first + n].len;
+            buf += requests[first + n].len;
+        }
+
+        stats->syscalls++;
+        len = process_vm_readv(target, local, n, remote, n, 0);
+        if (len == -1) {
+            if (errno == ENOSYS || errno == EPERM) {
+                /* nothing has been read yet, let the caller handle it */
+                if (first == 0)
+                    return false;
+                len = 0;
+            } else if (errno != EFAULT) {
+                show_error("process_vm_readv() failed, %s\n", strerror(errno));
+                len = 0;
+            } else {
+                /* the first remote iovec of the batch is not accessible */
+                len = 0;
+            }
+        }
+
+        /* mark what has been read: the read stops at the first failure */
+        for (i = 0; i < n && (size_t)len >= requests[first + i].len; i++) {
+            requests[first + i].ok = true;
+            len -= requests[first + i].len;
+            batch_buf += requests[first + i].len;
+        }
+        if (i < n) {
+            /* requests[first + i] failed: skip it and restart right after it */
+            batch_buf += requests[first + i].len;
+            buf = batch_buf;
+            i++;
+        }
+        first += i;
+    }
+
+    return true;
+}
+#endif
+
+/*
+ * sm_read_multi - read many small areas of the target memory in one go.
+ *
+ * The data of each request is stored consecutively into `buf`, which must be
+ * large enough for the sum of all the request lengths. The areas which can't
+ * be read are zeroed and get their `ok` flag cleared. This is meant for the
+ * periodic refresh of front-ends, so the target is only attached once and
+ * vectored reads are used when available.
+ */
+static bool read_multi(sm_stats_t *stats, pid_t target, sm_read_request_t *requests, size_t count, char *buf)
+{
+    size_t i, total_len = 0;
+    double start;
+
+    for (i = 0; i < count; i++) {
+        requests[i].ok = false;
+        total_len += requests[i].len;
+    }
+    memset(buf, 0x00, total_len);
+
+    if (count == 0)
+        return true;
 
-    if (sm_attach(target) == false) {
+    if (attach(stats, target) == false)
         return false;
+
+    start = stats_clock();
+#if HAVE_PROCESS_VM_READV
+    if (!read_multi_vectored(stats, target, requests, count, buf))
+#endif
+        read_multi_onebyone(stats, target, requests, count, buf);
+    stats->seconds[SM_PHASE_READ] += stats_clock() - start;
+
+    /* don't leave garbage in the unreadable areas */
+    for (i = 0; i < count; i++) {
+        if (!requests[i].ok)
+            memset(buf, 0x00, requests[i].len);
+        else
+            stats->bytes_read += requests[i].len;
+        buf += requests[i].len;
+    }
+
+    return detach(stats, target);
+}
+
+bool sm_read_multi(pid_t target, sm_read_request_t *requests, size_t count, char *buf)
+{
+    return read_multi(&sm_globals.stats, target, requests, count, buf);
+}
+
+bool sm_session_read_multi(globals_t *vars, sm_read_request_t *requests, size_t count, char *buf)
+{
+    size_t i;
+
+    if (vars->image == NULL)
+        return read_multi(&vars->stats, vars->target, requests, count, buf);
+
+    for (i = 0; i < count; i++) {
+        size_t nread = read_image(vars->image, requests[i].addr, buf, requests[i].len);
+        requests[i].ok = (nread == requests[i].len);
+        memset(buf + nread, 0x00, requests[i].len - nread);
+        buf += requests[i].len;
     }
+    return true;
+}
+
+/* TODO: may use /proc/<pid>/mem here */
+static bool poke_array(sm_stats_t *stats, pid_t target, char *addr, const char *data, int len)
+{
+    int i,j;
+    long peek_value;
 
     for (i = 0; i + sizeof(long) < len; i += sizeof(long))
     {
+        stats->syscalls++;
         if (ptrace(PTRACE_POKEDATA, target, addr + i, *(long *)(data + i)) == -1L) {
             return false;
         }
@@ -720,6 +1371,7 @@ bool sm_write_array(pid_t target, char *addr, const char *data, int len)
     {
         if (len > sizeof(long)) /* rewrite last sizeof(long) bytes of the buffer */
         {
+            stats->syscalls++;
             if (ptrace(PTRACE_POKEDATA, target, addr + len - sizeof(long), *(long *)(data + len - sizeof(long))) == -1L) {
                 return false;
             }
@@ -730,6 +1382,7 @@ bool sm_write_array(pid_t target, char *addr, const char *data, int len)
             for(j = 0; j <= sizeof(long) - (len - i); ++j)
             {
                 errno = 0;
+                stats->syscalls++;
                 if(((peek_value = ptrace(PTRACE_PEEKDATA, target, addr - j, NULL)) == -1L) && (errno != 0))
                 {
                     if (errno == EIO || errno == EFAULT) /* may try next shift */
@@ -745,6 +1398,7 @@ bool sm_write_array(pid_t target, char *addr, const char *data, int len)
                     /* write back */
                     memcpy(((int8_t*)&peek_value)+j, data+i, len-i);        
 
+                    stats->syscalls++;
                     if (ptrace(PTRACE_POKEDATA, target, addr - j, peek_value) == -1L)
                     {
                         show_error("%s failed.\n", __func__);
@@ -757,5 +1411,35 @@ bool sm_write_array(pid_t target, char *addr, const char *data, int len)
         }
     }
 
-    return sm_detach(target);
+    return true;
+}
+
+static bool write_array(sm_stats_t *stats, pid_t target, char *addr, const char *data, int len)
+{
+    double start;
+    bool ok;
+
+    if (attach(stats, target) == false) {
+        return false;
+    }
+    start = stats_clock();
+    ok = poke_array(stats, target, addr, data, len);
+    stats->seconds[SM_PHASE_WRITE] += stats_clock() - start;
+    if (!ok)
+        return false;
+    return detach(stats, target);
+}
+
+bool sm_write_array(pid_t target, char *addr, const char *data, int len)
+{
+    return write_array(&sm_globals.stats, target, addr, data, len);
+}
+
+bool sm_session_write_array(globals_t *vars, char *addr, const char *data, int len)
+{
+    if (vars->image) {
+        show_error("%s is read-only.\n", sm_image_path(vars->image));
+        return false;
+    }
+    return write_array(&vars->stats, vars->target, addr, data, len);
 }
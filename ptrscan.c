@@ -0,0 +1,1084 @@
+/*
+    Pointer map and pointer chain search.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/ptrace.h>
+
+#include "common.h"
+#include "getline.h"
+#include "image.h"
+#include "scanmem.h"
+#include "show_message.h"
+#include "ptrscan.h"
+
+/* regions are read in chunks of this size */
+#define READ_CHUNK_SIZE (1 << 20)
+
+/* a known region, in a table sorted by address */
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    const region_t *region;
+    const char *module;         /* ELF file name for exe and code regions */
+} region_range_t;
+
+typedef struct {
+    region_range_t *ranges;
+    size_t count;
+} region_table_t;
+
+static int cmp_ptrs(const void *a, const void *b)
+{
+    const sm_ptr_t *pa = a, *pb = b;
+
+    if (pa->value != pb->value)
+        return (pa->value > pb->value) ? 1 : -1;
+    return (pa->holder > pb->holder) - (pa->holder < pb->holder);
+}
+
+static int cmp_holders(const void *a, const void *b)
+{
+    const sm_ptr_t *pa = a, *pb = b;
+
+    return (pa->holder > pb->holder) - (pa->holder < pb->holder);
+}
+
+static unsigned num_threads(void)
+{
+#if HAVE_PROCMEM
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (n > 0) ? (unsigned) n : 1;
+#else
+    /* ptrace() requests have to come from the tracing thread */
+    return 1;
+#endif
+}
+
+static bool region_table_init(globals_t *vars, region_table_t *table)
+{
+    size_t i;
+
+    table->count = vars->regions->size;
+    if ((table->ranges = calloc(table->count + 1, sizeof(region_range_t))) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+
+    for (i = 0; i < table->count; i++) {
+        const region_t *r = &vars->regions->array[i];
+        table->ranges[i].start = (uintptr_t) r->start;
+        table->ranges[i].end = (uintptr_t) r->start + r->size;
+        table->ranges[i].region = r;
+        table->ranges[i].module = sm_regions_module(vars->regions, r);
+    }
+    return true;
+}
+
+static inline const region_range_t *region_table_find(const region_table_t *table, uintptr_t addr)
+{
+    size_t lo = 0, hi = table->count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (addr < table->ranges[mid].start)
+            hi = mid;
+        else if (addr >= table->ranges[mid].end)
+            lo = mid + 1;
+        else
+            return &table->ranges[mid];
+    }
+    return NULL;
+}
+
+/* index of the first pointer with a value not lower than `value` */
+static size_t ptrmap_lower_bound(const sm_ptrmap_t *map, uintptr_t value)
+{
+    size_t lo = 0, hi = map->count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (map->ptrs[mid].value < value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Reading pointers: every worker takes the next region that still has to
+ * be read, reads it chunk by chunk and keeps the aligned words with a value
+ * in [lowest, highest), and in a known region if `table` is set.
+ */
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    sm_ptr_t *ptrs;             /* sorted by holder */
+    size_t count;
+    size_t capacity;
+    bool done;                  /* already read */
+    bool failed;
+} region_ptrs_t;
+
+typedef struct {
+    pid_t target;
+    const sm_image_t *image;    /* read in place instead of the target */
+    region_ptrs_t *parts;
+    size_t count;
+    size_t next;                /* atomic */
+    uintptr_t lowest;
+    uintptr_t highest;
+    const region_table_t *table;
+} build_ctx_t;
+
+static bool add_ptr(region_ptrs_t *part, uintptr_t value, uintptr_t holder)
+{
+    if (part->count == part->capacity) {
+        size_t capacity = part->capacity ? part->capacity * 2 : 4096;
+        sm_ptr_t *ptrs = realloc(part->ptrs, capacity * sizeof(sm_ptr_t));
+        if (ptrs == NULL)
+            return false;
+        part->ptrs = ptrs;
+        part->capacity = capacity;
+    }
+    part->ptrs[part->count].value = value;
+    part->ptrs[part->count].holder = holder;
+    part->count++;
+    return true;
+}
+
+/* read up to `len` bytes at `addr`, returns the number of bytes read */
+static size_t read_chunk(int fd, pid_t pid, uintptr_t addr, char *buf, size_t len)
+{
+#if HAVE_PROCMEM
+    ssize_t n = pread(fd, buf, len, (off_t) addr);
+
+    (void) pid;
+    return (n > 0) ? (size_t) n : 0;
+#else
+    size_t nread;
+
+    (void) fd;
+    for (nread = 0; nread + sizeof(long) <= len; nread += sizeof(long)) {
+        long word;
+        errno = 0;
+        word = ptrace(PTRACE_PEEKDATA, pid, (void *) (addr + nread), NULL);
+        if (word == -1L && errno != 0)
+            break;
+        memcpy(buf + nread, &word, sizeof(long));
+    }
+    return nread;
+#endif
+}
+
+static void read_part(build_ctx_t *ctx, region_ptrs_t *part, int fd, char *buf)
+{
+    uintptr_t addr;
+
+    for (addr = part->start; addr < part->end; addr += READ_CHUNK_SIZE) {
+        size_t len = MIN(part->end - addr, (size_t) READ_CHUNK_SIZE);
+        const char *data = buf;
+        size_t nread, offset;
+
+        if (ctx->image) {
+            if ((data = (const char *) sm_image_data(ctx->image, (void *) addr, &nread)) == NULL)
+                nread = 0;
+            nread = MIN(nread, len);
+        } else {
+            nread = read_chunk(fd, ctx->target, addr, buf, len);
+        }
+
+        for (offset = 0; offset + sizeof(uintptr_t) <= nread; offset += sizeof(uintptr_t)) {
+            uintptr_t value;
+            memcpy(&value, data + offset, sizeof(value));
+            if (LIKELY(value < ctx->lowest || value >= ctx->highest))
+                continue;
+            if (ctx->table && region_table_find(ctx->table, value) == NULL)
+                continue;
+            if (!add_ptr(part, value, addr + offset)) {
+                part->failed = true;
+                return;
+            }
+        }
+        if (nread < len)
+            break;
+    }
+}
+
+static void *build_worker(void *arg)
+{
+    build_ctx_t *ctx = arg;
+    char *buf;
+    int fd = -1;
+    size_t i;
+
+    if ((buf = malloc(READ_CHUNK_SIZE)) == NULL)
+        return NULL;
+#if HAVE_PROCMEM
+    if (ctx->image == NULL) {
+        char mem[32];
+        snprintf(mem, sizeof(mem), "/proc/%d/mem", ctx->target);
+        if ((fd = open(mem, O_RDONLY)) == -1) {
+            free(buf);
+            return NULL;
+        }
+    }
+#endif
+
+    while ((i = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED)) < ctx->count) {
+        region_ptrs_t *part = &ctx->parts[i];
+
+        if (part->done)
+            continue;
+        read_part(ctx, part, fd, buf);
+        part->done = true;
+    }
+
+    if (fd != -1)
+        close(fd);
+    free(buf);
+    return NULL;
+}
+
+/* read the parts which aren't done yet, false on allocation failure */
+static bool build_parts(globals_t *vars, build_ctx_t *ctx)
+{
+    pthread_t *threads;
+    bool *started;
+    unsigned nthreads = num_threads(), i;
+    size_t todo = 0;
+    bool ok = true, all_started = true;
+
+    for (i = 0; i < ctx->count; i++)
+        todo += !ctx->parts[i].done;
+    if (todo == 0)
+        return true;
+    nthreads = MIN(nthreads, todo);
+
+    threads = calloc(nthreads, sizeof(pthread_t));
+    started = calloc(nthreads, sizeof(bool));
+    if (threads == NULL || started == NULL) {
+        free(threads);
+        free(started);
+        return false;
+    }
+
+    ctx->target = vars->target;
+    ctx->image = vars->image;
+    ctx->next = 0;
+    if (sm_session_attach(vars) == false) {
+        free(threads);
+        free(started);
+        return false;
+    }
+
+    if (nthreads > 1) {
+        for (i = 0; i < nthreads; i++) {
+            started[i] = (pthread_create(&threads[i], NULL, build_worker, ctx) == 0);
+            all_started = all_started && started[i];
+        }
+        for (i = 0; i < nthreads; i++) {
+            if (started[i])
+                pthread_join(threads[i], NULL);
+        }
+    }
+    /* single thread, or the remaining regions if threads couldn't start */
+    if (nthreads == 1 || !all_started)
+        build_worker(ctx);
+
+    sm_session_detach(vars);
+    free(threads);
+    free(started);
+
+    for (i = 0; i < ctx->count; i++)
+        ok = ok && ctx->parts[i].done && !ctx->parts[i].failed;
+    return ok;
+}
+
+static void free_parts(region_ptrs_t *parts, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        free(parts[i].ptrs);
+    free(parts);
+}
+
+static bool ptrmap_add_module(sm_ptrmap_t *map, const char *name, uintptr_t load_addr)
+{
+    sm_ptrmodule_t *modules;
+
+    modules = realloc(map->modules, (map->nmodules + 1) * sizeof(sm_ptrmodule_t));
+    if (modules == NULL)
+        return false;
+    map->modules = modules;
+    if ((modules[map->nmodules].name = strdup(name)) == NULL)
+        return false;
+    modules[map->nmodules].load_addr = load_addr;
+    map->nmodules++;
+    return true;
+}
+
+/* the first module of a name wins, if a file is loaded twice */
+static const sm_ptrmodule_t *ptrmap_find_module(const sm_ptrmap_t *map, const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < map->nmodules; i++) {
+        if (strcmp(map->modules[i].name, name) == 0)
+            return &map->modules[i];
+    }
+    return NULL;
+}
+
+static bool ptrmap_add_modules(sm_ptrmap_t *map, const region_table_t *table)
+{
+    size_t i;
+
+    for (i = 0; i < table->count; i++) {
+        const region_range_t *range = &table->ranges[i];
+
+        if (range->module == NULL || ptrmap_find_module(map, range->module))
+            continue;
+        if (!ptrmap_add_module(map, range->module, range->region->load_addr))
+            return false;
+    }
+    return true;
+}
+
+bool sm_ptrmap_build(globals_t *vars, sm_ptrmap_t *map)
+{
+    region_table_t table;
+    build_ctx_t ctx;
+    size_t total = 0, i;
+    bool ok;
+
+    memset(map, 0, sizeof(sm_ptrmap_t));
+
+    if (vars->regions == NULL || vars->regions->size == 0) {
+        show_error("no regions are known, see `help reset`.\n");
+        return false;
+    }
+    if (!region_table_init(vars, &table))
+        return false;
+    if (!ptrmap_add_modules(map, &table)) {
+        show_error("sorry, there was a memory allocation error.\n");
+        sm_ptrmap_free(map);
+        free(table.ranges);
+        return false;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.count = table.count;
+    ctx.lowest = table.ranges[0].start;
+    ctx.highest = table.ranges[table.count - 1].end;
+    ctx.table = &table;
+    if ((ctx.parts = calloc(ctx.count, sizeof(region_ptrs_t))) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        free(table.ranges);
+        return false;
+    }
+    for (i = 0; i < ctx.count; i++) {
+        ctx.parts[i].start = table.ranges[i].start;
+        ctx.parts[i].end = table.ranges[i].end;
+    }
+
+    ok = build_parts(vars, &ctx);
+    for (i = 0; i < ctx.count; i++)
+        total += ctx.parts[i].count;
+
+    /* gather the pointers of all regions */
+    if (ok && total > 0 && (map->ptrs = malloc(total * sizeof(sm_ptr_t))) == NULL)
+        ok = false;
+    for (i = 0; ok && i < ctx.count; i++) {
+        memcpy(map->ptrs + map->count, ctx.parts[i].ptrs, ctx.parts[i].count * sizeof(sm_ptr_t));
+        map->count += ctx.parts[i].count;
+    }
+    free_parts(ctx.parts, ctx.count);
+    free(table.ranges);
+
+    if (!ok) {
+        show_error("failed to build the pointer map.\n");
+        sm_ptrmap_free(map);
+        return false;
+    }
+
+    qsort(map->ptrs, map->count, sizeof(sm_ptr_t), cmp_ptrs);
+    return true;
+}
+
+void sm_ptrmap_free(sm_ptrmap_t *map)
+{
+    size_t i;
+
+    for (i = 0; i < map->nmodules; i++)
+        free(map->modules[i].name);
+    free(map->modules);
+    free(map->ptrs);
+    memset(map, 0, sizeof(sm_ptrmap_t));
+}
+
+/*
+ * The reverse index keeps the pointers of every region apart, so that only
+ * the regions which changed have to be read again. The pointers of all the
+ * regions are then gathered in one array sorted by value and partitioned on
+ * the high bits of the value, a query only has to search one or two buckets.
+ */
+#define INDEX_RADIX_BITS (16)
+#define INDEX_BUCKETS (1 << INDEX_RADIX_BITS)
+
+struct sm_ptrindex {
+    pid_t target;
+    const sm_image_t *image;
+    region_ptrs_t *parts;       /* sorted by start */
+    size_t nparts;
+    uintptr_t lowest;           /* values indexed: [lowest, highest) */
+    uintptr_t highest;
+    unsigned shift;             /* bucket of a value: (value - lowest) >> shift */
+    sm_ptr_t *ptrs;             /* sorted by value */
+    size_t count;
+    size_t buckets[INDEX_BUCKETS + 1]; /* bucket b: ptrs[buckets[b]] to ptrs[buckets[b + 1] - 1] */
+};
+
+static inline size_t index_bucket(const sm_ptrindex_t *index, uintptr_t value)
+{
+    return (value - index->lowest) >> index->shift;
+}
+
+/* gather the pointers of all parts and partition them */
+static bool index_merge(sm_ptrindex_t *index)
+{
+    size_t total = 0, i, b;
+    size_t *cursors;
+
+    for (i = 0; i < index->nparts; i++)
+        total += index->parts[i].count;
+
+    free(index->ptrs);
+    index->ptrs = NULL;
+    index->count = 0;
+    if (total > 0 && (index->ptrs = malloc(total * sizeof(sm_ptr_t))) == NULL)
+        return false;
+    if ((cursors = calloc(INDEX_BUCKETS, sizeof(size_t))) == NULL)
+        return false;
+
+    /* count, then scatter to the buckets */
+    memset(index->buckets, 0, sizeof(index->buckets));
+    for (i = 0; i < index->nparts; i++) {
+        const region_ptrs_t *part = &index->parts[i];
+        size_t j;
+        for (j = 0; j < part->count; j++)
+            index->buckets[index_bucket(index, part->ptrs[j].value) + 1]++;
+    }
+    for (b = 0; b < INDEX_BUCKETS; b++) {
+        index->buckets[b + 1] += index->buckets[b];
+        cursors[b] = index->buckets[b];
+    }
+    for (i = 0; i < index->nparts; i++) {
+        const region_ptrs_t *part = &index->parts[i];
+        size_t j;
+        for (j = 0; j < part->count; j++)
+            index->ptrs[cursors[index_bucket(index, part->ptrs[j].value)]++] = part->ptrs[j];
+    }
+    free(cursors);
+
+    for (b = 0; b < INDEX_BUCKETS; b++) {
+        size_t n = index->buckets[b + 1] - index->buckets[b];
+        if (n > 1)
+            qsort(index->ptrs + index->buckets[b], n, sizeof(sm_ptr_t), cmp_ptrs);
+    }
+    index->count = total;
+    return true;
+}
+
+void sm_ptrindex_free(globals_t *vars)
+{
+    sm_ptrindex_t *index = vars->ptrindex;
+
+    if (index == NULL)
+        return;
+    free_parts(index->parts, index->nparts);
+    free(index->ptrs);
+    free(index);
+    vars->ptrindex = NULL;
+}
+
+/* whether the regions of `table` are the ones indexed */
+static bool index_is_current(const sm_ptrindex_t *index, const region_table_t *table)
+{
+    size_t i;
+
+    if (index->nparts != table->count)
+        return false;
+    for (i = 0; i < table->count; i++) {
+        if (index->parts[i].start != table->ranges[i].start ||
+            index->parts[i].end != table->ranges[i].end)
+            return false;
+    }
+    return true;
+}
+
+bool sm_ptrindex_update(globals_t *vars, bool rebuild, size_t *nread)
+{
+    sm_ptrindex_t *old = vars->ptrindex, *index;
+    region_table_t table;
+    build_ctx_t ctx;
+    uintptr_t lowest, highest;
+    size_t i, j = 0;
+
+    *nread = 0;
+    if (vars->regions == NULL || vars->regions->size == 0) {
+        show_error("no regions are known, see `help reset`.\n");
+        return false;
+    }
+    if (!region_table_init(vars, &table))
+        return false;
+    lowest = table.ranges[0].start;
+    highest = table.ranges[table.count - 1].end;
+
+    /* the kept regions may miss pointers to a wider range of values */
+    if (old && (rebuild || old->target != vars->target || old->image != vars->image ||
+                lowest < old->lowest || highest > old->highest)) {
+        sm_ptrindex_free(vars);
+        old = NULL;
+    }
+    if (old && index_is_current(old, &table)) {
+        free(table.ranges);
+        return true;
+    }
+
+    if ((index = calloc(1, sizeof(sm_ptrindex_t))) == NULL ||
+        (index->parts = calloc(table.count, sizeof(region_ptrs_t))) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        free(index);
+        free(table.ranges);
+        return false;
+    }
+    index->target = vars->target;
+    index->image = vars->image;
+    index->nparts = table.count;
+    index->lowest = old ? old->lowest : lowest;
+    index->highest = old ? old->highest : highest;
+    while (((index->highest - index->lowest - 1) >> index->shift) >= INDEX_BUCKETS)
+        index->shift++;
+
+    /* keep the pointers of the regions that are still there */
+    for (i = 0; i < table.count; i++) {
+        region_ptrs_t *part = &index->parts[i];
+
+        part->start = table.ranges[i].start;
+        part->end = table.ranges[i].end;
+        while (old && j < old->nparts && old->parts[j].start < part->start)
+            j++;
+        if (old && j < old->nparts && old->parts[j].start == part->start &&
+            old->parts[j].end == part->end) {
+            *part = old->parts[j];
+            memset(&old->parts[j], 0, sizeof(region_ptrs_t));
+        } else {
+            (*nread)++;
+        }
+    }
+    free(table.ranges);
+    sm_ptrindex_free(vars);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.parts = index->parts;
+    ctx.count = index->nparts;
+    ctx.lowest = index->lowest;
+    ctx.highest = index->highest;
+
+    if (!build_parts(vars, &ctx) || !index_merge(index)) {
+        show_error("failed to build the pointer index.\n");
+        free_parts(index->parts, index->nparts);
+        free(index->ptrs);
+        free(index);
+        return false;
+    }
+    vars->ptrindex = index;
+    return true;
+}
+
+size_t sm_ptrindex_query(const globals_t *vars, uintptr_t start, uintptr_t end,
+                         const sm_ptr_t **ptrs)
+{
+    const sm_ptrindex_t *index = vars->ptrindex;
+    sm_ptrmap_t bucket;
+    size_t first, last, b;
+
+    *ptrs = NULL;
+    if (index == NULL || index->count == 0)
+        return 0;
+    start = MAX(start, index->lowest);
+    end = MIN(end, index->highest);
+    if (start >= end)
+        return 0;
+
+    b = index_bucket(index, start);
+    bucket.ptrs = index->ptrs + index->buckets[b];
+    bucket.count = index->buckets[b + 1] - index->buckets[b];
+    first = index->buckets[b] + ptrmap_lower_bound(&bucket, start);
+
+    b = index_bucket(index, end - 1);
+    bucket.ptrs = index->ptrs + index->buckets[b];
+    bucket.count = index->buckets[b + 1] - index->buckets[b];
+    last = index->buckets[b] + ptrmap_lower_bound(&bucket, end);
+
+    *ptrs = index->ptrs + first;
+    return last - first;
+}
+
+/*
+ * Searching chains: the pointers to (or just below) the target are
+ * distributed among the workers, each one follows them backwards with a
+ * depth-first search until a static address is reached.
+ */
+typedef struct {
+    globals_t *vars;
+    const sm_ptrmap_t *map;
+    const region_table_t *table;
+    uintptr_t target;
+    unsigned depth;
+    unsigned long maxoffset;
+    size_t first;               /* pointers to the target: [first, last) */
+    size_t last;
+    size_t next;                /* atomic */
+    unsigned long found;        /* atomic */
+    FILE *out;
+} search_ctx_t;
+
+typedef struct {
+    search_ctx_t *ctx;
+    pthread_t thread;
+    uintptr_t holders[MAX_POINTER_DEPTH];
+    unsigned long offsets[MAX_POINTER_DEPTH];
+} search_worker_t;
+
+/* print the chain of `len` pointers leading to the target */
+static void emit_chain(search_worker_t *w, const region_range_t *base, unsigned len)
+{
+    char line[64 + 20 * MAX_POINTER_DEPTH + 4 * 256];
+    int pos;
+    unsigned i;
+
+    /* the module is a single word, so that the offsets can be split on spaces */
+    pos = (int) MIN(sm_module_escape(base->module, line, sizeof(line)), sizeof(line) - 1);
+    pos += snprintf(line + pos, sizeof(line) - pos, "+0x%lx",
+                    (unsigned long) (w->holders[len - 1] - base->region->load_addr));
+    for (i = len; i > 0 && pos < (int) sizeof(line); i--)
+        pos += snprintf(line + pos, sizeof(line) - pos, " 0x%lx", w->offsets[i - 1]);
+    if (pos < (int) sizeof(line) - 1) {
+        line[pos++] = '\n';
+        line[pos] = '\0';
+    }
+    /* a single call, so that lines of different workers don't mix */
+    fputs(line, w->ctx->out);
+    __atomic_fetch_add(&w->ctx->found, 1, __ATOMIC_RELAXED);
+}
+
+/* `len` pointers are in the chain, the last one is stored at holders[len - 1] */
+static void search_from(search_worker_t *w, unsigned len)
+{
+    search_ctx_t *ctx = w->ctx;
+    uintptr_t holder = w->holders[len - 1];
+    const region_range_t *range = region_table_find(ctx->table, holder);
+    uintptr_t low;
+    size_t i;
+    unsigned j;
+
+    if (range && range->module) {
+        emit_chain(w, range, len);
+        return;
+    }
+    if (len >= ctx->depth || __atomic_load_n(&ctx->vars->stop_flag, __ATOMIC_RELAXED))
+        return;
+
+    low = (holder > ctx->maxoffset) ? holder - ctx->maxoffset : 0;
+    for (i = ptrmap_lower_bound(ctx->map, low);
+         i < ctx->map->count && ctx->map->ptrs[i].value <= holder; i++) {
+        const sm_ptr_t *p = &ctx->map->ptrs[i];
+
+        /* skip loops */
+        for (j = 0; j < len; j++) {
+            if (w->holders[j] == p->holder)
+                break;
+        }
+        if (j < len)
+            continue;
+
+        w->holders[len] = p->holder;
+        w->offsets[len] = holder - p->value;
+        search_from(w, len + 1);
+    }
+}
+
+static void *search_worker(void *arg)
+{
+    search_worker_t *w = arg;
+    search_ctx_t *ctx = w->ctx;
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED)) < ctx->last - ctx->first) {
+        const sm_ptr_t *p = &ctx->map->ptrs[ctx->first + i];
+
+        w->holders[0] = p->holder;
+        w->offsets[0] = ctx->target - p->value;
+        search_from(w, 1);
+    }
+    return NULL;
+}
+
+bool sm_pointerscan(globals_t *vars, const sm_ptrmap_t *map, uintptr_t target,
+                    unsigned depth, unsigned long maxoffset, FILE *out,
+                    unsigned long *found)
+{
+    region_table_t table;
+    search_ctx_t ctx;
+    search_worker_t *workers;
+    unsigned nthreads, i;
+    uintptr_t low = (target > maxoffset) ? target - maxoffset : 0;
+
+    *found = 0;
+    if (depth == 0 || depth > MAX_POINTER_DEPTH) {
+        show_error("the depth must be between 1 and %d.\n", MAX_POINTER_DEPTH);
+        return false;
+    }
+    if (!region_table_init(vars, &table))
+        return false;
+
+    ctx.vars = vars;
+    ctx.map = map;
+    ctx.table = &table;
+    ctx.target = target;
+    ctx.depth = depth;
+    ctx.maxoffset = maxoffset;
+    ctx.first = ptrmap_lower_bound(map, low);
+    ctx.last = ptrmap_lower_bound(map, target + 1);
+    ctx.next = 0;
+    ctx.found = 0;
+    ctx.out = out;
+
+    /* the search doesn't read the target, so it's always parallel */
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (n > 0) ? (unsigned) n : 1;
+    }
+    if ((workers = calloc(nthreads, sizeof(search_worker_t))) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        free(table.ranges);
+        return false;
+    }
+    for (i = 0; i < nthreads; i++) {
+        workers[i].ctx = &ctx;
+        if (pthread_create(&workers[i].thread, NULL, search_worker, &workers[i]) != 0)
+            workers[i].ctx = NULL;
+    }
+    for (i = 0; i < nthreads; i++) {
+        if (workers[i].ctx)
+            pthread_join(workers[i].thread, NULL);
+    }
+    /* in case no thread could be started */
+    if (ctx.next < ctx.last - ctx.first) {
+        workers[0].ctx = &ctx;
+        search_worker(&workers[0]);
+    }
+
+    free(workers);
+    free(table.ranges);
+    *found = ctx.found;
+    return true;
+}
+
+/*
+ * Map files: the magic, the version and the pointer size, then the modules
+ * and the pointers sorted by holder, all numbers as LEB128 varints. A holder
+ * is stored as the difference to the previous one, a value as the zigzag
+ * encoded difference to its holder, pointers to close data being common.
+ */
+#define PTRMAP_MAGIC "SMPTRMAP"
+#define PTRMAP_VERSION (1)
+
+static bool write_varint(FILE *f, uint64_t n)
+{
+    do {
+        int byte = n & 0x7f;
+        n >>= 7;
+        if (fputc(byte | (n ? 0x80 : 0), f) == EOF)
+            return false;
+    } while (n);
+    return true;
+}
+
+static bool read_varint(FILE *f, uint64_t *n)
+{
+    unsigned shift;
+    int byte;
+
+    *n = 0;
+    for (shift = 0; shift < 64; shift += 7) {
+        if ((byte = fgetc(f)) == EOF)
+            return false;
+        *n |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/* copy of the pointers of `map`, sorted by holder */
+static sm_ptr_t *ptrs_by_holder(const sm_ptrmap_t *map)
+{
+    sm_ptr_t *ptrs;
+
+    if ((ptrs = malloc(MAX(map->count, 1) * sizeof(sm_ptr_t))) == NULL)
+        return NULL;
+    memcpy(ptrs, map->ptrs, map->count * sizeof(sm_ptr_t));
+    qsort(ptrs, map->count, sizeof(sm_ptr_t), cmp_holders);
+    return ptrs;
+}
+
+bool sm_ptrmap_save(const sm_ptrmap_t *map, const char *filename)
+{
+    FILE *f;
+    sm_ptr_t *ptrs;
+    uint32_t header[2] = { PTRMAP_VERSION, sizeof(uintptr_t) };
+    uintptr_t prev = 0;
+    bool ok;
+    size_t i;
+
+    if ((ptrs = ptrs_by_holder(map)) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+    if ((f = fopen(filename, "wb")) == NULL) {
+        show_error("failed to open `%s`: %s.\n", filename, strerror(errno));
+        free(ptrs);
+        return false;
+    }
+
+    ok = fwrite(PTRMAP_MAGIC, 1, 8, f) == 8 &&
+         fwrite(header, sizeof(header), 1, f) == 1 &&
+         write_varint(f, map->nmodules);
+    for (i = 0; ok && i < map->nmodules; i++) {
+        size_t len = strlen(map->modules[i].name);
+        ok = write_varint(f, len) &&
+             fwrite(map->modules[i].name, 1, len, f) == len &&
+             write_varint(f, map->modules[i].load_addr);
+    }
+    ok = ok && write_varint(f, map->count);
+    for (i = 0; ok && i < map->count; i++) {
+        intptr_t delta = (intptr_t) (ptrs[i].value - ptrs[i].holder);
+        uint64_t zigzag = (delta < 0) ? ((uint64_t) ~delta << 1) | 1 : (uint64_t) delta << 1;
+
+        ok = write_varint(f, ptrs[i].holder - prev) && write_varint(f, zigzag);
+        prev = ptrs[i].holder;
+    }
+    free(ptrs);
+
+    if (fclose(f) != 0 || !ok) {
+        show_error("failed to write `%s`.\n", filename);
+        return false;
+    }
+    return true;
+}
+
+bool sm_ptrmap_load(sm_ptrmap_t *map, const char *filename)
+{
+    FILE *f;
+    char magic[8];
+    uint32_t header[2];
+    uint64_t nmodules, count, i;
+    uintptr_t holder = 0;
+    bool ok;
+
+    memset(map, 0, sizeof(sm_ptrmap_t));
+    if ((f = fopen(filename, "rb")) == NULL) {
+        show_error("failed to open `%s`: %s.\n", filename, strerror(errno));
+        return false;
+    }
+    if (fread(magic, 1, 8, f) != 8 || memcmp(magic, PTRMAP_MAGIC, 8) != 0 ||
+        fread(header, sizeof(header), 1, f) != 1 ||
+        header[0] != PTRMAP_VERSION || header[1] != sizeof(uintptr_t)) {
+        show_error("`%s` is not a pointer map of this version.\n", filename);
+        fclose(f);
+        return false;
+    }
+
+    ok = read_varint(f, &nmodules);
+    for (i = 0; ok && i < nmodules; i++) {
+        uint64_t len, load_addr;
+        char name[256];
+
+        ok = read_varint(f, &len) && len < sizeof(name) &&
+             fread(name, 1, len, f) == len &&
+             read_varint(f, &load_addr);
+        if (ok) {
+            name[len] = '\0';
+            ok = ptrmap_add_module(map, name, load_addr);
+        }
+    }
+    ok = ok && read_varint(f, &count) && count <= SIZE_MAX / sizeof(sm_ptr_t);
+    if (ok && count > 0 && (map->ptrs = malloc(count * sizeof(sm_ptr_t))) == NULL)
+        ok = false;
+    for (i = 0; ok && i < count; i++) {
+        uint64_t delta, zigzag;
+
+        if (!(ok = read_varint(f, &delta) && read_varint(f, &zigzag)))
+            break;
+        holder += delta;
+        map->ptrs[i].holder = holder;
+        map->ptrs[i].value = holder + (uintptr_t) ((zigzag & 1) ? ~(zigzag >> 1) : zigzag >> 1);
+        map->count++;
+    }
+    fclose(f);
+
+    if (!ok) {
+        show_error("failed to read `%s`.\n", filename);
+        sm_ptrmap_free(map);
+        return false;
+    }
+    qsort(map->ptrs, map->count, sizeof(sm_ptr_t), cmp_ptrs);
+    return true;
+}
+
+/* the value held at `holder`, false if it's not in the map */
+static bool lookup_holder(const sm_ptr_t *ptrs, size_t count, uintptr_t holder, uintptr_t *value)
+{
+    size_t lo = 0, hi = count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ptrs[mid].holder < holder) {
+            lo = mid + 1;
+        } else if (ptrs[mid].holder > holder) {
+            hi = mid;
+        } else {
+            *value = ptrs[mid].value;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* follow the chain of `line` through `ptrs`, false if it's malformed */
+static bool resolve_chain(const sm_ptrmap_t *map, const sm_ptr_t *ptrs, char *line, uintptr_t *addr)
+{
+    const sm_ptrmodule_t *module;
+    char *saveptr, *token, *plus, *endptr;
+    bool valid = true;
+
+    if ((token = strtok_r(line, " \t\n", &saveptr)) == NULL ||
+        (plus = strrchr(token, '+')) == NULL)
+        return false;
+    *plus = '\0';
+    *addr = (uintptr_t) strtoul(plus + 1, &endptr, 0);
+    if (*endptr != '\0' || !sm_module_unescape(token))
+        return false;
+
+    /* an unknown module can't lead anywhere */
+    if ((module = ptrmap_find_module(map, token)) == NULL)
+        valid = false;
+    else
+        *addr += module->load_addr;
+
+    while ((token = strtok_r(NULL, " \t\n", &saveptr)) != NULL) {
+        unsigned long offset = strtoul(token, &endptr, 0);
+        uintptr_t value;
+
+        if (*endptr != '\0')
+            return false;
+        if (valid && lookup_holder(ptrs, map->count, *addr, &value))
+            *addr = value + offset;
+        else
+            valid = false;
+    }
+    if (!valid)
+        *addr = 0;
+    return true;
+}
+
+bool sm_filterchains(const sm_ptrmap_t *map, uintptr_t target, FILE *in,
+                     FILE *out, unsigned long *kept, unsigned long *total)
+{
+    sm_ptr_t *ptrs;
+    char *line = NULL, *copy = NULL;
+    size_t len = 0, copylen = 0;
+    ssize_t n;
+    bool ok = true;
+
+    *kept = *total = 0;
+    if ((ptrs = ptrs_by_holder(map)) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+
+    while ((n = getline(&line, &len, in)) != -1) {
+        uintptr_t addr;
+
+        if (n == 0 || line[0] == '\n')
+            continue;
+        /* keep the line intact for the output */
+        if ((size_t) n + 1 > copylen) {
+            char *p = realloc(copy, n + 1);
+            if (p == NULL) {
+                show_error("sorry, there was a memory allocation error.\n");
+                ok = false;
+                break;
+            }
+            copy = p;
+            copylen = n + 1;
+        }
+        memcpy(copy, line, n + 1);
+
+        if (!resolve_chain(map, ptrs, copy, &addr)) {
+            show_error("bad pointer chain: %s", line);
+            ok = false;
+            break;
+        }
+        (*total)++;
+        if (addr == target && addr != 0) {
+            fputs(line, out);
+            if (line[n - 1] != '\n')
+                fputc('\n', out);
+            (*kept)++;
+        }
+    }
+
+    free(line);
+    free(copy);
+    free(ptrs);
+    return ok;
+}
@@ -0,0 +1,105 @@
+/*
+    Pointer map and pointer chain search.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PTRSCAN_H
+#define PTRSCAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "scanmem.h"
+
+/* maximum length of a pointer chain */
+#define MAX_POINTER_DEPTH (16)
+
+/* a pointer found in the target: the word at `holder` contains `value` */
+typedef struct {
+    uintptr_t value;
+    uintptr_t holder;
+} sm_ptr_t;
+
+/* an ELF file loaded by the target, the static base of pointer chains */
+typedef struct {
+    char *name;                 /* file name, without the directory */
+    uintptr_t load_addr;
+} sm_ptrmodule_t;
+
+/* all the pointers from known regions into known regions, sorted by value */
+typedef struct {
+    sm_ptr_t *ptrs;
+    size_t count;
+    sm_ptrmodule_t *modules;
+    size_t nmodules;
+} sm_ptrmap_t;
+
+/*
+ * Build the pointer map of the target of `vars`, using one thread per CPU.
+ * Only pointer-aligned words are considered.
+ */
+bool sm_ptrmap_build(globals_t *vars, sm_ptrmap_t *map);
+void sm_ptrmap_free(sm_ptrmap_t *map);
+
+/*
+ * Save a map to a file, to check chains against it once the target is gone.
+ * The pointers are stored sorted by holder and delta-encoded, along with the
+ * load address of every module, so that chains can be resolved from their
+ * module name and offset.
+ */
+bool sm_ptrmap_save(const sm_ptrmap_t *map, const char *filename);
+bool sm_ptrmap_load(sm_ptrmap_t *map, const char *filename);
+
+/*
+ * Write to `out` every chain of at most `depth` pointers that leads from a
+ * static address (in an exe or code region) to `target`, allowing an offset
+ * of up to `maxoffset` after each dereference. The search runs on all CPUs.
+ * `found` is set to the number of chains written.
+ */
+bool sm_pointerscan(globals_t *vars, const sm_ptrmap_t *map, uintptr_t target,
+                    unsigned depth, unsigned long maxoffset, FILE *out,
+                    unsigned long *found);
+
+/*
+ * Copy from `in` to `out` the chains, as written by sm_pointerscan(), which
+ * lead to `target` when followed through `map`, e.g. the map of the target
+ * after a restart. `total` is set to the number of chains read and `kept`
+ * to the number of chains written.
+ */
+bool sm_filterchains(const sm_ptrmap_t *map, uintptr_t target, FILE *in,
+                     FILE *out, unsigned long *kept, unsigned long *total);
+
+/*
+ * The reverse pointer index of a session: every aligned word of the known
+ * regions that may be a pointer, searchable by value. It's a snapshot, read
+ * again only for the regions that changed since the last update.
+ */
+
+/* Update the index of `vars` to its current regions, reading all the regions
+ * again if `rebuild` is set. `nread` is set to the number of regions read. */
+bool sm_ptrindex_update(globals_t *vars, bool rebuild, size_t *nread);
+void sm_ptrindex_free(globals_t *vars);
+
+/* Point `ptrs` to the pointers with a value in [start, end), sorted by value,
+ * and return their number. */
+size_t sm_ptrindex_query(const globals_t *vars, uintptr_t start, uintptr_t end,
+                         const sm_ptr_t **ptrs);
+
+#endif /* PTRSCAN_H */
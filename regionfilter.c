@@ -0,0 +1,423 @@
+/*
+    Expressions selecting the regions to scan.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The expression is parsed by recursive descent into a tree of nodes, kept
+ * in one array, which is then evaluated for each region:
+ *     expr   := and ('|' and)*
+ *     and    := unary ('&' unary)*
+ *     unary  := '!' unary | '(' expr ')' | term
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fnmatch.h>
+
+#include "regionfilter.h"
+#include "show_message.h"
+
+#define MAX_FILTER_NODES (256)
+
+typedef enum {
+    FILTER_OR,
+    FILTER_AND,
+    FILTER_NOT,                 /* of `left` */
+    FILTER_TYPE,                /* region of type `type` */
+    FILTER_ANON,                /* region without a file */
+    FILTER_PATH,                /* filename matching the glob `path` */
+    FILTER_PERM,                /* region with all the permissions in `perms` */
+    FILTER_SIZE,                /* size compared to `lo` with `cmp` */
+    FILTER_ADDR                 /* region overlapping [lo, hi) */
+} filter_op_t;
+
+typedef enum {
+    CMP_LT, CMP_LE, CMP_GT, CMP_GE, CMP_EQ
+} filter_cmp_t;
+
+enum {
+    PERM_READ = 1 << 0,
+    PERM_WRITE = 1 << 1,
+    PERM_EXEC = 1 << 2,
+    PERM_SHARED = 1 << 3,
+    PERM_PRIVATE = 1 << 4
+};
+
+typedef struct {
+    filter_op_t op;
+    int left, right;
+    region_type_t type;
+    char *path;
+    unsigned perms;
+    filter_cmp_t cmp;
+    unsigned long lo, hi;
+} filter_node_t;
+
+struct sm_region_filter {
+    filter_node_t nodes[MAX_FILTER_NODES];
+    int count;
+    int root;
+};
+
+typedef struct {
+    const char *p;
+    const char *error;
+    sm_region_filter_t *filter;
+} parser_t;
+
+static int parse_or(parser_t *ps);
+
+static void skip_spaces(parser_t *ps)
+{
+    while (isspace((unsigned char) *ps->p))
+        ps->p++;
+}
+
+static int new_node(parser_t *ps, filter_op_t op)
+{
+    sm_region_filter_t *f = ps->filter;
+
+    if (f->count == MAX_FILTER_NODES) {
+        ps->error = "too many terms";
+        return -1;
+    }
+    memset(&f->nodes[f->count], 0, sizeof(filter_node_t));
+    f->nodes[f->count].op = op;
+    f->nodes[f->count].left = f->nodes[f->count].right = -1;
+    return f->count++;
+}
+
+/* a word of the glob or of a value: up to a space, an operator or `)` */
+static size_t word_length(const char *p)
+{
+    return strcspn(p, " \t\n&|)");
+}
+
+/* a size, optionally followed by K, M, G or T */
+static bool parse_size(parser_t *ps, unsigned long *size)
+{
+    unsigned long value, scale = 1;
+    char *end;
+
+    if (!isdigit((unsigned char) *ps->p)) {
+        ps->error = "expected a size";
+        return false;
+    }
+    errno = 0;
+    value = strtoul(ps->p, &end, 0);
+    switch (toupper((unsigned char) *end)) {
+    case 'K': scale = 1UL << 10; end++; break;
+    case 'M': scale = 1UL << 20; end++; break;
+    case 'G': scale = 1UL << 30; end++; break;
+    case 'T': scale = 1UL << 40; end++; break;
+    }
+    if (errno == ERANGE || value > (unsigned long) -1 / scale) {
+        ps->error = "size too large";
+        return false;
+    }
+    *size = value * scale;
+    ps->p = end;
+    return true;
+}
+
+static bool parse_address(parser_t *ps, unsigned long *address)
+{
+    char *end;
+
+    if (!isxdigit((unsigned char) *ps->p)) {
+        ps->error = "expected a hexadecimal address";
+        return false;
+    }
+    errno = 0;
+    *address = strtoul(ps->p, &end, 16);
+    if (errno == ERANGE) {
+        ps->error = "address too large";
+        return false;
+    }
+    ps->p = end;
+    return true;
+}
+
+static int parse_term(parser_t *ps)
+{
+    const char *word = ps->p;
+    size_t length = 0;
+    int n;
+
+    while (isalpha((unsigned char) word[length]))
+        length++;
+
+    if (length == 4 && strncmp(word, "anon", 4) == 0) {
+        ps->p += length;
+        return new_node(ps, FILTER_ANON);
+    }
+
+    for (region_type_t type = REGION_TYPE_MISC; type <= REGION_TYPE_STACK; type++) {
+        if (strlen(region_type_names[type]) == length &&
+            strncmp(word, region_type_names[type], length) == 0) {
+            if ((n = new_node(ps, FILTER_TYPE)) >= 0)
+                ps->filter->nodes[n].type = type;
+            ps->p += length;
+            return n;
+        }
+    }
+
+    if (length == 4 && strncmp(word, "path", 4) == 0 && word[4] == '=') {
+        ps->p += 5;
+        length = word_length(ps->p);
+        if (length == 0) {
+            ps->error = "expected a glob";
+            return -1;
+        }
+        if ((n = new_node(ps, FILTER_PATH)) < 0)
+            return -1;
+        if ((ps->filter->nodes[n].path = strndup(ps->p, length)) == NULL) {
+            ps->error = "out of memory";
+            return -1;
+        }
+        ps->p += length;
+        return n;
+    }
+
+    if (length == 4 && strncmp(word, "perm", 4) == 0 && word[4] == '=') {
+        unsigned perms = 0;
+
+        ps->p += 5;
+        for (length = word_length(ps->p); length > 0; length--, ps->p++) {
+            switch (*ps->p) {
+            case 'r': perms |= PERM_READ; break;
+            case 'w': perms |= PERM_WRITE; break;
+            case 'x': perms |= PERM_EXEC; break;
+            case 's': perms |= PERM_SHARED; break;
+            case 'p': perms |= PERM_PRIVATE; break;
+            case '-': break;
+            default:
+                ps->error = "expected permissions among `rwxsp`";
+                return -1;
+            }
+        }
+        if ((n = new_node(ps, FILTER_PERM)) >= 0)
+            ps->filter->nodes[n].perms = perms;
+        return n;
+    }
+
+    if (length == 4 && strncmp(word, "size", 4) == 0) {
+        filter_cmp_t cmp;
+
+        ps->p += 4;
+        skip_spaces(ps);
+        if (ps->p[0] == '<' && ps->p[1] == '=') { cmp = CMP_LE; ps->p += 2; }
+        else if (ps->p[0] == '>' && ps->p[1] == '=') { cmp = CMP_GE; ps->p += 2; }
+        else if (ps->p[0] == '<') { cmp = CMP_LT; ps->p++; }
+        else if (ps->p[0] == '>') { cmp = CMP_GT; ps->p++; }
+        else if (ps->p[0] == '=') { cmp = CMP_EQ; ps->p++; }
+        else {
+            ps->error = "expected one of `<`, `<=`, `>`, `>=` or `=`";
+            return -1;
+        }
+        skip_spaces(ps);
+        if ((n = new_node(ps, FILTER_SIZE)) < 0)
+            return -1;
+        ps->filter->nodes[n].cmp = cmp;
+        if (!parse_size(ps, &ps->filter->nodes[n].lo))
+            return -1;
+        return n;
+    }
+
+    if (length == 4 && strncmp(word, "addr", 4) == 0 && word[4] == '=') {
+        filter_node_t *node;
+
+        ps->p += 5;
+        if ((n = new_node(ps, FILTER_ADDR)) < 0)
+            return -1;
+        node = &ps->filter->nodes[n];
+        if (!parse_address(ps, &node->lo))
+            return -1;
+        if (*ps->p == '-') {
+            ps->p++;
+            if (!parse_address(ps, &node->hi))
+                return -1;
+            if (node->hi <= node->lo) {
+                ps->error = "empty address range";
+                return -1;
+            }
+        } else {
+            /* the regions containing one address */
+            node->hi = node->lo + 1;
+        }
+        return n;
+    }
+
+    ps->error = "expected a region property";
+    return -1;
+}
+
+static int parse_unary(parser_t *ps)
+{
+    int n, operand;
+
+    skip_spaces(ps);
+    if (*ps->p == '!') {
+        ps->p++;
+        if ((operand = parse_unary(ps)) < 0 || (n = new_node(ps, FILTER_NOT)) < 0)
+            return -1;
+        ps->filter->nodes[n].left = operand;
+        return n;
+    }
+    if (*ps->p == '(') {
+        ps->p++;
+        if ((n = parse_or(ps)) < 0)
+            return -1;
+        skip_spaces(ps);
+        if (*ps->p != ')') {
+            ps->error = "expected `)`";
+            return -1;
+        }
+        ps->p++;
+        return n;
+    }
+    return parse_term(ps);
+}
+
+static int parse_binary(parser_t *ps, char symbol, filter_op_t op,
+                        int (*parse_operand)(parser_t *ps))
+{
+    int left, right, n;
+
+    if ((left = parse_operand(ps)) < 0)
+        return -1;
+    for (;;) {
+        skip_spaces(ps);
+        if (*ps->p != symbol)
+            return left;
+        ps->p++;
+        if ((right = parse_operand(ps)) < 0 || (n = new_node(ps, op)) < 0)
+            return -1;
+        ps->filter->nodes[n].left = left;
+        ps->filter->nodes[n].right = right;
+        left = n;
+    }
+}
+
+static int parse_and(parser_t *ps)
+{
+    return parse_binary(ps, '&', FILTER_AND, parse_unary);
+}
+
+static int parse_or(parser_t *ps)
+{
+    return parse_binary(ps, '|', FILTER_OR, parse_and);
+}
+
+sm_region_filter_t *sm_region_filter_compile(const char *expr)
+{
+    parser_t ps = { expr, NULL, NULL };
+
+    if ((ps.filter = calloc(1, sizeof(sm_region_filter_t))) == NULL) {
+        show_error("memory allocation for the region filter failed.\n");
+        return NULL;
+    }
+
+    ps.filter->root = parse_or(&ps);
+    skip_spaces(&ps);
+    if (ps.filter->root >= 0 && *ps.p != '\0')
+        ps.error = "unexpected character";
+    if (ps.error) {
+        show_error("%s at offset %ld of the region filter.\n", ps.error, (long) (ps.p - expr));
+        sm_region_filter_free(ps.filter);
+        return NULL;
+    }
+    return ps.filter;
+}
+
+void sm_region_filter_free(sm_region_filter_t *filter)
+{
+    if (filter == NULL)
+        return;
+    for (int n = 0; n < filter->count; n++)
+        free(filter->nodes[n].path);
+    free(filter);
+}
+
+sm_region_filter_t *sm_region_filter_copy(const sm_region_filter_t *filter)
+{
+    sm_region_filter_t *copy;
+
+    if (filter == NULL || (copy = malloc(sizeof(sm_region_filter_t))) == NULL)
+        return NULL;
+    *copy = *filter;
+    for (int n = 0; n < copy->count; n++) {
+        if (filter->nodes[n].path && (copy->nodes[n].path = strdup(filter->nodes[n].path)) == NULL) {
+            copy->count = n;
+            sm_region_filter_free(copy);
+            return NULL;
+        }
+    }
+    return copy;
+}
+
+static bool eval(const sm_region_filter_t *filter, int n, const region_t *region)
+{
+    const filter_node_t *node = &filter->nodes[n];
+    unsigned long start = (unsigned long) region->start;
+    unsigned perms;
+
+    switch (node->op) {
+    case FILTER_OR:
+        return eval(filter, node->left, region) || eval(filter, node->right, region);
+    case FILTER_AND:
+        return eval(filter, node->left, region) && eval(filter, node->right, region);
+    case FILTER_NOT:
+        return !eval(filter, node->left, region);
+    case FILTER_TYPE:
+        return region->type == node->type;
+    case FILTER_ANON:
+        return region->filename[0] == '\0';
+    case FILTER_PATH:
+        return fnmatch(node->path, region->filename, 0) == 0;
+    case FILTER_PERM:
+        perms = (region->flags.read ? PERM_READ : 0) |
+                (region->flags.write ? PERM_WRITE : 0) |
+                (region->flags.exec ? PERM_EXEC : 0) |
+                (region->flags.shared ? PERM_SHARED : 0) |
+                (region->flags.private ? PERM_PRIVATE : 0);
+        return (perms & node->perms) == node->perms;
+    case FILTER_SIZE:
+        switch (node->cmp) {
+        case CMP_LT: return region->size < node->lo;
+        case CMP_LE: return region->size <= node->lo;
+        case CMP_GT: return region->size > node->lo;
+        case CMP_GE: return region->size >= node->lo;
+        case CMP_EQ: return region->size == node->lo;
+        }
+        return false;
+    case FILTER_ADDR:
+        return start < node->hi && node->lo < start + region->size;
+    }
+    return false;
+}
+
+bool sm_region_filter_match(const sm_region_filter_t *filter, const region_t *region)
+{
+    return eval(filter, filter->root, region);
+}
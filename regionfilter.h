@@ -0,0 +1,50 @@
+/*
+    Expressions selecting the regions to scan.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REGIONFILTER_H
+#define REGIONFILTER_H
+
+#include <stdbool.h>
+
+#include "maps.h"
+
+/*
+ * Compile an expression of region properties combined with `!`, `&`, `|`
+ * and parentheses, e.g. `(heap|stack|anon) & size<1G & !path=*libnvidia*`.
+ * `!` binds tighter than `&`, which binds tighter than `|`.
+ * The properties are:
+ *     misc, code, exe, heap, stack   the type of the region
+ *     anon                           no associated file
+ *     path=<glob>                    the associated file matches the glob
+ *     perm=<rwxsp>                   all of these permissions
+ *     size<N, <=, >, >=, =           size in bytes, with a K, M, G or T suffix
+ *     addr=<start>[-<end>]           overlaps the hexadecimal address range
+ * Show an error and return NULL if the expression is invalid.
+ */
+sm_region_filter_t *sm_region_filter_compile(const char *expr);
+void sm_region_filter_free(sm_region_filter_t *filter);
+
+/* a copy of `filter`, NULL if it's NULL or on error */
+sm_region_filter_t *sm_region_filter_copy(const sm_region_filter_t *filter);
+
+bool sm_region_filter_match(const sm_region_filter_t *filter, const region_t *region);
+
+#endif /* REGIONFILTER_H */
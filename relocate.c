@@ -0,0 +1,410 @@
+/*
+    Matches relative to the modules of the target.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "getline.h"
+#include "relocate.h"
+#include "signatures.h"
+#include "show_message.h"
+
+#define RELOCSET_HEADER "# scanmem matches\n"
+
+/* the names of `option scan_data_type`, in the order of scan_data_type_t */
+static const char *scan_data_type_names[] = {
+    "number", "int", "float", "int8", "int16", "int32", "int64",
+    "float32", "float64", "bytearray", "string"
+};
+
+/* one byte of the relocated matches */
+typedef struct {
+    char *address;
+    uint8_t old_value;
+    match_flags match_info;
+} reloc_byte_t;
+
+void sm_relocset_free(sm_relocset_t *set)
+{
+    size_t i;
+
+    for (i = 0; i < set->nmodules; i++)
+        free(set->modules[i]);
+    free(set->modules);
+    free(set->relocs);
+    free(set->bytes);
+    memset(set, 0, sizeof(sm_relocset_t));
+}
+
+/* the index of the module `name`, added if it's new, or -1 on error */
+static long relocset_module(sm_relocset_t *set, const char *name)
+{
+    char **modules;
+    size_t i;
+
+    /* matches come by module, and there are few of them */
+    for (i = set->nmodules; i-- > 0; ) {
+        if (strcmp(set->modules[i], name) == 0)
+            return i;
+    }
+    if ((modules = realloc(set->modules, (set->nmodules + 1) * sizeof(char *))) == NULL)
+        return -1;
+    set->modules = modules;
+    if ((set->modules[set->nmodules] = strdup(name)) == NULL)
+        return -1;
+    return set->nmodules++;
+}
+
+static bool relocset_add(sm_relocset_t *set, size_t module, unsigned long offset,
+                         match_flags match_info, const uint8_t *old_value, uint16_t length)
+{
+    sm_reloc_t *reloc;
+
+    if (set->count == set->capacity) {
+        size_t capacity = set->capacity ? 2 * set->capacity : 256;
+        sm_reloc_t *relocs = realloc(set->relocs, capacity * sizeof(sm_reloc_t));
+        if (relocs == NULL)
+            return false;
+        set->relocs = relocs;
+        set->capacity = capacity;
+    }
+    if (set->nbytes + length > set->bytes_capacity) {
+        size_t capacity = set->bytes_capacity ? 2 * set->bytes_capacity : 1024;
+        uint8_t *bytes;
+
+        while (capacity < set->nbytes + length)
+            capacity *= 2;
+        if ((bytes = realloc(set->bytes, capacity)) == NULL)
+            return false;
+        set->bytes = bytes;
+        set->bytes_capacity = capacity;
+    }
+
+    reloc = &set->relocs[set->count++];
+    reloc->module = module;
+    reloc->offset = offset;
+    reloc->match_info = match_info;
+    reloc->length = length;
+    reloc->old_value = set->nbytes;
+    memcpy(&set->bytes[set->nbytes], old_value, length);
+    set->nbytes += length;
+    return true;
+}
+
+bool sm_relocset_build(const globals_t *vars, sm_relocset_t *set, unsigned long *skipped)
+{
+    const matches_and_old_values_swath *swath;
+    const region_t *region = NULL;
+    long module = -1;
+    uint8_t old_value[UINT16_MAX];
+
+    memset(set, 0, sizeof(sm_relocset_t));
+    set->scan_data_type = vars->options.scan_data_type;
+    *skipped = 0;
+
+    if (vars->matches == NULL || vars->regions == NULL)
+        return true;
+
+    for (swath = vars->matches->swaths; swath->first_byte_in_child;
+         swath = (const matches_and_old_values_swath *) &swath->data[swath->number_of_bytes]) {
+        for (size_t i = 0; i < swath->number_of_bytes; i++) {
+            match_flags flags = swath->data[i].match_info;
+            char *address = swath->first_byte_in_child + i;
+            size_t length;
+
+            if (flags == flags_empty)
+                continue;
+
+            /* matches are sorted, so they are often in the previous region */
+            if (region == NULL || address < region->start ||
+                address >= region->start + region->size) {
+                const char *name;
+
+                module = -1;
+                if ((region = sm_regions_find(vars->regions, address)) != NULL &&
+                    (name = sm_regions_module(vars->regions, region)) != NULL &&
+                    strcmp(name, "unassociated") != 0 &&
+                    (module = relocset_module(set, name)) < 0)
+                    goto fail;
+            }
+            if (module < 0) {
+                ++(*skipped);
+                continue;
+            }
+
+            /* the old value may overlap the next matches */
+            length = flags_to_memlength(set->scan_data_type, flags);
+            if (length > swath->number_of_bytes - i)
+                length = swath->number_of_bytes - i;
+            for (size_t j = 0; j < length; j++)
+                old_value[j] = swath->data[i + j].old_value;
+
+            if (!relocset_add(set, module, address - (char *) region->load_addr,
+                              flags, old_value, length))
+                goto fail;
+        }
+    }
+    return true;
+
+fail:
+    show_error("sorry, there was a memory allocation error.\n");
+    sm_relocset_free(set);
+    return false;
+}
+
+static int cmp_bytes(const void *a, const void *b)
+{
+    const reloc_byte_t *ba = a, *bb = b;
+
+    if (ba->address != bb->address)
+        return (ba->address > bb->address) ? 1 : -1;
+    /* the start of a match before the old value of another one */
+    return (ba->match_info < bb->match_info) - (ba->match_info > bb->match_info);
+}
+
+bool sm_relocset_apply(globals_t *vars, const sm_relocset_t *set, unsigned long *dropped)
+{
+    unsigned long *load_addrs = NULL;
+    reloc_byte_t *bytes = NULL;
+    size_t nbytes = 0, i, m;
+    const region_t *region = NULL;
+    matches_and_old_values_array *matches;
+    matches_and_old_values_swath *swath;
+
+    *dropped = 0;
+    free(vars->matches);
+    vars->matches = NULL;
+    vars->num_matches = 0;
+    sm_sigset_free(vars->signatures);
+    vars->signatures = NULL;
+
+    if ((load_addrs = calloc(set->nmodules + 1, sizeof(unsigned long))) == NULL ||
+        (bytes = calloc(set->nbytes + 1, sizeof(reloc_byte_t))) == NULL)
+        goto fail;
+
+    /* the load address of each module, 0 if it's not loaded */
+    for (i = 0; i < vars->regions->size; i++) {
+        const region_t *r = &vars->regions->array[i];
+        const char *name = sm_regions_module(vars->regions, r);
+
+        if (name == NULL)
+            continue;
+        for (m = 0; m < set->nmodules; m++) {
+            if (load_addrs[m] == 0 && strcmp(set->modules[m], name) == 0)
+                load_addrs[m] = r->load_addr;
+        }
+    }
+
+    for (i = 0; i < set->count; i++) {
+        const sm_reloc_t *reloc = &set->relocs[i];
+        char *address = (char *) load_addrs[reloc->module] + reloc->offset;
+
+        if (region == NULL || address < region->start ||
+            address >= region->start + region->size)
+            region = sm_regions_find(vars->regions, address);
+        if (load_addrs[reloc->module] == 0 || region == NULL) {
+            ++(*dropped);
+            continue;
+        }
+        for (size_t j = 0; j < reloc->length &&
+                           address + j < region->start + region->size; j++) {
+            bytes[nbytes].address = address + j;
+            bytes[nbytes].old_value = set->bytes[reloc->old_value + j];
+            bytes[nbytes].match_info = j ? flags_empty : reloc->match_info;
+            nbytes++;
+        }
+    }
+
+    /* the modules may have moved in a different order */
+    qsort(bytes, nbytes, sizeof(reloc_byte_t), cmp_bytes);
+
+    /* at most a swath per byte */
+    if ((matches = allocate_array(NULL, sizeof(matches_and_old_values_array) +
+                                  (nbytes + 1) * (sizeof(matches_and_old_values_swath) +
+                                                  sizeof(old_value_and_match_info)))) == NULL)
+        goto fail;
+    swath = matches->swaths;
+    swath->first_byte_in_child = NULL;
+    swath->number_of_bytes = 0;
+
+    for (i = 0; i < nbytes; i++) {
+        /* keep the first byte of each address */
+        if (i > 0 && bytes[i].address == bytes[i - 1].address)
+            continue;
+        swath = add_element(&matches, swath, bytes[i].address,
+                            bytes[i].old_value, bytes[i].match_info);
+        if (matches == NULL)
+            goto fail;
+        if (bytes[i].match_info != flags_empty)
+            ++vars->num_matches;
+    }
+    if ((vars->matches = null_terminate(matches, swath)) == NULL) {
+        vars->num_matches = 0;
+        goto fail;
+    }
+
+    free(bytes);
+    free(load_addrs);
+    return true;
+
+fail:
+    show_error("sorry, there was a memory allocation error.\n");
+    free(bytes);
+    free(load_addrs);
+    return false;
+}
+
+bool sm_relocset_save(const sm_relocset_t *set, const char *filename)
+{
+    FILE *f;
+    bool ok;
+    size_t i, j;
+
+    if ((f = fopen(filename, "w")) == NULL) {
+        show_error("failed to open `%s`: %s.\n", filename, strerror(errno));
+        return false;
+    }
+
+    ok = fprintf(f, RELOCSET_HEADER "scan_data_type %s\n",
+                 scan_data_type_names[set->scan_data_type]) > 0;
+    for (i = 0; ok && i < set->count; i++) {
+        const sm_reloc_t *reloc = &set->relocs[i];
+        char module[4 * 256];
+
+        /* the module is a single word, so that the fields can be split on spaces */
+        sm_module_escape(set->modules[reloc->module], module, sizeof(module));
+        ok = fprintf(f, "%s+0x%lx 0x%x ", module,
+                     reloc->offset, (unsigned) reloc->match_info) > 0;
+        for (j = 0; ok && j < reloc->length; j++)
+            ok = fprintf(f, "%02x", set->bytes[reloc->old_value + j]) > 0;
+        ok = ok && fputc('\n', f) != EOF;
+    }
+
+    if (fclose(f) != 0 || !ok) {
+        show_error("failed to write `%s`.\n", filename);
+        return false;
+    }
+    return true;
+}
+
+/* parse a line written by sm_relocset_save(), false if it's malformed */
+static bool parse_reloc(sm_relocset_t *set, char *line, bool *nomem)
+{
+    char *saveptr, *token, *name, *plus, *endptr;
+    unsigned long offset, flags;
+    uint8_t old_value[UINT16_MAX];
+    size_t length;
+    long module;
+
+    if ((token = strtok_r(line, " \t\n", &saveptr)) == NULL ||
+        (plus = strrchr(token, '+')) == NULL)
+        return false;
+    *plus = '\0';
+    name = token;
+    offset = strtoul(plus + 1, &endptr, 0);
+    if (*endptr != '\0' || name[0] == '\0' || !sm_module_unescape(name))
+        return false;
+
+    if ((token = strtok_r(NULL, " \t\n", &saveptr)) == NULL)
+        return false;
+    flags = strtoul(token, &endptr, 0);
+    if (*endptr != '\0' || flags == flags_empty || flags > flags_max)
+        return false;
+
+    if ((token = strtok_r(NULL, " \t\n", &saveptr)) == NULL ||
+        (length = strlen(token)) % 2 != 0 || length / 2 > UINT16_MAX)
+        return false;
+    for (size_t i = 0; i < length / 2; i++) {
+        char hex[3] = { token[2 * i], token[2 * i + 1], '\0' };
+
+        old_value[i] = (uint8_t) strtoul(hex, &endptr, 16);
+        if (*endptr != '\0')
+            return false;
+    }
+    if (strtok_r(NULL, " \t\n", &saveptr) != NULL)
+        return false;
+
+    if ((module = relocset_module(set, name)) < 0 ||
+        !relocset_add(set, module, offset, flags, old_value, length / 2)) {
+        *nomem = true;
+        return false;
+    }
+    return true;
+}
+
+bool sm_relocset_load(sm_relocset_t *set, const char *filename)
+{
+    FILE *f;
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t n;
+    bool ok = false, nomem = false;
+    unsigned long lineno = 2;
+
+    memset(set, 0, sizeof(sm_relocset_t));
+    if ((f = fopen(filename, "r")) == NULL) {
+        show_error("failed to open `%s`: %s.\n", filename, strerror(errno));
+        return false;
+    }
+
+    /* the header and the scan data type */
+    if (getline(&line, &len, f) != -1 && strcmp(line, RELOCSET_HEADER) == 0 &&
+        getline(&line, &len, f) != -1 && strncmp(line, "scan_data_type ", 15) == 0) {
+        line[strcspn(line, "\n")] = '\0';
+        for (size_t i = 0; i < sizeof(scan_data_type_names) / sizeof(char *); i++) {
+            if (strcmp(line + 15, scan_data_type_names[i]) == 0) {
+                set->scan_data_type = (scan_data_type_t) i;
+                ok = true;
+            }
+        }
+    }
+    if (!ok) {
+        show_error("`%s` is not a file of matches.\n", filename);
+        goto out;
+    }
+
+    while ((n = getline(&line, &len, f)) != -1) {
+        ++lineno;
+        if (n == 0 || line[0] == '\n' || line[0] == '#')
+            continue;
+        if (!parse_reloc(set, line, &nomem)) {
+            if (nomem)
+                show_error("sorry, there was a memory allocation error.\n");
+            else
+                show_error("bad match at line %lu of `%s`.\n", lineno, filename);
+            ok = false;
+            break;
+        }
+    }
+
+out:
+    free(line);
+    fclose(f);
+    if (!ok)
+        sm_relocset_free(set);
+    return ok;
+}
@@ -0,0 +1,75 @@
+/*
+    Matches relative to the modules of the target.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RELOCATE_H
+#define RELOCATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scanmem.h"
+
+/* a match at an offset from the load address of its module */
+typedef struct {
+    size_t module;              /* index in the modules of the set */
+    unsigned long offset;
+    match_flags match_info;
+    uint16_t length;            /* of the old value */
+    size_t old_value;           /* index of the old value in the bytes of the set */
+} sm_reloc_t;
+
+/* the matches of a session which don't depend on where the modules are */
+typedef struct {
+    scan_data_type_t scan_data_type;
+    sm_reloc_t *relocs;
+    size_t count;
+    size_t capacity;
+    char **modules;             /* file names, without the directory */
+    size_t nmodules;
+    uint8_t *bytes;             /* the old values */
+    size_t nbytes;
+    size_t bytes_capacity;
+} sm_relocset_t;
+
+/*
+ * Build the set of the matches of `vars` in exe and code regions. The
+ * number of other matches, which can't be relocated, is stored in `skipped`.
+ */
+bool sm_relocset_build(const globals_t *vars, sm_relocset_t *set, unsigned long *skipped);
+void sm_relocset_free(sm_relocset_t *set);
+
+/*
+ * Replace the matches of `vars` by those of `set`, at the load addresses of
+ * their modules in the regions of `vars`. The number of matches whose module
+ * or region is gone is stored in `dropped`.
+ */
+bool sm_relocset_apply(globals_t *vars, const sm_relocset_t *set, unsigned long *dropped);
+
+/*
+ * Save a set to a text file, with one match per line:
+ *     <module>+<offset> <flags> <old value bytes>
+ * as in the pointer chains, after a line with the scan data type.
+ */
+bool sm_relocset_save(const sm_relocset_t *set, const char *filename);
+bool sm_relocset_load(sm_relocset_t *set, const char *filename);
+
+#endif /* RELOCATE_H */
@@ -34,10 +34,16 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <string.h>
 
 #include "scanmem.h"
 #include "commands.h"
 #include "handlers.h"
+#include "image.h"
+#include "ptrscan.h"
+#include "regionfilter.h"
+#include "signatures.h"
 #include "show_message.h"
 
 
@@ -46,29 +52,43 @@ void sm_printversion(FILE *outfd)
     fprintf(outfd, "libscanmem version %s\n", PACKAGE_VERSION);
 }
 
-/* global settings */
-globals_t sm_globals = {
-    false,                      /* exit flag */
-    false,                      /* stop flag */
-    0,                          /* pid target */
-    NULL,                       /* matches */
-    0,                          /* match count */
-    0,                          /* scan progress */
-    NULL,                       /* regions */
-    NULL,                       /* commands */
-    NULL,                       /* current_cmdline */
-    sm_printversion,            /* printversion() pointer */
-    /* options */
-    {
-        1,                      /* alignment */
-        0,                      /* debug */
-        0,                      /* backend */
-        ANYINTEGER,             /* scan_data_type */
-        REGION_HEAP_STACK_EXECUTABLE_BSS, /* region_detail_level */ 
-        1,                      /* dump_with_ascii */
-        0,                      /* reverse_endianness */
-    }
-};
+/* initial state of every session */
+#define SESSION_DEFAULTS {                                                    \
+    false,                      /* exit flag */                               \
+    false,                      /* stop flag */                               \
+    0,                          /* pid target */                              \
+    NULL,                       /* image */                                   \
+    NULL,                       /* matches */                                 \
+    0,                          /* match count */                             \
+    0,                          /* scan progress */                           \
+    NULL,                       /* callbacks */                               \
+    NULL,                       /* scan routine */                            \
+    NULL,                       /* peek buffer */                             \
+    NULL,                       /* pointer index */                           \
+    NULL,                       /* signatures */                              \
+    NULL,                       /* regions */                                 \
+    NULL,                       /* commands */                                \
+    NULL,                       /* current_cmdline */                         \
+    sm_printversion,            /* printversion() pointer */                  \
+    /* options */                                                             \
+    {                                                                         \
+        1,                      /* alignment */                               \
+        0,                      /* debug */                                   \
+        0,                      /* backend */                                 \
+        ANYINTEGER,             /* scan_data_type */                          \
+        REGION_HEAP_STACK_EXECUTABLE_BSS, /* region_detail_level */           \
+        NULL,                   /* region_filter */                           \
+        1,                      /* dump_with_ascii */                         \
+        0,                      /* reverse_endianness */                      \
+        -1,                     /* float_display_digits */                    \
+        ENCODING_UTF8,          /* string_encoding */                         \
+        0,                      /* string_ignore_case */                      \
+        0,                      /* memory_budget */                           \
+    }                                                                         \
+}
+
+/* the default session */
+globals_t sm_globals = SESSION_DEFAULTS;
 
 /* signal handler - use async-signal safe functions ONLY! */
 static void sighandler(int n)
@@ -135,8 +155,22 @@ bool sm_init(void)
                        DELETE_LONGDOC);
     sm_registercommand("reset", handler__reset, vars->commands, RESET_SHRTDOC,
                        RESET_LONGDOC);
+    sm_registercommand("refresh", handler__refresh, vars->commands, REFRESH_SHRTDOC,
+                       REFRESH_LONGDOC);
     sm_registercommand("pid", handler__pid, vars->commands, PID_SHRTDOC,
                        PID_LONGDOC);
+    sm_registercommand("retarget", handler__retarget, vars->commands, RETARGET_SHRTDOC,
+                       RETARGET_LONGDOC);
+    sm_registercommand("open", handler__open, vars->commands, OPEN_SHRTDOC,
+                       OPEN_LONGDOC);
+    sm_registercommand("saveimage", handler__saveimage, vars->commands,
+                       SAVEIMAGE_SHRTDOC, SAVEIMAGE_LONGDOC);
+    sm_registercommand("diff", handler__diff, vars->commands, DIFF_SHRTDOC,
+                       DIFF_LONGDOC);
+    sm_registercommand("savematches", handler__savematches, vars->commands,
+                       SAVEMATCHES_SHRTDOC, SAVEMATCHES_LONGDOC);
+    sm_registercommand("loadmatches", handler__loadmatches, vars->commands,
+                       LOADMATCHES_SHRTDOC, LOADMATCHES_LONGDOC);
     sm_registercommand("snapshot", handler__snapshot, vars->commands,
                        SNAPSHOT_SHRTDOC, SNAPSHOT_LONGDOC);
     sm_registercommand("dregion", handler__dregion, vars->commands,
@@ -147,6 +181,8 @@ bool sm_init(void)
                        LREGIONS_SHRTDOC, LREGIONS_LONGDOC);
     sm_registercommand("version", handler__version, vars->commands,
                        VERSION_SHRTDOC, VERSION_LONGDOC);
+    sm_registercommand("stats", handler__stats, vars->commands,
+                       STATS_SHRTDOC, STATS_LONGDOC);
     sm_registercommand("=", handler__operators, vars->commands, NOTCHANGED_SHRTDOC,
                        NOTCHANGED_LONGDOC);
     sm_registercommand("!=", handler__operators, vars->commands, CHANGED_SHRTDOC,
@@ -159,8 +195,14 @@ bool sm_init(void)
                        INCREASED_LONGDOC);
     sm_registercommand("-", handler__operators, vars->commands, DECREASED_SHRTDOC,
                        DECREASED_LONGDOC);
+    sm_registercommand("group", handler__group, vars->commands, GROUP_SHRTDOC,
+                       GROUP_LONGDOC);
     sm_registercommand("\"", handler__string, vars->commands, STRING_SHRTDOC,
                        STRING_LONGDOC);
+    sm_registercommand("regex", handler__regex, vars->commands, REGEX_SHRTDOC,
+                       REGEX_LONGDOC);
+    sm_registercommand("signatures", handler__signatures, vars->commands,
+                       SIGNATURES_SHRTDOC, SIGNATURES_LONGDOC);
     sm_registercommand("update", handler__update, vars->commands, UPDATE_SHRTDOC,
                        UPDATE_LONGDOC);
     sm_registercommand("exit", handler__exit, vars->commands, EXIT_SHRTDOC,
@@ -175,6 +217,15 @@ bool sm_init(void)
                     WATCH_LONGDOC);
     sm_registercommand("show", handler__show, vars->commands, SHOW_SHRTDOC, SHOW_LONGDOC);
     sm_registercommand("dump", handler__dump, vars->commands, DUMP_SHRTDOC, DUMP_LONGDOC);
+    sm_registercommand("mdump", handler__mdump, vars->commands, MDUMP_SHRTDOC, MDUMP_LONGDOC);
+    sm_registercommand("pointerscan", handler__pointerscan, vars->commands,
+                       POINTERSCAN_SHRTDOC, POINTERSCAN_LONGDOC);
+    sm_registercommand("pointers_to", handler__pointers_to, vars->commands,
+                       POINTERS_TO_SHRTDOC, POINTERS_TO_LONGDOC);
+    sm_registercommand("savepointermap", handler__savepointermap, vars->commands,
+                       SAVEPOINTERMAP_SHRTDOC, SAVEPOINTERMAP_LONGDOC);
+    sm_registercommand("filterchains", handler__filterchains, vars->commands,
+                       FILTERCHAINS_SHRTDOC, FILTERCHAINS_LONGDOC);
     sm_registercommand("write", handler__write, vars->commands, WRITE_SHRTDOC, WRITE_LONGDOC);
     sm_registercommand("option", handler__option, vars->commands, OPTION_SHRTDOC, OPTION_LONGDOC);
 
@@ -188,36 +239,222 @@ bool sm_init(void)
     return true;
 }
 
+/* free the regions and matches of `vars`, e.g. a saved copy of sm_globals */
+void sm_free_scan_state(globals_t *vars)
+{
+    sm_regions_free(vars->regions);
+    vars->regions = NULL;
+
+    /* free matches array */
+    free(vars->matches);
+    vars->matches = NULL;
+    vars->num_matches = 0;
+
+    sm_sigset_free(vars->signatures);
+    vars->signatures = NULL;
+}
+
 void sm_cleanup(void)
 {
     /* free any allocated memory used */
-    l_destroy(sm_globals.regions);
+    sm_free_scan_state(&sm_globals);
+    sm_free_peekbuf(&sm_globals);
+    sm_ptrindex_free(&sm_globals);
+    sm_region_filter_free(sm_globals.options.region_filter);
+    sm_image_close(sm_globals.image);
     l_destroy(sm_globals.commands);
 
-    /* free matches array */
-    if (sm_globals.matches)
-        free(sm_globals.matches);
-
     /* attempt to detach just in case */
     sm_detach(sm_globals.target);
 }
 
+globals_t *sm_session_new(void)
+{
+    static const globals_t defaults = SESSION_DEFAULTS;
+    globals_t *vars;
+
+    if (sm_globals.commands == NULL) {
+        show_error("sm_init() has to be called before creating sessions.\n");
+        return NULL;
+    }
+    if ((vars = malloc(sizeof(globals_t))) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return NULL;
+    }
+    *vars = defaults;
+    vars->commands = sm_globals.commands;
+    vars->options.backend = sm_globals.options.backend;
+    vars->options.debug = sm_globals.options.debug;
+    return vars;
+}
+
+void sm_session_free(globals_t *vars)
+{
+    if (vars == NULL || vars == &sm_globals)
+        return;
+    sm_free_scan_state(vars);
+    sm_free_peekbuf(vars);
+    sm_ptrindex_free(vars);
+    sm_region_filter_free(vars->options.region_filter);
+    sm_image_close(vars->image);
+    free(vars);
+}
+
+bool sm_session_exec_cmd(globals_t *vars, const char *commandline)
+{
+    bool ret;
+
+    sm_session_set_stop_flag(vars, false);
+    ret = sm_execcommand(vars, commandline);
+    fflush(stdout);
+    fflush(stderr);
+    return ret;
+}
+
+unsigned long sm_session_get_num_matches(const globals_t *vars)
+{
+    return vars->num_matches;
+}
+
+const sm_stats_t *sm_session_get_stats(const globals_t *vars)
+{
+    return &vars->stats;
+}
+
+double sm_session_get_scan_progress(const globals_t *vars)
+{
+    double progress;
+
+    __atomic_load(&vars->scan_progress, &progress, __ATOMIC_RELAXED);
+    return progress;
+}
+
+void sm_session_set_stop_flag(globals_t *vars, bool stop_flag)
+{
+    __atomic_store_n(&vars->stop_flag, stop_flag, __ATOMIC_RELAXED);
+}
+
 /* for front-ends */
 void sm_set_backend(void)
 {
     sm_globals.options.backend = 1;
 }
 
+/* a command running in its own thread, see sm_exec_cmd_async() */
+struct sm_async_cmd {
+    pthread_t thread;
+    char *commandline;
+    sm_scan_callbacks_t callbacks;
+    bool result;
+    bool done;                  /* atomic */
+};
+
+/* set while an asynchronous command owns sm_globals */
+static bool async_running = false;
+
 void sm_backend_exec_cmd(const char *commandline)
 {
-    sm_execcommand(&sm_globals, commandline);
+    if (__atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+        show_error("a command is already running in the background.\n");
+        return;
+    }
+    sm_session_exec_cmd(&sm_globals, commandline);
+}
+
+static void *async_cmd_thread(void *arg)
+{
+    sm_async_cmd_t *cmd = arg;
+    globals_t *vars = &sm_globals;
+
+    vars->callbacks = &cmd->callbacks;
+    cmd->result = sm_execcommand(vars, cmd->commandline);
+    vars->callbacks = NULL;
     fflush(stdout);
     fflush(stderr);
+
+    __atomic_store_n(&cmd->done, true, __ATOMIC_RELEASE);
+    if (cmd->callbacks.done)
+        cmd->callbacks.done(cmd->result, vars->num_matches,
+                            cmd->callbacks.user_data);
+    return NULL;
+}
+
+/*
+ * Execute a command in a new thread and return immediately. The callbacks
+ * (any of them may be NULL) are called from that thread, so a GUI has to
+ * forward them to its main loop. Until sm_async_wait() is called, no other
+ * command may be run; sm_backend_exec_cmd() refuses to. Returns NULL if
+ * the thread can't be started or another command is still running.
+ */
+sm_async_cmd_t *sm_exec_cmd_async(const char *commandline,
+                                  const sm_scan_callbacks_t *callbacks)
+{
+    sm_async_cmd_t *cmd;
+    bool expected = false;
+
+    if (!__atomic_compare_exchange_n(&async_running, &expected, true, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        show_error("a command is already running in the background.\n");
+        return NULL;
+    }
+
+    if ((cmd = calloc(1, sizeof(sm_async_cmd_t))) == NULL ||
+        (cmd->commandline = strdup(commandline)) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        goto error;
+    }
+    if (callbacks)
+        cmd->callbacks = *callbacks;
+
+    /* reset before the thread starts, so an early cancel is not lost */
+    sm_set_stop_flag(false);
+    if (pthread_create(&cmd->thread, NULL, async_cmd_thread, cmd) != 0) {
+        show_error("failed to start the command thread.\n");
+        goto error;
+    }
+    return cmd;
+
+error:
+    if (cmd)
+        free(cmd->commandline);
+    free(cmd);
+    __atomic_store_n(&async_running, false, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* ask a running command to stop, scans keep the matches found so far */
+void sm_async_cancel(sm_async_cmd_t *cmd)
+{
+    (void) cmd;
+    sm_set_stop_flag(true);
+}
+
+bool sm_async_is_done(const sm_async_cmd_t *cmd)
+{
+    return __atomic_load_n(&cmd->done, __ATOMIC_ACQUIRE);
+}
+
+/* wait for the command to finish, free the handle and return its result */
+bool sm_async_wait(sm_async_cmd_t *cmd)
+{
+    bool result;
+
+    pthread_join(cmd->thread, NULL);
+    result = cmd->result;
+    free(cmd->commandline);
+    free(cmd);
+    __atomic_store_n(&async_running, false, __ATOMIC_RELEASE);
+    return result;
 }
 
 unsigned long sm_get_num_matches(void)
 {
-    return sm_globals.num_matches;
+    return sm_session_get_num_matches(&sm_globals);
+}
+
+const sm_stats_t *sm_get_stats(void)
+{
+    return sm_session_get_stats(&sm_globals);
 }
 
 const char *sm_get_version(void)
@@ -227,10 +464,17 @@ const char *sm_get_version(void)
 
 double sm_get_scan_progress(void)
 {
-    return sm_globals.scan_progress;
+    return sm_session_get_scan_progress(&sm_globals);
+}
+
+void sm_reset_scan_progress(void)
+{
+    double progress = 0.0;
+
+    __atomic_store(&sm_globals.scan_progress, &progress, __ATOMIC_RELAXED);
 }
 
 void sm_set_stop_flag(bool stop_flag)
 {
-    sm_globals.stop_flag = stop_flag;
+    sm_session_set_stop_flag(&sm_globals, stop_flag);
 }
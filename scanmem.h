@@ -37,16 +37,69 @@
 #include "targetmem.h"
 
 
-/* global settings */
+/* callbacks for sm_exec_cmd_async(), called from the scan thread */
+typedef struct {
+    void (*progress)(double progress, void *user_data);         /* 0.0 to 1.0 */
+    void (*partial)(unsigned long num_matches, void *user_data); /* matches so far */
+    void (*done)(bool success, unsigned long num_matches, void *user_data);
+    void *user_data;
+} sm_scan_callbacks_t;
+
+/* handle of a command running in the background */
+typedef struct sm_async_cmd sm_async_cmd_t;
+
+/* cache of target memory used by sm_peekdata() */
+typedef struct sm_peekbuf sm_peekbuf_t;
+
+/* reverse pointer index used by `pointers_to` */
+typedef struct sm_ptrindex sm_ptrindex_t;
+
+/* the phases timed in sm_stats_t */
+typedef enum {
+    SM_PHASE_ATTACH,            /* ptrace attach and waitpid() for the stop */
+    SM_PHASE_READ,              /* reading the target, cache misses of the peek buffer */
+    SM_PHASE_SCAN,              /* the scan routine and the storing of the matches */
+    SM_PHASE_WRITE,             /* writing the target */
+    SM_PHASE_DETACH,
+    SM_PHASES
+} sm_phase_t;
+
+/* counters of a session since it started or since `stats reset`, kept by
+ * sm_searchregions(), sm_checkmatches(), sm_setaddr(), sm_read_array() and
+ * the other functions accessing the target */
+typedef struct {
+    double seconds[SM_PHASES];  /* indexed by sm_phase_t */
+    unsigned long searches;     /* sm_searchregions() calls */
+    unsigned long checks;       /* sm_checkmatches() calls */
+    unsigned long sets;         /* sm_setaddr() calls */
+    unsigned long reads;        /* sm_read_array() calls */
+    unsigned long attaches;
+    unsigned long syscalls;     /* ptrace(), waitpid(), open(), pread()... */
+    unsigned long long bytes_read;
+    unsigned long reallocs;     /* of the matches array */
+    unsigned long peek_hits;    /* of the peek buffer */
+    unsigned long peek_misses;  /* partial hits included */
+    size_t matches_peak;        /* largest size of the matches array, in bytes */
+    size_t buffer_peak;         /* largest buffer a region was read into */
+} sm_stats_t;
+
+/* a session: everything needed to scan one target. Sessions are
+ * independent, different threads may use different sessions. */
 typedef struct {
     bool exit;
-    bool stop_flag;
+    bool stop_flag;                /* atomic, may be set from another thread */
     pid_t target;
+    sm_image_t *image;             /* replaces the target if set */
     matches_and_old_values_array *matches;
     unsigned long num_matches;
-    double scan_progress;
-    list_t *regions;
-    list_t *commands;              /* command handlers */
+    double scan_progress;          /* atomic, may be read from another thread */
+    const sm_scan_callbacks_t *callbacks; /* set while running asynchronously */
+    scan_routine_t scan_routine;   /* chosen for the last scan */
+    sm_peekbuf_t *peekbuf;         /* allocated on first use */
+    sm_ptrindex_t *ptrindex;       /* built on first use */
+    sm_sigset_t *signatures;       /* of the last `signatures` scan, to name matches */
+    regions_t *regions;
+    list_t *commands;              /* command handlers, shared by all sessions */
     const char *current_cmdline;   /* the command being executed */
     void (*printversion)(FILE *outfd);
     struct {
@@ -58,35 +111,81 @@ typedef struct {
         /* options that can be changed during runtime */
         scan_data_type_t scan_data_type;
         region_scan_level_t region_scan_level;
+        sm_region_filter_t *region_filter; /* replaces region_scan_level if set */
         unsigned short dump_with_ascii;
         unsigned short reverse_endianness;
+        short float_display_digits;   /* for `~v`, -1 to count those written */
+        string_encoding_t string_encoding;
+        unsigned short string_ignore_case;
+        size_t memory_budget;      /* bytes for the matches and the scan buffer,
+                                      0 for no limit */
     } options;
+    sm_stats_t stats;
 } globals_t;
 
-/* global settings */
+/* the default session, used by the functions without a session argument */
 extern globals_t sm_globals;
 
+/* one area to read with sm_read_multi() */
+typedef struct {
+    const char *addr;           /* address in the target */
+    size_t len;                 /* number of bytes to read */
+    bool ok;                    /* set if all the `len` bytes could be read */
+} sm_read_request_t;
+
 bool sm_init(void);
 void sm_cleanup(void);
+void sm_free_scan_state(globals_t *vars);
 void sm_printversion(FILE *outfd);
 void sm_set_backend(void);
 void sm_backend_exec_cmd(const char *commandline);
 unsigned long sm_get_num_matches(void);
+const sm_stats_t *sm_get_stats(void);
 const char *sm_get_version(void);
 double sm_get_scan_progress(void);
 void sm_reset_scan_progress(void);
 void sm_set_stop_flag(bool stop_flag);
+sm_async_cmd_t *sm_exec_cmd_async(const char *commandline,
+                                  const sm_scan_callbacks_t *callbacks);
+void sm_async_cancel(sm_async_cmd_t *cmd);
+bool sm_async_is_done(const sm_async_cmd_t *cmd);
+bool sm_async_wait(sm_async_cmd_t *cmd);
+
+/* sessions other than sm_globals, sm_init() must be called first */
+globals_t *sm_session_new(void);
+void sm_session_free(globals_t *vars);
+bool sm_session_exec_cmd(globals_t *vars, const char *commandline);
+unsigned long sm_session_get_num_matches(const globals_t *vars);
+const sm_stats_t *sm_session_get_stats(const globals_t *vars);
+double sm_session_get_scan_progress(const globals_t *vars);
+void sm_session_set_stop_flag(globals_t *vars, bool stop_flag);
+
+/* whether the session has something to scan, a process or an image */
+static inline bool sm_session_has_target(const globals_t *vars)
+{
+    return vars->target != 0 || vars->image != NULL;
+}
 
 /* ptrace.c */
 bool sm_detach(pid_t target);
 bool sm_setaddr(pid_t target, char *addr, const value_t *to);
+bool sm_session_setaddr(globals_t *vars, char *addr, const value_t *to);
 bool sm_checkmatches(globals_t *vars, scan_match_type_t match_type,
                      const uservalue_t *uservalue);
 bool sm_searchregions(globals_t *vars, scan_match_type_t match_type,
                       const uservalue_t *uservalue);
 bool sm_peekdata(pid_t pid, const char *addr, uint16_t length, const mem64_t **result_ptr, size_t *memlength);
+bool sm_session_peekdata(globals_t *vars, const char *addr, uint16_t length, const mem64_t **result_ptr, size_t *memlength);
 bool sm_attach(pid_t target);
+bool sm_session_attach(globals_t *vars);
+bool sm_session_detach(globals_t *vars);
+size_t sm_session_read(globals_t *vars, const char *addr, char *buf, size_t len);
+void sm_free_peekbuf(globals_t *vars);
 bool sm_read_array(pid_t target, const char *addr, char *buf, int len);
+bool sm_session_read_array(globals_t *vars, const char *addr, char *buf, int len);
+bool sm_read_multi(pid_t target, sm_read_request_t *requests, size_t count, char *buf);
+bool sm_session_read_multi(globals_t *vars, sm_read_request_t *requests, size_t count, char *buf);
 bool sm_write_array(pid_t target, char *addr, const char *data, int len);
+bool sm_session_write_array(globals_t *vars, char *addr, const char *data, int len);
 
 #endif /* SCANMEM_H */
@@ -22,11 +22,14 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "scanroutines.h"
 #include "common.h"
 #include "endianness.h"
 #include "value.h"
+#include "memregex.h"
+#include "signatures.h"
 
 
 /* for convenience */
@@ -295,6 +298,178 @@ DEFINE_FLOAT_RANGE_ROUTINE(32, 1, _REVENDIAN)
 DEFINE_FLOAT_RANGE_ROUTINE(64, 0, )
 DEFINE_FLOAT_RANGE_ROUTINE(64, 1, _REVENDIAN)
 
+/*-----------*/
+/* for ANYOF */
+/*-----------*/
+
+/* up to this size, sets are searched with a branchless loop the compiler can
+ * vectorize, bigger ones with a binary search */
+#define SMALL_SET_SIZE (16)
+
+#define DEFINE_SET_CONTAINS(FIELD, TYPE) \
+    static inline bool set_contains_##FIELD(const valueset_t *set, TYPE value) \
+    { \
+        const TYPE *values = set->values[VALUESET_INDEX(FIELD)]; \
+        size_t count = set->counts[VALUESET_INDEX(FIELD)]; \
+        size_t lo = 0, hi = count; \
+        if (count <= SMALL_SET_SIZE) { \
+            bool found = false; \
+            size_t i; \
+            for (i = 0; i < count; i++) \
+                found |= (values[i] == value); \
+            return found; \
+        } \
+        while (lo < hi) { \
+            size_t mid = lo + (hi - lo) / 2; \
+            if (values[mid] < value) \
+                lo = mid + 1; \
+            else \
+                hi = mid; \
+        } \
+        return (lo < count && values[lo] == value); \
+    }
+
+DEFINE_SET_CONTAINS(u8b, uint8_t)
+DEFINE_SET_CONTAINS(s8b, int8_t)
+DEFINE_SET_CONTAINS(u16b, uint16_t)
+DEFINE_SET_CONTAINS(s16b, int16_t)
+DEFINE_SET_CONTAINS(u32b, uint32_t)
+DEFINE_SET_CONTAINS(s32b, int32_t)
+DEFINE_SET_CONTAINS(u64b, uint64_t)
+DEFINE_SET_CONTAINS(s64b, int64_t)
+DEFINE_SET_CONTAINS(f32b, float)
+DEFINE_SET_CONTAINS(f64b, double)
+
+#define DEFINE_INTEGER_ANYOF_ROUTINE(DATAWIDTH, REVENDIAN, REVEND_STR) \
+    extern inline unsigned int scan_routine_INTEGER##DATAWIDTH##_ANYOF##REVEND_STR SCAN_ROUTINE_ARGUMENTS \
+    { \
+        if (memlength < (DATAWIDTH)/8) return 0; \
+        int ret = 0; \
+        mem64_t val; \
+        if (REVENDIAN) { \
+            val.uint##DATAWIDTH##_value = swap_bytes##DATAWIDTH (memory_ptr->uint##DATAWIDTH##_value); \
+            memory_ptr = &val; \
+        } \
+        if (set_contains_s##DATAWIDTH##b(user_value->set_value, get_s##DATAWIDTH##b(memory_ptr))) \
+            { ret = (DATAWIDTH)/8; SET_FLAG(saveflags, s##DATAWIDTH##b); } \
+        if (set_contains_u##DATAWIDTH##b(user_value->set_value, get_u##DATAWIDTH##b(memory_ptr))) \
+            { ret = (DATAWIDTH)/8; SET_FLAG(saveflags, u##DATAWIDTH##b); } \
+        return ret; \
+    }
+
+DEFINE_INTEGER_ANYOF_ROUTINE( 8, 0, )
+DEFINE_INTEGER_ANYOF_ROUTINE(16, 0, )
+DEFINE_INTEGER_ANYOF_ROUTINE(16, 1, _REVENDIAN)
+DEFINE_INTEGER_ANYOF_ROUTINE(32, 0, )
+DEFINE_INTEGER_ANYOF_ROUTINE(32, 1, _REVENDIAN)
+DEFINE_INTEGER_ANYOF_ROUTINE(64, 0, )
+DEFINE_INTEGER_ANYOF_ROUTINE(64, 1, _REVENDIAN)
+
+#define DEFINE_FLOAT_ANYOF_ROUTINE(DATAWIDTH, REVENDIAN, REVEND_STR) \
+    extern inline unsigned int scan_routine_FLOAT##DATAWIDTH##_ANYOF##REVEND_STR SCAN_ROUTINE_ARGUMENTS \
+    { \
+        if (memlength < (DATAWIDTH)/8) return 0; \
+        int ret = 0; \
+        mem64_t val; \
+        if (REVENDIAN) { \
+            val.uint##DATAWIDTH##_value = swap_bytes##DATAWIDTH (memory_ptr->uint##DATAWIDTH##_value); \
+            memory_ptr = &val; \
+        } \
+        if (set_contains_f##DATAWIDTH##b(user_value->set_value, get_f##DATAWIDTH##b(memory_ptr))) \
+            { ret = (DATAWIDTH)/8; SET_FLAG(saveflags, f##DATAWIDTH##b); } \
+        return ret; \
+    }
+
+DEFINE_FLOAT_ANYOF_ROUTINE(32, 0, )
+DEFINE_FLOAT_ANYOF_ROUTINE(32, 1, _REVENDIAN)
+DEFINE_FLOAT_ANYOF_ROUTINE(64, 0, )
+DEFINE_FLOAT_ANYOF_ROUTINE(64, 1, _REVENDIAN)
+
+/*----------*/
+/* for ULPS */
+/*----------*/
+
+/* floats mapped to integers in the same order, so that adjacent floats are
+ * one apart and both zeros map to 0 */
+static inline int64_t float32_order(float value)
+{
+    int32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits < 0) ? INT32_MIN - bits : bits;
+}
+
+static inline int64_t float64_order(double value)
+{
+    int64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits < 0) ? INT64_MIN - bits : bits;
+}
+
+static inline uint64_t signed_distance(int64_t a, int64_t b)
+{
+    return (a > b) ? (uint64_t) a - (uint64_t) b : (uint64_t) b - (uint64_t) a;
+}
+
+static inline uint64_t unsigned_distance(uint64_t a, uint64_t b)
+{
+    return (a > b) ? a - b : b - a;
+}
+
+/* the number of ulps is in user_value[1].uint64_value */
+#define DEFINE_INTEGER_ULPS_ROUTINE(DATAWIDTH, REVENDIAN, REVEND_STR) \
+    extern inline unsigned int scan_routine_INTEGER##DATAWIDTH##_ULPS##REVEND_STR SCAN_ROUTINE_ARGUMENTS \
+    { \
+        if (memlength < (DATAWIDTH)/8) return 0; \
+        int ret = 0; \
+        mem64_t val; \
+        if (REVENDIAN) { \
+            val.uint##DATAWIDTH##_value = swap_bytes##DATAWIDTH (memory_ptr->uint##DATAWIDTH##_value); \
+            memory_ptr = &val; \
+        } \
+        if ((user_value[0].flags & flag_s##DATAWIDTH##b) \
+                && (signed_distance(get_s##DATAWIDTH##b(memory_ptr), get_s##DATAWIDTH##b(&user_value[0])) \
+                    <= user_value[1].uint64_value)) \
+            { ret = (DATAWIDTH)/8; SET_FLAG(saveflags, s##DATAWIDTH##b); } \
+        if ((user_value[0].flags & flag_u##DATAWIDTH##b) \
+                && (unsigned_distance(get_u##DATAWIDTH##b(memory_ptr), get_u##DATAWIDTH##b(&user_value[0])) \
+                    <= user_value[1].uint64_value)) \
+            { ret = (DATAWIDTH)/8; SET_FLAG(saveflags, u##DATAWIDTH##b); } \
+        return ret; \
+    }
+
+DEFINE_INTEGER_ULPS_ROUTINE( 8, 0, )
+DEFINE_INTEGER_ULPS_ROUTINE(16, 0, )
+DEFINE_INTEGER_ULPS_ROUTINE(16, 1, _REVENDIAN)
+DEFINE_INTEGER_ULPS_ROUTINE(32, 0, )
+DEFINE_INTEGER_ULPS_ROUTINE(32, 1, _REVENDIAN)
+DEFINE_INTEGER_ULPS_ROUTINE(64, 0, )
+DEFINE_INTEGER_ULPS_ROUTINE(64, 1, _REVENDIAN)
+
+/* NaNs are never within any number of ulps */
+#define DEFINE_FLOAT_ULPS_ROUTINE(DATAWIDTH, REVENDIAN, REVEND_STR) \
+    extern inline unsigned int scan_routine_FLOAT##DATAWIDTH##_ULPS##REVEND_STR SCAN_ROUTINE_ARGUMENTS \
+    { \
+        if (memlength < (DATAWIDTH)/8) return 0; \
+        int ret = 0; \
+        mem64_t val; \
+        if (REVENDIAN) { \
+            val.uint##DATAWIDTH##_value = swap_bytes##DATAWIDTH (memory_ptr->uint##DATAWIDTH##_value); \
+            memory_ptr = &val; \
+        } \
+        if ((user_value[0].flags & flag_f##DATAWIDTH##b) \
+                && (get_f##DATAWIDTH##b(memory_ptr) == get_f##DATAWIDTH##b(memory_ptr)) \
+                && (signed_distance(float##DATAWIDTH##_order(get_f##DATAWIDTH##b(memory_ptr)), \
+                                    float##DATAWIDTH##_order(get_f##DATAWIDTH##b(&user_value[0]))) \
+                    <= user_value[1].uint64_value)) \
+            { ret = (DATAWIDTH)/8; SET_FLAG(saveflags, f##DATAWIDTH##b); } \
+        return ret; \
+    }
+
+DEFINE_FLOAT_ULPS_ROUTINE(32, 0, )
+DEFINE_FLOAT_ULPS_ROUTINE(32, 1, _REVENDIAN)
+DEFINE_FLOAT_ULPS_ROUTINE(64, 0, )
+DEFINE_FLOAT_ULPS_ROUTINE(64, 1, _REVENDIAN)
+
 
 /*------------------------*/
 /* Any-xxx types specific */
@@ -338,12 +513,16 @@ DEFINE_ANYTYPE_ROUTINE(LESSTHAN, )
 DEFINE_ANYTYPE_ROUTINE(INCREASEDBY, )
 DEFINE_ANYTYPE_ROUTINE(DECREASEDBY, )
 DEFINE_ANYTYPE_ROUTINE(RANGE, )
+DEFINE_ANYTYPE_ROUTINE(ANYOF, )
+DEFINE_ANYTYPE_ROUTINE(ULPS, )
 
 DEFINE_ANYTYPE_ROUTINE(EQUALTO, _REVENDIAN)
 DEFINE_ANYTYPE_ROUTINE(NOTEQUALTO, _REVENDIAN)
 DEFINE_ANYTYPE_ROUTINE(GREATERTHAN, _REVENDIAN)
 DEFINE_ANYTYPE_ROUTINE(LESSTHAN, _REVENDIAN)
 DEFINE_ANYTYPE_ROUTINE(RANGE, _REVENDIAN)
+DEFINE_ANYTYPE_ROUTINE(ANYOF, _REVENDIAN)
+DEFINE_ANYTYPE_ROUTINE(ULPS, _REVENDIAN)
 
 /*----------------------------------------*/
 /* for generic VLT (Variable Length Type) */
@@ -561,6 +740,84 @@ DEFINE_STRING_SMALLOOP_EQUALTO_ROUTINE(48)
 DEFINE_STRING_SMALLOOP_EQUALTO_ROUTINE(56)
 
 
+/*-----------*/
+/* for REGEX */
+/*-----------*/
+
+/* The longest match is saved as a string of its length. */
+extern inline unsigned int scan_routine_REGEX_EQUALTO SCAN_ROUTINE_ARGUMENTS
+{
+    unsigned int length = sm_regex_match(user_value->regex_value,
+                                         (const uint8_t *)memory_ptr, memlength);
+    *saveflags = length;
+    return length;
+}
+
+
+/*----------------*/
+/* for SIGNATURES */
+/*----------------*/
+
+/* The first signature matching is saved as a bytearray of its length. */
+extern inline unsigned int scan_routine_SIGNATURES_EQUALTO SCAN_ROUTINE_ARGUMENTS
+{
+    size_t length;
+
+    if (sm_sigset_match(user_value->sigset_value, (const uint8_t *)memory_ptr,
+                        memlength, &length) < 0)
+        return 0;
+    *saveflags = length;
+    return length;
+}
+
+
+/*-----------*/
+/* for GROUP */
+/*-----------*/
+
+/* The fields are sorted so that the most selective one rejects most of the
+ * candidates with a single compare. Fields without an offset are searched
+ * at the offsets of the window aligned to their width, after the first field.
+ * The flags of the first field are saved, the group is matched as a whole. */
+extern inline unsigned int scan_routine_GROUP_EQUALTO SCAN_ROUTINE_ARGUMENTS
+{
+    const group_t *group = user_value->group_value;
+    unsigned int length = 0, i;
+    match_flags anchor_flags = flags_empty;
+
+    for (i = 0; i < group->count; i++) {
+        const group_field_t *field = &group->fields[i];
+        match_flags flags = flags_empty;
+        size_t offset;
+
+        if (field->offset >= 0) {
+            offset = field->offset;
+            if (memlength < offset + field->width ||
+                !field->routine((const mem64_t *)(memory_ptr->bytes + offset), memlength - offset,
+                                NULL, field->value, &flags))
+                return 0;
+            if (offset == 0)
+                anchor_flags = flags;
+        }
+        else {
+            size_t end = MIN(memlength, group->window);
+            offset = (group->anchor_width + field->width - 1) / field->width * field->width;
+            for (; offset + field->width <= end; offset += field->width) {
+                if (field->routine((const mem64_t *)(memory_ptr->bytes + offset), memlength - offset,
+                                   NULL, field->value, &flags))
+                    break;
+            }
+            if (offset + field->width > end)
+                return 0;
+        }
+        length = MAX(length, offset + field->width);
+    }
+
+    *saveflags = anchor_flags;
+    return length;
+}
+
+
 /***************************************************************/
 /* choose a routine according to scan_data_type and match_type */
 /***************************************************************/
@@ -647,6 +904,8 @@ scan_routine_t sm_get_scanroutine(scan_data_type_t dt, scan_match_type_t mt, mat
     CHOOSE_ROUTINE_FOR_ALL_NUMBER_TYPES(MATCHINCREASEDBY, INCREASEDBY)
     CHOOSE_ROUTINE_FOR_ALL_NUMBER_TYPES(MATCHDECREASEDBY, DECREASEDBY)
     CHOOSE_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(MATCHRANGE, RANGE)
+    CHOOSE_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(MATCHANYOF, ANYOF)
+    CHOOSE_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(MATCHWITHINULPS, ULPS)
 
     CHOOSE_ROUTINE(BYTEARRAY, VLT, MATCHANY, ANY)
     CHOOSE_ROUTINE(BYTEARRAY, VLT, MATCHUPDATE, UPDATE)
@@ -676,27 +935,47 @@ static match_flags possible_flags_for_scan_data_type[] = {
     [STRING]     = flags_max
 };
 
-bool sm_choose_scanroutine(scan_data_type_t dt, scan_match_type_t mt, const uservalue_t* uval, bool reverse_endianness)
+scan_routine_t sm_find_scanroutine(scan_data_type_t dt, scan_match_type_t mt, const uservalue_t* uval, bool reverse_endianness)
 {
     match_flags uflags = uval ? uval->flags : flags_empty;
 
+    /* groups match each field with the routine of its own type */
+    if (uval && uval->group_value)
+        return (mt == MATCHEQUALTO) ? &scan_routine_GROUP_EQUALTO : NULL;
+
+    /* so do regexes, whatever the length of their match */
+    if (uval && uval->regex_value)
+        return (mt == MATCHEQUALTO) ? &scan_routine_REGEX_EQUALTO : NULL;
+    if (uval && uval->sigset_value)
+        return (mt == MATCHEQUALTO) ? &scan_routine_SIGNATURES_EQUALTO : NULL;
+
+    /* strings regardless of case are matched as bytearrays with CASELESS wildcards */
+    if (dt == STRING && uval && uval->wildcard_value)
+        dt = BYTEARRAY;
+
     /* Check scans that need an uservalue */
     if (mt == MATCHEQUALTO     ||
         mt == MATCHNOTEQUALTO  ||
         mt == MATCHGREATERTHAN ||
         mt == MATCHLESSTHAN    ||
         mt == MATCHRANGE       ||
+        mt == MATCHANYOF       ||
+        mt == MATCHWITHINULPS  ||
         mt == MATCHINCREASEDBY ||
         mt == MATCHDECREASEDBY)
     {
         match_flags possible_flags = possible_flags_for_scan_data_type[dt];
         if ((possible_flags & uflags) == flags_empty) {
             /* There's no possibility to have a match, just abort */
-            sm_scan_routine = NULL;
-            return false;
+            return NULL;
         }
     }
 
-    sm_scan_routine = sm_get_scanroutine(dt, mt, uflags, reverse_endianness);
+    return sm_get_scanroutine(dt, mt, uflags, reverse_endianness);
+}
+
+bool sm_choose_scanroutine(scan_data_type_t dt, scan_match_type_t mt, const uservalue_t* uval, bool reverse_endianness)
+{
+    sm_scan_routine = sm_find_scanroutine(dt, mt, uval, reverse_endianness);
     return (sm_scan_routine != NULL);
 }
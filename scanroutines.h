@@ -49,6 +49,8 @@ typedef enum {
     MATCHGREATERTHAN,
     MATCHLESSTHAN,
     MATCHRANGE,
+    MATCHANYOF,              /* equal to one of a set of values */
+    MATCHWITHINULPS,         /* within a number of ulps of a value */
     /* following: compare with the old value */
     MATCHUPDATE,
     MATCHNOTCHANGED,
@@ -70,12 +72,57 @@ typedef unsigned int (*scan_routine_t)(const mem64_t *memory_ptr, size_t memleng
                                        const value_t *old_value, const uservalue_t *user_value, match_flags *saveflags);
 extern scan_routine_t sm_scan_routine;
 
+/* group scans: values of different types at offsets from the first one */
+#define MAX_GROUP_FIELDS (16)
+#define MAX_GROUP_WINDOW (4096)
+
+typedef struct {
+    scan_routine_t routine;     /* EQUALTO or RANGE routine of the field type */
+    uservalue_t value[2];       /* the value, or the bounds of a range */
+    int offset;                 /* from the first field, -1 for anywhere in the window */
+    uint16_t width;
+} group_field_t;
+
+struct group {
+    group_field_t fields[MAX_GROUP_FIELDS]; /* the most selective ones first */
+    unsigned count;
+    uint16_t anchor_width;      /* width of the first field, at offset 0 */
+    uint16_t window;            /* fields without offset are searched in [0, window) */
+    uint16_t span;              /* bytes needed to match the group */
+};
+
+/*
+ * Find the scanroutine for the given parameters.
+ * Returns NULL if there is none, or if `uval` can't match the data type.
+ */
+scan_routine_t sm_find_scanroutine(scan_data_type_t dt, scan_match_type_t mt, const uservalue_t* uval, bool reverse_endianness);
+
 /* 
  * Choose the global scanroutine according to the given parameters, sm_scan_routine will be set.
  * Returns whether a proper routine has been found.
+ * Not reentrant, sessions use sm_find_scanroutine() instead.
  */
 bool sm_choose_scanroutine(scan_data_type_t dt, scan_match_type_t mt, const uservalue_t* uval, bool reverse_endianness);
 
 scan_routine_t sm_get_scanroutine(scan_data_type_t dt, scan_match_type_t mt, match_flags uflags, bool reverse_endianness);
 
+/* the number of bytes of a match with `flags` */
+static inline uint16_t flags_to_memlength(scan_data_type_t scan_data_type, match_flags flags)
+{
+    switch(scan_data_type)
+    {
+        case BYTEARRAY:
+        case STRING:
+            return flags;
+            break;
+        default: /* numbers */
+                 if (flags & flags_64b) return 8;
+            else if (flags & flags_32b) return 4;
+            else if (flags & flags_16b) return 2;
+            else if (flags & flags_8b ) return 1;
+            else    /* it can't be a variable of any size */ return 0;
+            break;
+    }
+}
+
 #endif /* SCANROUTINES_H */
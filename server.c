@@ -0,0 +1,441 @@
+/*
+    Serve scanmem sessions over a Unix domain socket.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of scanmem.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "scanmem.h"
+#include "commands.h"
+#include "regionfilter.h"
+#include "show_message.h"
+#include "server.h"
+
+#define MAX_CLIENTS (64)
+#define MAX_REQUEST_LEN (64 * 1024)
+
+/* a library session, shared by the clients that switched to it */
+typedef struct session {
+    char *name;                 /* NULL for the private session of a client */
+    globals_t *vars;
+    struct session *next;       /* in the list of named sessions */
+} session_t;
+
+typedef struct {
+    int fd;
+    session_t *session;         /* current session */
+    session_t *private;         /* dropped on disconnect */
+    bool hangup;                /* `exit` was requested */
+    char buf[MAX_REQUEST_LEN];
+    size_t len;
+} client_t;
+
+static session_t *named_sessions = NULL;
+
+/* set by `@shutdown`, SIGINT and SIGTERM */
+static volatile sig_atomic_t shutdown_requested = 0;
+
+static void request_shutdown(int signum)
+{
+    (void) signum;
+    shutdown_requested = 1;
+}
+
+static void free_session(session_t *s)
+{
+    sm_session_free(s->vars);
+    free(s->name);
+    free(s);
+}
+
+/* new sessions start with the target, options and regions of `vars` */
+static session_t *new_session(globals_t *vars, const char *name)
+{
+    session_t *s;
+
+    if ((s = calloc(1, sizeof(session_t))) == NULL)
+        return NULL;
+    if ((name && (s->name = strdup(name)) == NULL) ||
+        (s->vars = sm_session_new()) == NULL) {
+        free(s->name);
+        free(s);
+        return NULL;
+    }
+    s->vars->target = vars->target;
+    s->vars->options = vars->options;
+    s->vars->options.region_filter = NULL;
+
+    /* copy the regions of the default target instead of reading the maps again */
+    if ((vars->options.region_filter &&
+         (s->vars->options.region_filter = sm_region_filter_copy(vars->options.region_filter)) == NULL) ||
+        (s->vars->target != 0 && vars->regions &&
+         (s->vars->regions = sm_regions_copy(vars->regions)) == NULL)) {
+        free_session(s);
+        return NULL;
+    }
+    return s;
+}
+
+static session_t *get_named_session(globals_t *vars, const char *name)
+{
+    session_t *s;
+
+    for (s = named_sessions; s; s = s->next) {
+        if (strcmp(s->name, name) == 0)
+            return s;
+    }
+    if ((s = new_session(vars, name)) == NULL)
+        return NULL;
+    s->next = named_sessions;
+    named_sessions = s;
+    return s;
+}
+
+static bool send_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* send the header and the contents of both capture files */
+static bool send_response(int fd, bool ok, int out_fd, int err_fd)
+{
+    char header[64];
+    off_t lens[2];
+    int files[2] = { out_fd, err_fd };
+    char chunk[BUFSIZ];
+    int i;
+
+    for (i = 0; i < 2; i++)
+        lens[i] = lseek(files[i], 0, SEEK_END);
+    snprintf(header, sizeof(header), "%d %ld %ld\n", ok ? 0 : 1,
+             (long) lens[0], (long) lens[1]);
+    if (!send_all(fd, header, strlen(header)))
+        return false;
+
+    for (i = 0; i < 2; i++) {
+        off_t offset = 0;
+        while (offset < lens[i]) {
+            ssize_t n = pread(files[i], chunk, MIN((size_t) (lens[i] - offset), sizeof(chunk)), offset);
+            if (n <= 0)
+                return false;
+            if (!send_all(fd, chunk, n))
+                return false;
+            offset += n;
+        }
+    }
+    return true;
+}
+
+/* execute one request with stdout and stderr redirected to `out_fd` and `err_fd` */
+static bool execute(globals_t *vars, client_t *c, char *line, int out_fd, int err_fd)
+{
+    int saved_stdout, saved_stderr;
+    bool ok;
+
+    fflush(stdout);
+    fflush(stderr);
+    if (ftruncate(out_fd, 0) == -1 || ftruncate(err_fd, 0) == -1)
+        return false;
+    lseek(out_fd, 0, SEEK_SET);
+    lseek(err_fd, 0, SEEK_SET);
+    saved_stdout = dup(STDOUT_FILENO);
+    saved_stderr = dup(STDERR_FILENO);
+    dup2(out_fd, STDOUT_FILENO);
+    dup2(err_fd, STDERR_FILENO);
+
+    if (strncmp(line, "@session", 8) == 0 && (line[8] == ' ' || line[8] == '\0')) {
+        const char *name = line + 8;
+        session_t *s;
+
+        while (*name == ' ')
+            name++;
+        if (*name == '\0') {
+            printf("%s\n", c->session->name ? c->session->name : "");
+            ok = true;
+        } else if ((s = get_named_session(vars, name)) == NULL) {
+            show_error("failed to create session `%s`.\n", name);
+            ok = false;
+        } else {
+            c->session = s;
+            ok = true;
+        }
+    } else if (strcmp(line, "@shutdown") == 0) {
+        shutdown_requested = 1;
+        ok = true;
+    } else if (line[0] == '@') {
+        show_error("unknown request `%s`.\n", line);
+        ok = false;
+    } else {
+        globals_t *session_vars = c->session->vars;
+
+        ok = sm_execcommand(session_vars, line);
+        if (session_vars->exit) {
+            /* `exit` ends the connection, not the server */
+            session_vars->exit = false;
+            c->hangup = true;
+        }
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stdout);
+    close(saved_stderr);
+    return ok;
+}
+
+static void drop_client(client_t *c)
+{
+    close(c->fd);
+    if (c->private)
+        free_session(c->private);
+    free(c);
+}
+
+/* read from the client and serve every complete line, false on disconnect */
+static bool serve_client(globals_t *vars, client_t *c, int out_fd, int err_fd)
+{
+    ssize_t n;
+    char *eol;
+
+    n = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+    if (n <= 0)
+        return (n < 0 && errno == EINTR);
+    c->len += n;
+
+    while ((eol = memchr(c->buf, '\n', c->len)) != NULL) {
+        size_t linelen = eol - c->buf;
+        bool ok;
+
+        *eol = '\0';
+        if (linelen > 0 && c->buf[linelen - 1] == '\r')
+            c->buf[linelen - 1] = '\0';
+        ok = execute(vars, c, c->buf, out_fd, err_fd);
+        if (!send_response(c->fd, ok, out_fd, err_fd) || c->hangup)
+            return false;
+        c->len -= linelen + 1;
+        memmove(c->buf, eol + 1, c->len);
+    }
+
+    if (c->len == sizeof(c->buf)) {
+        show_error("request too long, dropping client.\n");
+        return false;
+    }
+    return true;
+}
+
+static int open_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        show_error("socket path `%s` is too long.\n", path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+        show_error("failed to create socket: %s.\n", strerror(errno));
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        /* replace a stale socket, but not a living server */
+        if (errno != EADDRINUSE ||
+            connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0 ||
+            errno != ECONNREFUSED) {
+            show_error("failed to bind `%s`: %s.\n", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        close(fd);
+        unlink(path);
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 ||
+            bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+            show_error("failed to bind `%s`: %s.\n", path, strerror(errno));
+            if (fd != -1)
+                close(fd);
+            return -1;
+        }
+    }
+    if (listen(fd, MAX_CLIENTS) == -1) {
+        show_error("failed to listen on `%s`: %s.\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool serve(globals_t *vars, const char *path)
+{
+    struct pollfd fds[MAX_CLIENTS + 1];
+    client_t *clients[MAX_CLIENTS];
+    unsigned nclients = 0, i;
+    session_t *default_session, *s, *next;
+    struct sigaction stop_action, old_int, old_term;
+    sigset_t stop_signals, old_mask;
+    FILE *out = NULL, *err = NULL;
+    int listen_fd;
+    bool ok = true;
+
+    if ((out = tmpfile()) == NULL || (err = tmpfile()) == NULL) {
+        show_error("failed to create the output capture files.\n");
+        goto fail;
+    }
+    if ((listen_fd = open_socket(path)) == -1)
+        goto fail;
+
+    /* the state set up so far is the "default" session,
+     * new sessions start from its options and target */
+    if ((default_session = calloc(1, sizeof(session_t))) == NULL ||
+        (default_session->name = strdup("default")) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        free(default_session);
+        close(listen_fd);
+        unlink(path);
+        goto fail;
+    }
+    default_session->vars = vars;
+    named_sessions = default_session;
+
+    /* stop cleanly on SIGINT and SIGTERM, which are only delivered in ppoll() */
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = request_shutdown;
+    sigemptyset(&stop_action.sa_mask);
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop_signals, &old_mask);
+    sigaction(SIGINT, &stop_action, &old_int);
+    sigaction(SIGTERM, &stop_action, &old_term);
+    shutdown_requested = 0;
+
+    show_info("serving on %s\n", path);
+
+    while (!shutdown_requested) {
+        fds[0].fd = listen_fd;
+        fds[0].events = (nclients < MAX_CLIENTS) ? POLLIN : 0;
+        for (i = 0; i < nclients; i++) {
+            fds[i + 1].fd = clients[i]->fd;
+            fds[i + 1].events = POLLIN;
+        }
+
+        if (ppoll(fds, nclients + 1, NULL, &old_mask) == -1) {
+            if (errno == EINTR)
+                continue;
+            show_error("poll failed: %s.\n", strerror(errno));
+            ok = false;
+            break;
+        }
+
+        /* serve clients first, `i` may be removed while iterating */
+        for (i = nclients; i > 0; i--) {
+            client_t *c = clients[i - 1];
+            if (fds[i].revents == 0)
+                continue;
+            if (!serve_client(vars, c, fileno(out), fileno(err))) {
+                drop_client(c);
+                clients[i - 1] = clients[--nclients];
+            }
+        }
+
+        if (shutdown_requested)
+            break;
+        if (fds[0].revents & POLLIN) {
+            client_t *c;
+            int fd;
+
+            if ((fd = accept(listen_fd, NULL, NULL)) == -1)
+                continue;
+            if ((c = calloc(1, sizeof(client_t))) == NULL ||
+                (c->private = new_session(vars, NULL)) == NULL) {
+                show_error("sorry, there was a memory allocation error.\n");
+                free(c);
+                close(fd);
+                continue;
+            }
+            c->fd = fd;
+            c->session = c->private;
+            clients[nclients++] = c;
+        }
+    }
+
+    if (ok)
+        show_info("shutting down.\n");
+    for (i = 0; i < nclients; i++)
+        drop_client(clients[i]);
+    close(listen_fd);
+    unlink(path);
+
+    /* the default session belongs to the caller */
+    for (s = named_sessions; s; s = next) {
+        next = s->next;
+        if (s == default_session) {
+            free(s->name);
+            free(s);
+        } else {
+            free_session(s);
+        }
+    }
+    named_sessions = NULL;
+    fclose(out);
+    fclose(err);
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    return ok;
+
+fail:
+    if (out)
+        fclose(out);
+    if (err)
+        fclose(err);
+    return false;
+}
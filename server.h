@@ -0,0 +1,51 @@
+/*
+    Serve scanmem sessions over a Unix domain socket.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of scanmem.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+
+#include "scanmem.h"
+
+/*
+ * serve() listens on the Unix domain socket `path` and executes the commands
+ * sent by its clients until the request "@shutdown", SIGINT or SIGTERM, then
+ * removes the socket. Returns false if the socket can't be set up or polling
+ * fails.
+ *
+ * The commands are executed one at a time, in the order their requests
+ * arrive: a long scan of a client delays the requests of all the others.
+ *
+ * Every request is one line holding a command. Every response starts with
+ * the line "<status> <stdout length> <stderr length>\n", where status is 0
+ * on success and 1 on failure, followed by the captured stdout and stderr
+ * bytes of the command.
+ *
+ * Each client gets a private session (target, regions, matches and options)
+ * that is dropped on disconnect. The request "@session <name>" switches the
+ * client to the named session, creating it if needed; named sessions are
+ * kept across connections. The state set up before serving (`-p`, `-c`) is
+ * the session named "default".
+ */
+bool serve(globals_t *vars, const char *path);
+
+#endif /* SERVER_H */
@@ -0,0 +1,470 @@
+/*
+    Search of many byte signatures at once.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Each signature is represented by a key, a run of its fixed bytes, and the
+ * keys of all the signatures are searched at once with an Aho-Corasick
+ * automaton. The starts of the signatures whose key was found are marked in
+ * a bitmap, and the signatures are checked in full at the marked offsets only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "common.h"
+#include "getline.h"
+#include "signatures.h"
+#include "show_message.h"
+
+/* longer keys make larger automatons but hardly fewer false candidates */
+#define MAX_KEY_LENGTH (8)
+
+typedef struct {
+    char *name;
+    uint8_t *bytes;
+    wildcard_t *wildcards;
+    size_t len;
+    size_t key_offset, key_len;
+    long next_same_key;         /* next signature with the same key, or -1 */
+} signature_t;
+
+/* the signature of a recorded match */
+typedef struct {
+    const void *address;
+    long id;
+} sighit_t;
+
+struct sm_sigset {
+    signature_t *sigs;
+    size_t count;
+
+    /* the automaton: state 0 is the root, `delta` is complete once built */
+    int32_t (*delta)[256];
+    int32_t *fail;
+    long *output;               /* first signature whose key ends here, or -1 */
+    int32_t *dict;              /* next state on the fail path with an output, or -1 */
+    size_t nstates;
+    size_t max_key_end;         /* of key_offset + key_len */
+
+    /* state of the current search */
+    uint64_t *starts;           /* bitmap of the match starts */
+    size_t bitmap_words;
+    size_t size;
+    size_t scanned;             /* bytes fed to the automaton */
+    int32_t state;
+    long last_id;               /* of the last sm_sigset_match() */
+
+    /* the signatures of the recorded matches, by address */
+    sighit_t *hits;
+    size_t nhits, hits_alloced;
+};
+
+static void free_signatures(sm_sigset_t *set)
+{
+    size_t i;
+
+    for (i = 0; i < set->count; i++) {
+        free(set->sigs[i].name);
+        free(set->sigs[i].bytes);
+        free(set->sigs[i].wildcards);
+    }
+    free(set->sigs);
+}
+
+void sm_sigset_free(sm_sigset_t *set)
+{
+    if (set == NULL)
+        return;
+    free_signatures(set);
+    free(set->delta);
+    free(set->fail);
+    free(set->output);
+    free(set->dict);
+    free(set->starts);
+    free(set->hits);
+    free(set);
+}
+
+size_t sm_sigset_count(const sm_sigset_t *set)
+{
+    return set->count;
+}
+
+const char *sm_sigset_name(const sm_sigset_t *set, size_t id)
+{
+    return (id < set->count) ? set->sigs[id].name : NULL;
+}
+
+/* pick the longest run of fixed bytes, and in it the window with the fewest
+ * 0x00 and 0xff, which fill most of the memory */
+static bool choose_key(signature_t *sig)
+{
+    size_t i, start, best_zeroes = 0;
+
+    sig->key_len = 0;
+    for (start = 0; start < sig->len; start = i + 1) {
+        size_t run, len, offset;
+
+        for (i = start; i < sig->len && sig->wildcards[i] == FIXED; i++)
+            ;
+        run = i - start;
+        len = MIN(run, MAX_KEY_LENGTH);
+        if (len == 0 || len < sig->key_len)
+            continue;
+        for (offset = start; offset + len <= i; offset++) {
+            size_t j, zeroes = 0;
+            for (j = offset; j < offset + len; j++)
+                zeroes += (sig->bytes[j] == 0x00 || sig->bytes[j] == 0xff);
+            if (len > sig->key_len || zeroes < best_zeroes) {
+                sig->key_offset = offset;
+                sig->key_len = len;
+                best_zeroes = zeroes;
+            }
+        }
+    }
+    return sig->key_len > 0;
+}
+
+/* parse `<name> <byte> ...` in place, false with `error` set if it's invalid */
+static bool parse_signature(char *line, signature_t *sig, const char **error)
+{
+    char *saveptr, *token, *name;
+    char *bytes[MAX_SIGNATURE_LENGTH];
+    unsigned nbytes = 0;
+    uservalue_t val;
+
+    name = strtok_r(line, " \t\r\n", &saveptr);
+    while ((token = strtok_r(NULL, " \t\r\n", &saveptr)) != NULL) {
+        if (nbytes == MAX_SIGNATURE_LENGTH) {
+            *error = "too long";
+            return false;
+        }
+        bytes[nbytes++] = (strcmp(token, "?") == 0) ? "??" : token;
+    }
+    if (nbytes == 0) {
+        *error = "no bytes";
+        return false;
+    }
+    if (!parse_uservalue_bytearray(bytes, nbytes, &val)) {
+        *error = "bad bytes";
+        return false;
+    }
+
+    sig->bytes = (uint8_t *) val.bytearray_value;
+    sig->wildcards = (wildcard_t *) val.wildcard_value;
+    sig->len = nbytes;
+    sig->next_same_key = -1;
+    if (!choose_key(sig)) {
+        free_uservalue(&val);
+        *error = "no fixed bytes";
+        return false;
+    }
+    if ((sig->name = strdup(name)) == NULL) {
+        free_uservalue(&val);
+        *error = "out of memory";
+        return false;
+    }
+    return true;
+}
+
+static bool read_signatures(sm_sigset_t *set, FILE *in, const char *path)
+{
+    char *line = NULL;
+    size_t len = 0, alloced = 0;
+    unsigned long lineno = 0;
+
+    while (getline(&line, &len, in) != -1) {
+        const char *error = NULL;
+        char *p = line + strspn(line, " \t\r\n");
+
+        lineno++;
+        if (*p == '\0' || *p == '#')
+            continue;
+
+        if (set->count == alloced) {
+            signature_t *sigs;
+            alloced = alloced ? 2 * alloced : 64;
+            if ((sigs = realloc(set->sigs, alloced * sizeof(signature_t))) == NULL) {
+                show_error("sorry, there was a memory allocation error.\n");
+                free(line);
+                return false;
+            }
+            set->sigs = sigs;
+        }
+        if (!parse_signature(p, &set->sigs[set->count], &error)) {
+            show_error("%s:%lu: bad signature, %s.\n", path, lineno, error);
+            free(line);
+            return false;
+        }
+        set->count++;
+    }
+    free(line);
+
+    if (ferror(in)) {
+        show_error("failed to read `%s`.\n", path);
+        return false;
+    }
+    if (set->count == 0) {
+        show_error("there are no signatures in `%s`.\n", path);
+        return false;
+    }
+    return true;
+}
+
+static bool build_automaton(sm_sigset_t *set)
+{
+    size_t i, max_states = 1, head, tail;
+    int32_t *queue;
+    int c;
+
+    for (i = 0; i < set->count; i++)
+        max_states += set->sigs[i].key_len;
+    if ((set->delta = malloc(max_states * sizeof(*set->delta))) == NULL ||
+        (set->fail = calloc(max_states, sizeof(int32_t))) == NULL ||
+        (set->output = malloc(max_states * sizeof(long))) == NULL ||
+        (set->dict = malloc(max_states * sizeof(int32_t))) == NULL ||
+        (queue = malloc(max_states * sizeof(int32_t))) == NULL)
+        return false;
+
+    /* the trie of the keys, -1 for no child */
+    memset(set->delta, 0xff, max_states * sizeof(*set->delta));
+    set->output[0] = -1;
+    set->nstates = 1;
+    for (i = 0; i < set->count; i++) {
+        signature_t *sig = &set->sigs[i];
+        const uint8_t *key = sig->bytes + sig->key_offset;
+        int32_t s = 0;
+        size_t j;
+
+        for (j = 0; j < sig->key_len; j++) {
+            if (set->delta[s][key[j]] < 0) {
+                set->output[set->nstates] = -1;
+                set->delta[s][key[j]] = set->nstates++;
+            }
+            s = set->delta[s][key[j]];
+        }
+        /* signatures with the same key are listed from the first one */
+        if (set->output[s] < 0) {
+            set->output[s] = i;
+        }
+        else {
+            long last = set->output[s];
+            while (set->sigs[last].next_same_key >= 0)
+                last = set->sigs[last].next_same_key;
+            set->sigs[last].next_same_key = i;
+        }
+        set->max_key_end = MAX(set->max_key_end, sig->key_offset + sig->key_len);
+    }
+
+    /* breadth-first, complete `delta` with the transitions of the fail states */
+    head = tail = 0;
+    set->dict[0] = -1;
+    for (c = 0; c < 256; c++) {
+        int32_t t = set->delta[0][c];
+        if (t < 0) {
+            set->delta[0][c] = 0;
+        }
+        else {
+            set->fail[t] = 0;
+            set->dict[t] = -1;
+            queue[tail++] = t;
+        }
+    }
+    while (head < tail) {
+        int32_t s = queue[head++];
+        for (c = 0; c < 256; c++) {
+            int32_t t = set->delta[s][c];
+            if (t < 0) {
+                set->delta[s][c] = set->delta[set->fail[s]][c];
+                continue;
+            }
+            set->fail[t] = set->delta[set->fail[s]][c];
+            set->dict[t] = (set->output[set->fail[t]] >= 0) ? set->fail[t] : set->dict[set->fail[t]];
+            queue[tail++] = t;
+        }
+    }
+    free(queue);
+    return true;
+}
+
+sm_sigset_t *sm_sigset_load(const char *path)
+{
+    sm_sigset_t *set;
+    FILE *in;
+
+    if ((in = fopen(path, "r")) == NULL) {
+        show_error("failed to open `%s`: %s.\n", path, strerror(errno));
+        return NULL;
+    }
+    if ((set = calloc(1, sizeof(sm_sigset_t))) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        fclose(in);
+        return NULL;
+    }
+    if (!read_signatures(set, in, path)) {
+        fclose(in);
+        sm_sigset_free(set);
+        return NULL;
+    }
+    fclose(in);
+
+    if (!build_automaton(set)) {
+        show_error("sorry, there was a memory allocation error.\n");
+        sm_sigset_free(set);
+        return NULL;
+    }
+    return set;
+}
+
+static inline bool signature_matches(const signature_t *sig, const uint8_t *data)
+{
+    size_t i;
+
+    for (i = 0; i < sig->len; i++) {
+        if ((data[i] & sig->wildcards[i]) != sig->bytes[i])
+            return false;
+    }
+    return true;
+}
+
+/* loop `i` over the signatures whose key ends where the automaton reached `s` */
+#define FOR_EACH_KEY(set, s, i)                                                   \
+    for (int32_t o_ = ((set)->output[s] >= 0) ? (s) : (set)->dict[s]; o_ >= 0;  \
+         o_ = (set)->dict[o_])                                                    \
+        for (long i = (set)->output[o_]; i >= 0; i = (set)->sigs[i].next_same_key)
+
+long sm_sigset_match(sm_sigset_t *set, const uint8_t *data, size_t size, size_t *length)
+{
+    size_t pos, end = MIN(size, set->max_key_end);
+    int32_t s = 0;
+    long best = -1;
+
+    /* only the signatures whose key is found at its place can match */
+    for (pos = 0; pos < end; pos++) {
+        s = set->delta[s][data[pos]];
+        FOR_EACH_KEY(set, s, i) {
+            const signature_t *sig = &set->sigs[i];
+            if (sig->key_offset + sig->key_len == pos + 1 && (best < 0 || i < best) &&
+                sig->len <= size && signature_matches(sig, data))
+                best = i;
+        }
+    }
+    if (best >= 0)
+        *length = set->sigs[best].len;
+    set->last_id = best;
+    return best;
+}
+
+bool sm_sigset_record(sm_sigset_t *set, const void *address)
+{
+    if (set->nhits == set->hits_alloced) {
+        size_t alloced = set->hits_alloced ? 2 * set->hits_alloced : 1024;
+        sighit_t *hits = realloc(set->hits, alloced * sizeof(sighit_t));
+        if (hits == NULL)
+            return false;
+        set->hits = hits;
+        set->hits_alloced = alloced;
+    }
+    set->hits[set->nhits].address = address;
+    set->hits[set->nhits].id = set->last_id;
+    set->nhits++;
+    return true;
+}
+
+long sm_sigset_lookup(const sm_sigset_t *set, const void *address)
+{
+    size_t lo = 0, hi = set->nhits;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if ((const char *) set->hits[mid].address < (const char *) address)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo < set->nhits && set->hits[lo].address == address) ? set->hits[lo].id : -1;
+}
+
+bool sm_sigset_begin(sm_sigset_t *set, size_t size)
+{
+    size_t words = (size + 63) / 64;
+
+    if (words > set->bitmap_words) {
+        uint64_t *starts = realloc(set->starts, words * sizeof(uint64_t));
+        if (starts == NULL)
+            return false;
+        set->starts = starts;
+        set->bitmap_words = words;
+    }
+    memset(set->starts, 0, words * sizeof(uint64_t));
+    set->size = size;
+    set->scanned = 0;
+    set->state = 0;
+    return true;
+}
+
+/* feed the automaton up to `end`, checking the signatures of the keys found
+ * and marking the starts of their matches */
+static void scan_keys(sm_sigset_t *set, const uint8_t *data, size_t end)
+{
+    int32_t s = set->state;
+    size_t pos;
+
+    for (pos = set->scanned; pos < end; pos++) {
+        s = set->delta[s][data[pos]];
+        FOR_EACH_KEY(set, s, i) {
+            const signature_t *sig = &set->sigs[i];
+            size_t key_end = sig->key_offset + sig->key_len, start;
+            uint64_t bit;
+
+            if (pos + 1 < key_end || pos + 1 - key_end + sig->len > set->size)
+                continue;
+            start = pos + 1 - key_end;
+            bit = (uint64_t) 1 << (start % 64);
+            if (!(set->starts[start / 64] & bit) && signature_matches(sig, data + start))
+                set->starts[start / 64] |= bit;
+        }
+    }
+    set->state = s;
+    set->scanned = end;
+}
+
+size_t sm_sigset_next(sm_sigset_t *set, const uint8_t *data, size_t size,
+                      size_t from, size_t limit)
+{
+    size_t pos, end = MIN(limit, size);
+
+    /* all the keys of the signatures starting before `end` */
+    scan_keys(set, data, MAX(set->scanned, MIN(size, end + set->max_key_end - 1)));
+
+    for (pos = from; pos < end; pos++) {
+        uint64_t word = set->starts[pos / 64] >> (pos % 64);
+        if (word == 0) {
+            pos |= 63;
+            continue;
+        }
+        pos += __builtin_ctzll(word);
+        return (pos < end) ? pos : limit;
+    }
+    return limit;
+}
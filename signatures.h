@@ -0,0 +1,76 @@
+/*
+    Search of many byte signatures at once.
+
+    Copyright (C) 2017           Scanmem authors
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIGNATURES_H
+#define SIGNATURES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "value.h"
+
+#define MAX_SIGNATURE_LENGTH (1024)
+
+/*
+ * Load the signatures of the file at `path`, one per line:
+ *     <name> <byte> [<byte> ...]
+ * where a byte is two hexadecimal digits, or `??` (or `?`) for any byte.
+ * Empty lines and lines starting with `#` are skipped. The id of a
+ * signature is its index in the file, from 0.
+ */
+sm_sigset_t *sm_sigset_load(const char *path);
+void sm_sigset_free(sm_sigset_t *set);
+
+size_t sm_sigset_count(const sm_sigset_t *set);
+const char *sm_sigset_name(const sm_sigset_t *set, size_t id);
+
+/*
+ * Return the id of the first signature matching the start of the `size`
+ * bytes of `data`, and its length in `length`, or -1 if none matches.
+ * Only the signatures whose key is found by the automaton are checked.
+ */
+long sm_sigset_match(sm_sigset_t *set, const uint8_t *data, size_t size, size_t *length);
+
+/*
+ * Record that the match at `address` is the signature of the last call of
+ * sm_sigset_match(). The addresses must be recorded in increasing order.
+ */
+bool sm_sigset_record(sm_sigset_t *set, const void *address);
+
+/* the id of the signature recorded at `address`, or -1 */
+long sm_sigset_lookup(const sm_sigset_t *set, const void *address);
+
+/*
+ * Prepare to search a buffer of `size` bytes with sm_sigset_next(), whose
+ * calls must then have increasing `from`. The set keeps the state of the
+ * search, so it must not be used by several threads at once.
+ */
+bool sm_sigset_begin(sm_sigset_t *set, size_t size);
+
+/*
+ * Return the offset of the first match in the `size` bytes of `data` which
+ * starts in [from, limit), or `limit` if there is none.
+ */
+size_t sm_sigset_next(sm_sigset_t *set, const uint8_t *data, size_t size,
+                      size_t from, size_t limit);
+
+#endif /* SIGNATURES_H */
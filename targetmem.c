@@ -157,10 +157,22 @@ matches_and_old_values_array *
 delete_in_address_range (matches_and_old_values_array *array,
                          unsigned long *num_matches,
                          char *start_address, char *end_address)
+{
+    address_range_t range = { start_address, end_address };
+
+    return delete_in_address_ranges(array, num_matches, &range, 1);
+}
+
+/* deletes matches in any of the `count` sorted and disjoint `ranges`, in one pass */
+matches_and_old_values_array *
+delete_in_address_ranges (matches_and_old_values_array *array,
+                          unsigned long *num_matches,
+                          const address_range_t *ranges, size_t count)
 {
     assert(array);
 
     size_t reading_iterator = 0;
+    size_t range_index = 0;
     matches_and_old_values_swath *reading_swath_index = array->swaths;
 
     matches_and_old_values_swath reading_swath = *reading_swath_index;
@@ -175,7 +187,11 @@ delete_in_address_range (matches_and_old_values_array *array,
     while (reading_swath.first_byte_in_child) {
         char *address = reading_swath.first_byte_in_child + reading_iterator;
 
-        if (address < start_address || address >= end_address) {
+        /* skip the ranges before this address */
+        while (range_index < count && ranges[range_index].end <= address)
+            ++range_index;
+
+        if (range_index == count || address < ranges[range_index].start) {
             old_value_and_match_info old_byte;
 
             old_byte = reading_swath_index->data[reading_iterator];
@@ -67,6 +67,12 @@ typedef struct {
     size_t index;
 } match_location;
 
+/* The addresses in [start, end) */
+typedef struct {
+    char *start;
+    char *end;
+} address_range_t;
+
 
 /* Public functions */
 
@@ -94,6 +100,12 @@ delete_in_address_range (matches_and_old_values_array *array,
                          unsigned long *num_matches,
                          char *start_address, char *end_address);
 
+/* deletes matches in any of the `count` sorted and disjoint `ranges`, in one pass */
+matches_and_old_values_array *
+delete_in_address_ranges (matches_and_old_values_array *array,
+                          unsigned long *num_matches,
+                          const address_range_t *ranges, size_t count);
+
 /* The following functions are called in the hot scanning path and were moved
    to this header from the .c file so that they could be inlined */
 
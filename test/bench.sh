@@ -0,0 +1,103 @@
+#!/bin/bash
+#
+# Time scanmem on memfake: snapshot, searches and rescans for every data
+# type, list and set. Run with `make bench`.
+#
+# usage: bench.sh [<results> [<baseline>]]
+#
+# The results are written to <results> (bench.results by default), one line
+# per step:
+#     <type>.<step> <seconds> <bytes/s> <matches> <matches/s> <peak RSS in kB>
+# where bytes/s counts the bytes of the regions searched, and matches the
+# matches after the step. If <baseline> (bench.baseline by default) exists,
+# the bytes/s are compared to it and the exit status is 1 if a step is more
+# than BENCH_TOLERANCE percent slower. To keep a baseline:
+#     cp bench.results bench.baseline
+#
+# memfake is set with BENCH_MB (256), BENCH_MAPPINGS (16), BENCH_DIST (small)
+# and BENCH_MUTATION (0, percent of the values changed every second).
+
+set -e
+
+results=${1:-bench.results}
+baseline=${2:-bench.baseline}
+tolerance=${BENCH_TOLERANCE:-10}
+
+./memfake -n "${BENCH_MAPPINGS:-16}" -d "${BENCH_DIST:-small}" -u "${BENCH_MUTATION:-0}" \
+    "${BENCH_MB:-256}" &
+memfake_pid=$!
+trap 'kill $memfake_pid; wait' EXIT
+sleep 1
+
+# a line `@mark <step> <ns> VmHWM: <kB> kB` after each step
+mark () {
+    echo "shell echo @mark $1 \$(date +%s%N) \$(grep VmHWM /proc/\$PPID/status)"
+}
+
+# run the steps of a data type, as `<step>=<commands>` arguments
+bench_type () {
+    local type=$1 cmds="option scan_data_type $1;lregions;$(mark start)"
+    shift
+    for step in "$@"; do
+        cmds+=";${step#*=};$(mark "${step%%=*}")"
+    done
+    PAGER=cat ../scanmem -p $memfake_pid -c "${cmds};exit" 2>&1 </dev/null |
+        awk -v type="$type" '
+            /^\[ *[0-9]+\]/ && match($0, /[0-9]+ bytes,/) {
+                bytes += substr($0, RSTART, RLENGTH - 7)
+            }
+            match($0, /we currently have [0-9]+ matches/) {
+                matches = substr($0, RSTART + 18, RLENGTH - 26)
+            }
+            /^error:/ { print type ": " $0 > "/dev/stderr" }
+            $1 == "@mark" {
+                if ($2 != "start") {
+                    s = ($3 - last) / 1e9
+                    printf "%s.%s\t%.6f\t%.0f\t%d\t%.0f\t%d\n", type, $2, s,
+                           (s > 0) ? bytes / s : 0, matches, (s > 0) ? matches / s : 0, $5
+                }
+                last = $3
+            }'
+}
+
+common_steps=(
+    "snapshot=snapshot"
+    "rescan_notchanged=="
+    "rescan_increased=>"
+)
+int_steps=("search_range=reset;1..100" "search_equal=reset;1" "list=list" "set=set 1" "rescan_equal=1")
+# memfake's values are integers, the floats they make are mostly denormals;
+# set keeps away from the matches at the end of a region
+float_steps=("search_range=reset;1..100" "search_equal=reset;0" "list=list" "set=set ..999=0" "rescan_equal=0")
+
+{
+    printf "# step\tseconds\tbytes/s\tmatches\tmatches/s\tpeak_rss_kb\n"
+    for type in int8 int16 int32 int64; do
+        bench_type $type "${common_steps[@]}" "${int_steps[@]}"
+    done
+    for type in float32 float64; do
+        bench_type $type "${common_steps[@]}" "${float_steps[@]}"
+    done
+    for type in int number; do
+        bench_type $type "snapshot=snapshot" "rescan_notchanged==" "search_anyof=reset;{1,2,3}"
+    done
+    bench_type bytearray "search_bytes=01 00 00 00" "search_wildcard=reset;01 ?? 00 00"
+    bench_type string "search_string=\" scanmem"
+} > "$results"
+
+cat "$results"
+
+if [ -f "$baseline" ]; then
+    echo
+    echo "compared to $baseline:"
+    awk -v tolerance="$tolerance" '
+        /^#/ { next }
+        NR == FNR { old[$1] = $3; next }
+        $1 in old && old[$1] > 0 {
+            change = ($3 - old[$1]) * 100 / old[$1]
+            printf "%-32s %+7.1f%%%s\n", $1, change, change < -tolerance ? " SLOWER" : ""
+            if (change < -tolerance)
+                slower++
+        }
+        END { exit slower > 0 }' "$baseline" "$results"
+fi
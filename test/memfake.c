@@ -17,36 +17,127 @@
     along with this library.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+/*
+ * usage: memfake [-n <mappings>] [-d <distribution>] [-u <percent>] [<MB> [<random>]]
+ *
+ * Allocate <MB> megabytes, in <mappings> separate mappings if given, and
+ * fill them with values of a distribution:
+ *     zero    - only zeroes (the default)
+ *     random  - half of random values, half of zeroes (as with <random> = 1)
+ *     small   - values from 0 to 255
+ *     sparse  - one value from 1 to 255 every 100 values, zeroes elsewhere
+ * With -u, <percent> of the values are incremented every second.
+ */
+
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
+
+typedef enum { DIST_ZERO, DIST_RANDOM, DIST_SMALL, DIST_SPARSE } distribution_t;
+
+static void fill(int *array, size_t size, distribution_t dist)
+{
+    size_t i;
+
+    switch (dist) {
+    case DIST_ZERO:
+        break;
+    case DIST_RANDOM:
+        // Fill half with random values and leave an half of zeroes
+        for (i = 0; i < size/2; i++)
+            array[i] = rand();
+        break;
+    case DIST_SMALL:
+        for (i = 0; i < size; i++)
+            array[i] = rand() & 0xff;
+        break;
+    case DIST_SPARSE:
+        for (i = 0; i < size; i += 100)
+            array[i] = 1 + rand() % 255;
+        break;
+    }
+}
 
 int main(int argc, char **argv)
 {
     uint MB_to_allocate = 1;
-    bool add_randomness = false;
+    unsigned mappings = 0;
+    double mutation_rate = 0;
+    distribution_t dist = DIST_ZERO;
+    int **arrays;
+    size_t array_size, page_size = sysconf(_SC_PAGESIZE);
+    unsigned i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:d:u:")) != -1) {
+        switch (opt) {
+        case 'n':
+            mappings = atoi(optarg);
+            break;
+        case 'd':
+            if (strcmp(optarg, "zero") == 0) dist = DIST_ZERO;
+            else if (strcmp(optarg, "random") == 0) dist = DIST_RANDOM;
+            else if (strcmp(optarg, "small") == 0) dist = DIST_SMALL;
+            else if (strcmp(optarg, "sparse") == 0) dist = DIST_SPARSE;
+            else return 1;
+            break;
+        case 'u':
+            mutation_rate = atof(optarg) / 100;
+            break;
+        default:
+            return 1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
 
     if (argc >= 2) MB_to_allocate = atoi(argv[1]);
-    if (argc >= 3) add_randomness = atoi(argv[2]);
+    if (argc >= 3 && atoi(argv[2])) dist = DIST_RANDOM;
     if (argc >= 4) return 1;
 
-    size_t array_size = MB_to_allocate * 1024 * 1024 / sizeof(int);
-
-    int* array = calloc(array_size, sizeof(int));
+    srand(time(NULL));
 
-    // Fill half with random values and leave an half of zeroes, if asked to
-    if (add_randomness) {
-        srand(time(NULL));
-        for (size_t i = 0; i < array_size/2; i++) {
-            array[i] = rand();
+    if (mappings == 0) {
+        // one calloc'ed array
+        array_size = MB_to_allocate * 1024UL * 1024 / sizeof(int);
+        arrays = calloc(1, sizeof(int *));
+        if (arrays == NULL || (arrays[0] = calloc(array_size, sizeof(int))) == NULL)
+            return 1;
+        fill(arrays[0], array_size, dist);
+        mappings = 1;
+    } else {
+        // separate mappings, kept apart by an inaccessible page
+        size_t bytes = (MB_to_allocate * 1024UL * 1024 / mappings + page_size - 1) & ~(page_size - 1);
+        array_size = bytes / sizeof(int);
+        if ((arrays = calloc(mappings, sizeof(int *))) == NULL)
+            return 1;
+        for (i = 0; i < mappings; i++) {
+            char *p = mmap(NULL, bytes + page_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED || mprotect(p + bytes, page_size, PROT_NONE) == -1)
+                return 1;
+            arrays[i] = (int *) p;
+            fill(arrays[i], array_size, dist);
         }
     }
 
-    pause();
+    if (mutation_rate <= 0)
+        pause();
+
+    for (;;) {
+        size_t changes = mutation_rate * array_size;
+
+        sleep(1);
+        for (i = 0; i < mappings; i++) {
+            size_t c;
+            for (c = 0; c < changes; c++)
+                arrays[i][(size_t) rand() % array_size]++;
+        }
+    }
 
-    free(array);
     return 0;
 }
-
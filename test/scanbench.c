@@ -0,0 +1,538 @@
+/*
+    Time the scan routines of libscanmem without a target
+
+    Copyright (C) 2017           Scanmem authors
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * usage: scanbench [-s <MB>] [-d <percent>] [-r <repeats>]
+ *
+ * Run every scan routine, for each data type, match type and endianness,
+ * over <MB> megabytes (4 by default) of random bytes where <percent> (1)
+ * of the 8-byte slots hold 42, as one of the number types in either
+ * endianness, or a byte pattern. The routines are called at every offset,
+ * as sm_searchregions() and sm_checkmatches() do, the best time of
+ * <repeats> (1) runs is printed, one line per combination:
+ *     <data type> <match type> <endianness> <ns/byte> <matches>
+ * Then the routines which must agree are cross-checked: the reversed
+ * endianness ones on a buffer with its values swapped, the ones of every
+ * data type with those of `number`, and the byte array and string ones
+ * with sm_bytesearch_next(). The exit status is 1 if they don't.
+ */
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bytesearch.h"
+#include "endianness.h"
+#include "scanroutines.h"
+#include "value.h"
+
+#define VALUE (42)
+#define PATTERN_SIZE (16)
+
+static const char pattern[PATTERN_SIZE] = "scanmem-bench-42";
+
+static const struct {
+    const char *name;
+    scan_data_type_t type;
+    match_flags flags;          /* of a snapshot */
+} number_types[] = {
+    { "number",  ANYNUMBER,  flags_all },
+    { "int",     ANYINTEGER, flags_integer },
+    { "float",   ANYFLOAT,   flags_float },
+    { "int8",    INTEGER8,   flags_i8b },
+    { "int16",   INTEGER16,  flags_i16b },
+    { "int32",   INTEGER32,  flags_i32b },
+    { "int64",   INTEGER64,  flags_i64b },
+    { "float32", FLOAT32,    flag_f32b },
+    { "float64", FLOAT64,    flag_f64b },
+};
+#define NUMBER_TYPES (sizeof(number_types) / sizeof(number_types[0]))
+
+static const struct {
+    const char *name;
+    scan_match_type_t type;
+    bool old;                   /* compared with the old values */
+} match_types[] = {
+    { "any",         MATCHANY,         false },
+    { "equalto",     MATCHEQUALTO,     false },
+    { "notequalto",  MATCHNOTEQUALTO,  false },
+    { "greaterthan", MATCHGREATERTHAN, false },
+    { "lessthan",    MATCHLESSTHAN,    false },
+    { "range",       MATCHRANGE,       false },
+    { "anyof",       MATCHANYOF,       false },
+    { "ulps",        MATCHWITHINULPS,  false },
+    { "update",      MATCHUPDATE,      true },
+    { "notchanged",  MATCHNOTCHANGED,  true },
+    { "changed",     MATCHCHANGED,     true },
+    { "increased",   MATCHINCREASED,   true },
+    { "decreased",   MATCHDECREASED,   true },
+    { "increasedby", MATCHINCREASEDBY, true },
+    { "decreasedby", MATCHDECREASEDBY, true },
+};
+#define MATCH_TYPES (sizeof(match_types) / sizeof(match_types[0]))
+
+/* the lengths of the byte patterns searched */
+static const size_t pattern_lengths[] = { 1, 2, 3, 4, 5, 8, 12, 16 };
+#define PATTERN_LENGTHS (sizeof(pattern_lengths) / sizeof(pattern_lengths[0]))
+
+static uint8_t *data, *old, *swapped;
+static size_t size;
+static unsigned mismatches;
+
+/* the same bytes on every run */
+static uint64_t next_random(void)
+{
+    static uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1dULL;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* write `value` at `p` as the number type `t`, swapped if `reverse` */
+static void put_number(uint8_t *p, unsigned t, int64_t value, bool reverse)
+{
+    value_t v;
+    size_t width = flags_to_memlength(number_types[t].type, number_types[t].flags);
+
+    switch (number_types[t].type) {
+    case FLOAT32:
+        v.float32_value = value;
+        break;
+    case FLOAT64:
+        v.float64_value = value;
+        break;
+    default:
+        /* the low bytes on little endian hosts */
+        v.int64_value = value;
+        if (big_endian)
+            memmove(v.bytes, v.bytes + sizeof(v.bytes) - width, width);
+        break;
+    }
+    if (reverse && width > 1)
+        swap_bytes_var(v.bytes, width);
+    memcpy(p, v.bytes, width);
+}
+
+/*
+ * Fill the buffers: random bytes, where a slot in 100/<percent> holds
+ * VALUE in `data` and VALUE-1 in `old`, or the pattern in both. `swapped`
+ * is left for swap_buffer().
+ */
+static bool fill_buffers(double percent)
+{
+    size_t slot;
+
+    /* the routines read up to 8 bytes at the last offsets */
+    if ((data = calloc(size + 8, 1)) == NULL || (old = calloc(size + 8, 1)) == NULL ||
+        (swapped = calloc(size + 8, 1)) == NULL)
+        return false;
+
+    for (slot = 0; slot + 8 <= size; slot += 8) {
+        uint64_t r = next_random();
+        memcpy(data + slot, &r, 8);
+    }
+    memcpy(old, data, size);
+
+    for (slot = 0; slot + PATTERN_SIZE <= size; slot += 8) {
+        unsigned kind;
+
+        if (next_random() % 10000 >= percent * 100)
+            continue;
+        kind = next_random() % (2 * (NUMBER_TYPES - 3) + 1);
+        if (kind == 2 * (NUMBER_TYPES - 3)) {
+            memcpy(data + slot, pattern, PATTERN_SIZE);
+            memcpy(old + slot, pattern, PATTERN_SIZE);
+        } else {
+            /* the fixed width types follow number, int and float */
+            put_number(data + slot, 3 + kind / 2, VALUE, kind % 2);
+            put_number(old + slot, 3 + kind / 2, VALUE - 1, kind % 2);
+        }
+    }
+    return true;
+}
+
+/* copy `data` to `swapped`, with the bytes of every value of `width` swapped */
+static void swap_buffer(size_t width)
+{
+    size_t offset;
+
+    memcpy(swapped, data, size);
+    for (offset = 0; offset + width <= size; offset += width)
+        swap_bytes_var(swapped + offset, width);
+}
+
+/* small positive values fit in every type */
+static void number_uservalue(uservalue_t *val, int64_t value)
+{
+    memset(val, 0, sizeof(*val));
+    val->flags = flags_all;
+    val->int8_value = value;
+    val->uint8_value = value;
+    val->int16_value = value;
+    val->uint16_value = value;
+    val->int32_value = value;
+    val->uint32_value = value;
+    val->int64_value = value;
+    val->uint64_value = value;
+    val->float32_value = value;
+    val->float64_value = value;
+}
+
+#define SET_VALUES(field, type) \
+    static type field##_values[] = { 1, 7, VALUE, 100 }; \
+    set->values[VALUESET_INDEX(field)] = field##_values; \
+    set->counts[VALUESET_INDEX(field)] = sizeof(field##_values) / sizeof(type);
+
+/* the user values of a match type: VALUE, or a range, set or ulps around it */
+static void match_uservalue(uservalue_t val[2], scan_match_type_t mt)
+{
+    static valueset_t valueset;
+    valueset_t *set = &valueset;
+
+    switch (mt) {
+    case MATCHRANGE:
+        number_uservalue(&val[0], VALUE - 2);
+        number_uservalue(&val[1], VALUE + 2);
+        break;
+    case MATCHANYOF:
+        SET_VALUES(u8b, uint8_t)
+        SET_VALUES(s8b, int8_t)
+        SET_VALUES(u16b, uint16_t)
+        SET_VALUES(s16b, int16_t)
+        SET_VALUES(u32b, uint32_t)
+        SET_VALUES(s32b, int32_t)
+        SET_VALUES(u64b, uint64_t)
+        SET_VALUES(s64b, int64_t)
+        SET_VALUES(f32b, float)
+        SET_VALUES(f64b, double)
+        number_uservalue(&val[0], VALUE);
+        val[0].set_value = set;
+        break;
+    case MATCHWITHINULPS:
+        number_uservalue(&val[0], VALUE);
+        number_uservalue(&val[1], 2);
+        break;
+    case MATCHINCREASEDBY:
+    case MATCHDECREASEDBY:
+        number_uservalue(&val[0], 1);
+        break;
+    default:
+        number_uservalue(&val[0], VALUE);
+        break;
+    }
+}
+
+/*
+ * Call `routine` at every offset of `buf`, as sm_searchregions() does, or
+ * with the values of `old` as sm_checkmatches() does after a snapshot with
+ * `old_flags`. The flags are stored in `flags` if not NULL, the number of
+ * matches is returned.
+ */
+static size_t scan(scan_routine_t routine, const uint8_t *buf, match_flags old_flags,
+                   size_t old_length, const uservalue_t *uval, match_flags *flags)
+{
+    size_t offset, matches = 0;
+
+    for (offset = 0; offset < size; offset++) {
+        size_t memlength = size - offset;
+        match_flags checkflags = flags_empty;
+        value_t old_val;
+
+        if (old_flags != flags_empty) {
+            memcpy(old_val.bytes, old + offset, sizeof(old_val.bytes));
+            old_val.flags = old_flags;
+            if (memlength > old_length)
+                memlength = old_length;
+        }
+        if (routine((const mem64_t *)(buf + offset), memlength,
+                    (old_flags != flags_empty) ? &old_val : NULL, uval, &checkflags) > 0)
+            matches++;
+        if (flags)
+            flags[offset] = checkflags;
+    }
+    return matches;
+}
+
+static void report(const char *type, const char *match, const char *endianness,
+                   double ns, size_t matches)
+{
+    printf("%s\t%s\t%s\t%.3f\t%zu\n", type, match, endianness, ns / size, matches);
+}
+
+/* the first difference between two scans, if any */
+static void compare(const char *what, const match_flags *a, const match_flags *b,
+                    match_flags mask, size_t step, size_t width)
+{
+    size_t offset;
+
+    for (offset = 0; offset + width <= size; offset += step) {
+        if ((a[offset] & mask) != b[offset]) {
+            fprintf(stderr, "mismatch: %s at offset %zu: %#x != %#x\n",
+                    what, offset, a[offset] & mask, b[offset]);
+            mismatches++;
+            return;
+        }
+    }
+}
+
+static void bench_numbers(unsigned repeats)
+{
+    unsigned m, t, r;
+    int reverse;
+
+    for (m = 0; m < MATCH_TYPES; m++) {
+        uservalue_t val[2];
+        scan_match_type_t mt = match_types[m].type;
+
+        match_uservalue(val, mt);
+        for (t = 0; t < NUMBER_TYPES; t++) {
+            match_flags old_flags = match_types[m].old ? number_types[t].flags : flags_empty;
+            size_t old_length = flags_to_memlength(number_types[t].type, number_types[t].flags);
+            scan_routine_t native = sm_find_scanroutine(number_types[t].type, mt, val, false);
+
+            for (reverse = 0; reverse <= 1; reverse++) {
+                scan_routine_t routine = sm_find_scanroutine(number_types[t].type, mt, val, reverse);
+                double best = 0;
+                size_t matches = 0;
+
+                /* only the matches with a user value depend on endianness */
+                if (routine == NULL || (reverse && routine == native))
+                    continue;
+                for (r = 0; r < repeats; r++) {
+                    double start = now(), ns;
+
+                    matches = scan(routine, data, old_flags, old_length, val, NULL);
+                    ns = now() - start;
+                    if (r == 0 || ns < best)
+                        best = ns;
+                }
+                report(number_types[t].name, match_types[m].name,
+                       reverse ? "reversed" : "native", best, matches);
+            }
+        }
+    }
+}
+
+/* every data type against number, in both endiannesses */
+static void check_number_types(match_flags *flags, match_flags *other)
+{
+    unsigned m, t;
+    int reverse;
+    char what[128];
+
+    for (m = 0; m < MATCH_TYPES; m++) {
+        uservalue_t val[2];
+        scan_match_type_t mt = match_types[m].type;
+
+        match_uservalue(val, mt);
+        for (reverse = 0; reverse <= 1; reverse++) {
+            scan_routine_t number = sm_find_scanroutine(ANYNUMBER, mt, val, reverse);
+
+            if (number == NULL)
+                continue;
+            scan(number, data, match_types[m].old ? flags_all : flags_empty, 8, val, flags);
+            for (t = 1; t < NUMBER_TYPES; t++) {
+                scan_routine_t routine = sm_find_scanroutine(number_types[t].type, mt, val, reverse);
+                match_flags old_flags = match_types[m].old ? number_types[t].flags : flags_empty;
+
+                if (routine == NULL)
+                    continue;
+                scan(routine, data, old_flags,
+                     flags_to_memlength(number_types[t].type, number_types[t].flags), val, other);
+                snprintf(what, sizeof(what), "number and %s %s %s", number_types[t].name,
+                         match_types[m].name, reverse ? "reversed" : "native");
+                compare(what, flags, other, number_types[t].flags, 1, 1);
+            }
+        }
+    }
+}
+
+/* the reversed routines on the swapped values, against the native ones */
+static void check_endianness(match_flags *flags, match_flags *other)
+{
+    unsigned m, t;
+    char what[128];
+
+    for (t = 4; t < NUMBER_TYPES; t++) {
+        size_t width = flags_to_memlength(number_types[t].type, number_types[t].flags);
+
+        swap_buffer(width);
+        for (m = 0; m < MATCH_TYPES; m++) {
+            uservalue_t val[2];
+            scan_routine_t native, reversed;
+
+            match_uservalue(val, match_types[m].type);
+            native = sm_find_scanroutine(number_types[t].type, match_types[m].type, val, false);
+            reversed = sm_find_scanroutine(number_types[t].type, match_types[m].type, val, true);
+            if (native == NULL || reversed == native)
+                continue;
+            scan(native, data, flags_empty, 0, val, flags);
+            scan(reversed, swapped, flags_empty, 0, val, other);
+            snprintf(what, sizeof(what), "native and reversed %s %s", number_types[t].name,
+                     match_types[m].name);
+            compare(what, flags, other, flags_max, width, width);
+        }
+    }
+}
+
+/*
+ * Byte arrays, with a wildcard in the middle if `wildcards`, and strings:
+ * time the routines at every offset and the whole-buffer search, and check
+ * that they find the same matches.
+ */
+static void bench_patterns(unsigned repeats, match_flags *flags, match_flags *other)
+{
+    uint8_t bytes[PATTERN_SIZE];
+    wildcard_t wildcards[PATTERN_SIZE];
+    unsigned l, v, r;
+    char type[32], what[128];
+
+    memcpy(bytes, pattern, PATTERN_SIZE);
+    for (l = 0; l < PATTERN_LENGTHS; l++) {
+        size_t length = pattern_lengths[l];
+
+        for (v = 0; v < 3; v++) {
+            uservalue_t val;
+            scan_routine_t routine;
+            sm_bytesearch_t *searcher;
+            double best = 0;
+            size_t matches = 0, offset;
+
+            memset(&val, 0, sizeof(val));
+            memset(wildcards, FIXED, sizeof(wildcards));
+            val.flags = length;
+            if (v == 2) {
+                val.string_value = pattern;
+                snprintf(type, sizeof(type), "string[%zu]", length);
+            } else {
+                if (v == 1) {
+                    if (length < 3)
+                        continue;
+                    wildcards[length / 2] = WILDCARD;
+                    bytes[length / 2] = 0;
+                }
+                val.bytearray_value = bytes;
+                val.wildcard_value = wildcards;
+                snprintf(type, sizeof(type), "bytearray[%zu]%s", length, v ? "?" : "");
+            }
+            routine = sm_find_scanroutine(v == 2 ? STRING : BYTEARRAY, MATCHEQUALTO, &val, false);
+
+            for (r = 0; r < repeats; r++) {
+                double start = now(), ns;
+
+                matches = scan(routine, data, flags_empty, 0, &val, NULL);
+                ns = now() - start;
+                if (r == 0 || ns < best)
+                    best = ns;
+            }
+            report(type, "equalto", "-", best, matches);
+
+            if ((searcher = sm_bytesearch_new(v == 2 ? (const uint8_t *) pattern : bytes,
+                                              v == 2 ? NULL : wildcards, length)) == NULL) {
+                fprintf(stderr, "error: sm_bytesearch_new() failed\n");
+                mismatches++;
+                return;
+            }
+            for (r = 0; r < repeats; r++) {
+                double start = now(), ns;
+
+                matches = 0;
+                for (offset = 0; (offset = sm_bytesearch_next(searcher, data, size, offset, size)) < size; offset++)
+                    matches++;
+                ns = now() - start;
+                if (r == 0 || ns < best)
+                    best = ns;
+            }
+            report(type, "search", "-", best, matches);
+
+            /* the search finds the offsets where the routine matches */
+            scan(routine, data, flags_empty, 0, &val, flags);
+            memset(other, 0, size * sizeof(match_flags));
+            for (offset = 0; (offset = sm_bytesearch_next(searcher, data, size, offset, size)) < size; offset++)
+                other[offset] = length;
+            sm_bytesearch_free(searcher);
+            snprintf(what, sizeof(what), "%s routine and search", type);
+            compare(what, flags, other, flags_max, 1, 1);
+
+            if (v == 1)
+                bytes[length / 2] = pattern[length / 2];
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned MB = 4, repeats = 1;
+    double percent = 1;
+    match_flags *flags, *other;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:d:r:")) != -1) {
+        switch (opt) {
+        case 's':
+            MB = atoi(optarg);
+            break;
+        case 'd':
+            percent = atof(optarg);
+            break;
+        case 'r':
+            repeats = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s <MB>] [-d <percent>] [-r <repeats>]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (MB == 0 || repeats == 0) {
+        fprintf(stderr, "usage: %s [-s <MB>] [-d <percent>] [-r <repeats>]\n", argv[0]);
+        return 1;
+    }
+
+    size = MB * 1024UL * 1024;
+    if (!fill_buffers(percent) ||
+        (flags = calloc(size, sizeof(match_flags))) == NULL ||
+        (other = calloc(size, sizeof(match_flags))) == NULL) {
+        fprintf(stderr, "error: can't allocate %u MB buffers\n", MB);
+        return 1;
+    }
+
+    printf("# type\tmatch\tendianness\tns/byte\tmatches\n");
+    bench_numbers(repeats);
+    bench_patterns(repeats, flags, other);
+    check_number_types(flags, other);
+    check_endianness(flags, other);
+    printf("# cross-check: %u mismatches\n", mismatches);
+
+    return mismatches > 0;
+}
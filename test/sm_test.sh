@@ -17,9 +17,45 @@ test_sm "option scan_data_type int8;snapshot;exit"
 test_sm "option scan_data_type int8;snapshot;1;exit"
 test_sm "option scan_data_type int8;1;delete 0;1;exit"
 
+# first writable mapping of memfake, for raw memory access tests
+rw_addr=$(awk '$2 ~ /^rw/ { split($1, a, "-"); print a[1]; exit }' /proc/$memfake_pid/maps)
+
+test_sm "mdump ${rw_addr} 16 ${rw_addr} 4 0 8;exit"
+test_sm "pointerscan ${rw_addr} depth=2;exit"
+test_sm "pointers_to ${rw_addr}-ffffffffffff;pointers_to ${rw_addr};exit"
+
+ptr_files=$(mktemp -d)
+test_sm "pointerscan ${rw_addr} ${ptr_files}/chains;savepointermap ${ptr_files}/map;filterchains ${rw_addr} ${ptr_files}/chains map=${ptr_files}/map;exit"
+# chains from a module with a space in its name, to a pointer to itself
+cp memfake "${ptr_files}/mem fake"
+"${ptr_files}/mem fake" 1 &
+spaced_pid=$!
+sleep 1
+spaced_range=$(awk '/mem fake$/ { split($1, a, "-"); if (!s) s = a[1]; e = a[2] } END { print s "-" e }' /proc/$spaced_pid/maps)
+self_ptr=$(../scanmem -p $spaced_pid -e -c "pointers_to ${spaced_range};exit" | awk '$(NF-2) == $NF { print $NF; exit }')
+../scanmem -p $spaced_pid -e -c "pointerscan ${self_ptr} depth=1 ${ptr_files}/chains;savepointermap ${ptr_files}/map;filterchains ${self_ptr} ${ptr_files}/chains map=${ptr_files}/map;exit" 2>&1 |
+    grep "^info: [1-9][0-9]* of [0-9]* pointer chains kept"
+../scanmem -p $spaced_pid -e -c "option scan_data_type int8;0;savematches ${ptr_files}/matches;reset;loadmatches ${ptr_files}/matches;exit" 2>&1 |
+    grep "^info: [1-9][0-9]* matches loaded, 0 outside"
+kill $spaced_pid
+rm -rf "$ptr_files"
+
+test_sm "group int32:0 +4 int16:0 +8 int64:0;group int32:0 float:0..1 within 16;exit"
+# two fields at the same offset are refused
+test_sm "group int32:0 +0 int16:0;exit" && exit 1
+
+test_sm "option scan_data_type int32;{0,1,2};{0, 3};exit"
+test_sm "option scan_data_type float32;{1,nan};exit" && exit 1
+# a value split by a space is refused, not glued
+test_sm "option scan_data_type int32;{1 2};exit" && exit 1
 test_sm "option scan_data_type int;1;exit"
 test_sm "option scan_data_type float;1;exit"
+test_sm "option scan_data_type float;~0.5;0+-1;option float_display_digits 2;~0;0 +- 4ulp;exit"
+test_sm "option scan_data_type float;~ 0.5;0 +- 1;0 +- 4 ulps;exit"
+test_sm "option scan_data_type float;~1 2;exit" && exit 1
+test_sm "option scan_data_type float;1 +- 2 3;exit" && exit 1
 test_sm "option scan_data_type number;1;exit"
+test_sm "option scan_data_type bytearray;7f ?? 4c 46;reset;00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 ?? 00;exit"
 
 huge_bytearray=""
 huge_string=""
@@ -31,6 +67,36 @@ done
 
 test_sm "option scan_data_type bytearray;${huge_bytearray};exit"
 test_sm "option scan_data_type string;\" ${huge_string};exit"
+test_sm "option string_encoding utf16le;option string_case insensitive;\" Scanmem;exit"
+test_sm "regex [a-z]+[0-9]*;regex [a-z]{2,};reset;regex (?:\\x7fELF|lib)[^\\0]?;exit"
+# a negated class excludes both cases of its letters
+test_sm "write string ${rw_addr} scanmemAtest;option string_case insensitive;regex scanmem[^a]test;exit" 2>&1 |
+    grep "^info: we currently have 0 matches"
+test_sm "option string_case insensitive;regex scanmem[^b]test;exit" 2>&1 | grep "^info: we currently have 1 matches"
+
+sig_file=$(mktemp)
+printf '# name bytes\nelf 7f 45 4c 46 ?? 01\nzeroes 00 00 00 00 00 00 00 00 ? 00\n' > "$sig_file"
+test_sm "signatures ${sig_file};signatures ${sig_file};exit"
+PAGER=cat test_sm "signatures ${sig_file};list 1;exit" </dev/null 2>&1 | grep "\[signature 1: zeroes\]"
+# a later scan drops the signatures of the matches
+PAGER=cat test_sm "signatures ${sig_file};00;list 1;exit" </dev/null 2>&1 | grep "\[signature" && exit 1
+rm -f "$sig_file"
+
+test_sm "option scan_data_type int8;1;refresh;1;exit"
+matches_file=$(mktemp)
+test_sm "option scan_data_type int8;0;savematches ${matches_file};retarget ${memfake_pid};reset;loadmatches ${matches_file};exit"
+rm -f "$matches_file"
+test_sm "option region_filter (heap|stack|anon) & perm=r & size<=1G & !path=*libc*;reset;1;option region_filter none;reset;exit"
+image_file=$(mktemp)
+test_sm "saveimage ${image_file};open ${image_file};option scan_data_type int16;0;0;open;pid ${memfake_pid};exit"
+image_after=$(mktemp)
+test_sm "option scan_data_type int32;saveimage ${image_file};saveimage ${image_after};diff ${image_file} ${image_after};diff ${image_file} ${image_after} 0;exit"
+# a value written between the images is in a changed page
+test_sm "option scan_data_type int32;saveimage ${image_file};0;set 0=123456;saveimage ${image_after};diff ${image_file} ${image_after} 0;exit" 2>&1 |
+    grep "^info: [1-9][0-9]* of [0-9]* pages changed"
+rm -f "$image_file" "${image_file}.maps" "$image_after" "${image_after}.maps"
+test_sm "option scan_data_type int32;0;0;set 0=0;stats;stats reset;stats;exit"
+test_sm "option memory_budget 256K;option scan_data_type int32;0;0;snapshot;option memory_budget none;stats;exit"
 
 # Clean up
 kill $memfake_pid
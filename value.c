@@ -28,12 +28,15 @@
 #include <limits.h>
 #include <assert.h>
 #include <string.h>
+#include <strings.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <errno.h>
+#include <math.h>
 #include <inttypes.h> /* for fixed-width formatters */
 
 #include "value.h"
+#include "memregex.h"
 #include "show_message.h"
 
 void valtostr(const value_t *val, char *str, size_t n)
@@ -155,6 +158,7 @@ bool parse_uservalue_bytearray(char *const *argv, unsigned argc, uservalue_t *va
     }
 
     /* everything is ok */
+    zero_uservalue(val);
     val->bytearray_value = bytes_array;
     val->wildcard_value = wildcards_array;
     val->flags = argc;
@@ -255,7 +259,7 @@ bool parse_uservalue_float(const char *nptr, uservalue_t * val)
 
     errno = 0;
     num = strtod(nptr, &endptr);
-    if ((errno != 0) || (*endptr != '\0'))
+    if ((errno != 0) || (endptr == nptr) || (*endptr != '\0'))
         return false;
     
     /* I'm not sure how to distinguish between float and double, but I guess it's not necessary here */
@@ -265,11 +269,419 @@ bool parse_uservalue_float(const char *nptr, uservalue_t * val)
     return true;
 }
 
+/* decode the next code point of an UTF-8 string, -1 if it's not valid */
+static long utf8_next(const unsigned char **str)
+{
+    const unsigned char *s = *str;
+    unsigned len, i;
+    long cp;
+
+    if (s[0] < 0x80)      { cp = s[0];        len = 1; }
+    else if (s[0] < 0xc2) { return -1; }
+    else if (s[0] < 0xe0) { cp = s[0] & 0x1f; len = 2; }
+    else if (s[0] < 0xf0) { cp = s[0] & 0x0f; len = 3; }
+    else if (s[0] < 0xf5) { cp = s[0] & 0x07; len = 4; }
+    else                  { return -1; }
+
+    for (i = 1; i < len; i++) {
+        if ((s[i] & 0xc0) != 0x80)
+            return -1;
+        cp = (cp << 6) | (s[i] & 0x3f);
+    }
+    /* reject overlong forms, surrogates and code points out of range */
+    if ((len == 3 && cp < 0x800) || (len == 4 && (cp < 0x10000 || cp > 0x10ffff)) ||
+        (cp >= 0xd800 && cp <= 0xdfff))
+        return -1;
+    *str = s + len;
+    return cp;
+}
+
+/* append a code unit of `encoding`, folding the case of ASCII letters if there are wildcards */
+static void put_code_unit(uint8_t *bytes, wildcard_t *wildcards, size_t *size,
+                          unsigned unit, string_encoding_t encoding)
+{
+    wildcard_t mask = FIXED;
+    size_t low = *size, high = *size + 1;
+
+    if (wildcards && unit < 0x80 && isalpha(unit)) {
+        mask = CASELESS;
+        unit &= CASELESS;
+    }
+    if (encoding == ENCODING_UTF8) {
+        bytes[*size] = unit;
+        if (wildcards)
+            wildcards[*size] = mask;
+        *size += 1;
+        return;
+    }
+    if (encoding == ENCODING_UTF16BE) {
+        low = *size + 1;
+        high = *size;
+    }
+    bytes[low] = unit & 0xff;
+    bytes[high] = unit >> 8;
+    if (wildcards) {
+        wildcards[low] = mask;
+        wildcards[high] = FIXED;
+    }
+    *size += 2;
+}
+
+bool parse_uservalue_string(const char *str, string_encoding_t encoding, bool ignore_case, uservalue_t *val)
+{
+    const unsigned char *s = (const unsigned char *) str;
+    size_t len = strlen(str), size = 0;
+    uint8_t *bytes = NULL;
+    wildcard_t *wildcards = NULL;
+
+    zero_uservalue(val);
+
+    /* UTF-16 takes at most two bytes for each byte of UTF-8 */
+    if (encoding != ENCODING_UTF8)
+        len *= 2;
+    if ((bytes = malloc(len + 1)) == NULL ||
+        (ignore_case && (wildcards = malloc(len)) == NULL)) {
+        show_error("memory allocation for string failed.\n");
+        goto err;
+    }
+
+    while (*s) {
+        long cp;
+
+        /* UTF-8 strings are taken as they are, valid or not */
+        if (encoding == ENCODING_UTF8) {
+            put_code_unit(bytes, wildcards, &size, *s++, encoding);
+            continue;
+        }
+        if ((cp = utf8_next(&s)) < 0) {
+            show_error("the string is not valid UTF-8.\n");
+            goto err;
+        }
+        if (cp >= 0x10000) {
+            put_code_unit(bytes, wildcards, &size, 0xd800 + ((cp - 0x10000) >> 10), encoding);
+            put_code_unit(bytes, wildcards, &size, 0xdc00 + ((cp - 0x10000) & 0x3ff), encoding);
+        }
+        else {
+            put_code_unit(bytes, wildcards, &size, cp, encoding);
+        }
+    }
+    bytes[size] = '\0';
+
+    if (size > (uint16_t)(-1)) {
+        show_error("String length is limited to %u bytes\n", (uint16_t)(-1));
+        goto err;
+    }
+
+    if (ignore_case) {
+        val->bytearray_value = bytes;
+        val->wildcard_value = wildcards;
+    }
+    else {
+        val->string_value = (const char *) bytes;
+    }
+    val->flags = size;
+    return true;
+
+err:
+    free(bytes);
+    free(wildcards);
+    return false;
+}
+
+/* comparison of the values of each type of a set */
+#define DEFINE_VALUESET_COMPARE(field, type) \
+    static int valueset_compare_##field(const void *a, const void *b) \
+    { \
+        type va = *(const type *)a, vb = *(const type *)b; \
+        return (va > vb) - (va < vb); \
+    }
+
+DEFINE_VALUESET_COMPARE(u8b, uint8_t)
+DEFINE_VALUESET_COMPARE(s8b, int8_t)
+DEFINE_VALUESET_COMPARE(u16b, uint16_t)
+DEFINE_VALUESET_COMPARE(s16b, int16_t)
+DEFINE_VALUESET_COMPARE(u32b, uint32_t)
+DEFINE_VALUESET_COMPARE(s32b, int32_t)
+DEFINE_VALUESET_COMPARE(u64b, uint64_t)
+DEFINE_VALUESET_COMPARE(s64b, int64_t)
+DEFINE_VALUESET_COMPARE(f32b, float)
+DEFINE_VALUESET_COMPARE(f64b, double)
+
+static const struct {
+    size_t size;
+    int (*compare)(const void *, const void *);
+} valueset_types[VALUESET_TYPES] = {
+    [VALUESET_INDEX(u8b)]  = { sizeof(uint8_t),  valueset_compare_u8b  },
+    [VALUESET_INDEX(s8b)]  = { sizeof(int8_t),   valueset_compare_s8b  },
+    [VALUESET_INDEX(u16b)] = { sizeof(uint16_t), valueset_compare_u16b },
+    [VALUESET_INDEX(s16b)] = { sizeof(int16_t),  valueset_compare_s16b },
+    [VALUESET_INDEX(u32b)] = { sizeof(uint32_t), valueset_compare_u32b },
+    [VALUESET_INDEX(s32b)] = { sizeof(int32_t),  valueset_compare_s32b },
+    [VALUESET_INDEX(u64b)] = { sizeof(uint64_t), valueset_compare_u64b },
+    [VALUESET_INDEX(s64b)] = { sizeof(int64_t),  valueset_compare_s64b },
+    [VALUESET_INDEX(f32b)] = { sizeof(float),    valueset_compare_f32b },
+    [VALUESET_INDEX(f64b)] = { sizeof(double),   valueset_compare_f64b },
+};
+
+/* append the value of `uval` to the array of a type, if it can be stored in it */
+#define VALUESET_ADD(set, uval, field, type) \
+    if ((uval)->flags & flag_##field) { \
+        type *values = (set)->values[VALUESET_INDEX(field)]; \
+        values[(set)->counts[VALUESET_INDEX(field)]++] = get_##field(uval); \
+    }
+
+static void free_valueset(valueset_t *set)
+{
+    unsigned i;
+
+    for (i = 0; i < VALUESET_TYPES; i++)
+        free(set->values[i]);
+    free(set);
+}
+
+/* drop the spaces around `str`, in place: false if some are left inside it */
+static bool strip_spaces(char **str)
+{
+    char *end;
+
+    while (isspace(**str))
+        ++*str;
+    end = *str + strlen(*str);
+    while (end > *str && isspace(end[-1]))
+        *--end = '\0';
+    return strpbrk(*str, " \t\r\n\v\f") == NULL;
+}
+
+bool parse_uservalue_set(const char *str, uservalue_t *val)
+{
+    valueset_t *set;
+    char *values, *token, *saveptr;
+    size_t len = strlen(str), nvalues = 1, i;
+    unsigned t;
+
+    zero_uservalue(val);
+    if (len < 2 || str[0] != '{' || str[len - 1] != '}')
+        return false;
+    for (i = 0; i < len; i++)
+        nvalues += (str[i] == ',');
+
+    if ((set = calloc(1, sizeof(valueset_t))) == NULL ||
+        (values = strndup(str + 1, len - 2)) == NULL) {
+        show_error("memory allocation for set failed.\n");
+        free(set);
+        return false;
+    }
+    for (t = 0; t < VALUESET_TYPES; t++) {
+        if ((set->values[t] = malloc(nvalues * valueset_types[t].size)) == NULL) {
+            show_error("memory allocation for set failed.\n");
+            goto err;
+        }
+    }
+
+    for (token = strtok_r(values, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        uservalue_t uval;
+
+        if (!strip_spaces(&token)) {
+            show_error("missing comma in `%s`\n", token);
+            goto err;
+        }
+        if (!parse_uservalue_number(token, &uval)) {
+            show_error("unable to parse number `%s`\n", token);
+            goto err;
+        }
+        /* NaN is unordered, the sorted arrays couldn't be searched */
+        if ((uval.flags & flags_float) && isnan(get_f64b(&uval))) {
+            show_error("a set can't contain `%s`.\n", token);
+            goto err;
+        }
+        VALUESET_ADD(set, &uval, u8b, uint8_t)
+        VALUESET_ADD(set, &uval, s8b, int8_t)
+        VALUESET_ADD(set, &uval, u16b, uint16_t)
+        VALUESET_ADD(set, &uval, s16b, int16_t)
+        VALUESET_ADD(set, &uval, u32b, uint32_t)
+        VALUESET_ADD(set, &uval, s32b, int32_t)
+        VALUESET_ADD(set, &uval, u64b, uint64_t)
+        VALUESET_ADD(set, &uval, s64b, int64_t)
+        VALUESET_ADD(set, &uval, f32b, float)
+        VALUESET_ADD(set, &uval, f64b, double)
+    }
+
+    /* sort and drop the duplicates */
+    for (t = 0; t < VALUESET_TYPES; t++) {
+        size_t size = valueset_types[t].size, n = 0;
+        char *array = set->values[t];
+
+        qsort(array, set->counts[t], size, valueset_types[t].compare);
+        for (i = 0; i < set->counts[t]; i++) {
+            if (n == 0 || memcmp(array + (n - 1) * size, array + i * size, size) != 0)
+                memmove(array + n++ * size, array + i * size, size);
+        }
+        set->counts[t] = n;
+        if (n > 0)
+            val->flags |= 1 << t;
+    }
+
+    free(values);
+    if (val->flags == flags_empty) {
+        show_error("the set is empty.\n");
+        free_valueset(set);
+        return false;
+    }
+    val->set_value = set;
+    return true;
+
+err:
+    free(values);
+    free_valueset(set);
+    return false;
+}
+
+/* the number of decimals written in a number, negative for e.g. `1e3` */
+static int count_decimals(const char *str)
+{
+    const char *dot, *exp;
+    int digits = 0;
+
+    /* hexadecimal floats are not worth the trouble */
+    if (strpbrk(str, "xX"))
+        return 0;
+    exp = strpbrk(str, "eE");
+    if ((dot = strchr(str, '.')) != NULL) {
+        for (dot++; isdigit(*dot); dot++)
+            digits++;
+    }
+    if (exp)
+        digits -= atoi(exp + 1);
+    return digits;
+}
+
+/* set `vals` to the bounds of [lo, hi] for every type which has values in it */
+static void set_range_bounds(double lo, double hi, uservalue_t vals[2])
+{
+    double ilo = ceil(lo), ihi = floor(hi);
+    float flo = (float) lo, fhi = (float) hi;
+
+    zero_uservalue(&vals[0]);
+    zero_uservalue(&vals[1]);
+
+    /* floats: the closest ones inside the bounds */
+    if (flo < lo)
+        flo = nextafterf(flo, INFINITY);
+    if (fhi > hi)
+        fhi = nextafterf(fhi, -INFINITY);
+    if (flo <= fhi) {
+        vals[0].flags |= flag_f32b;
+        set_f32b(&vals[0], flo);
+        set_f32b(&vals[1], fhi);
+    }
+    vals[0].flags |= flag_f64b;
+    set_f64b(&vals[0], lo);
+    set_f64b(&vals[1], hi);
+
+    /* integers: the ones inside the bounds, clamped to the type */
+    if (ilo > ihi)
+        return;
+#define SET_INTEGER_BOUNDS(field, type, min, max) \
+    if (ilo <= (double) (max) && ihi >= (double) (min)) { \
+        vals[0].flags |= flag_##field; \
+        set_##field(&vals[0], (ilo <= (double) (min)) ? (min) : (type) ilo); \
+        set_##field(&vals[1], (ihi >= (double) (max)) ? (max) : (type) ihi); \
+    }
+    SET_INTEGER_BOUNDS(u8b, uint8_t, 0, UINT8_MAX)
+    SET_INTEGER_BOUNDS(s8b, int8_t, INT8_MIN, INT8_MAX)
+    SET_INTEGER_BOUNDS(u16b, uint16_t, 0, UINT16_MAX)
+    SET_INTEGER_BOUNDS(s16b, int16_t, INT16_MIN, INT16_MAX)
+    SET_INTEGER_BOUNDS(u32b, uint32_t, 0, UINT32_MAX)
+    SET_INTEGER_BOUNDS(s32b, int32_t, INT32_MIN, INT32_MAX)
+    SET_INTEGER_BOUNDS(u64b, uint64_t, 0, UINT64_MAX)
+    SET_INTEGER_BOUNDS(s64b, int64_t, INT64_MIN, INT64_MAX)
+#undef SET_INTEGER_BOUNDS
+}
+
+bool parse_uservalue_tolerance(const char *str, int digits, uservalue_t vals[2], bool *ulps)
+{
+    char buf[128];
+    char *val, *sep, *tol, *endptr;
+    size_t seplen;
+    double eps;
+
+    assert(str);
+    assert(vals);
+    assert(ulps);
+
+    *ulps = false;
+    if (strlen(str) >= sizeof(buf))
+        return false;
+    strcpy(buf, str);
+    val = buf;
+    strip_spaces(&val);
+
+    /* ~v: what displays as v */
+    if (val[0] == '~') {
+        ++val;
+        if (!strip_spaces(&val) || !parse_uservalue_float(val, &vals[0]))
+            return false;
+        if (digits < 0)
+            digits = count_decimals(val);
+        eps = 0.5 * pow(10, -digits);
+        set_range_bounds(vals[0].float64_value - eps, vals[0].float64_value + eps, vals);
+        return true;
+    }
+
+    /* v±eps or v±Nulp, the sign may also be written `+-` */
+    if ((sep = strstr(val, "\xc2\xb1")) != NULL)
+        seplen = 2;
+    else if ((sep = strstr(val, "+-")) != NULL)
+        seplen = 2;
+    else
+        return false;
+    tol = sep + seplen;
+    *sep = '\0';
+    if (!strip_spaces(&val))
+        return false;
+    while (isspace(*tol))
+        ++tol;
+
+    errno = 0;
+    endptr = tol + strspn(tol, "0123456789");
+    if (strncasecmp(endptr + strspn(endptr, " \t"), "ulp", 3) == 0) {
+        unsigned long long n = strtoull(tol, &endptr, 10);
+        if (errno != 0 || endptr == tol)
+            return false;
+        endptr += strspn(endptr, " \t");
+        if (strcasecmp(endptr, "ulp") != 0 && strcasecmp(endptr, "ulps") != 0)
+            return false;
+        if (!parse_uservalue_number(val, &vals[0]))
+            return false;
+        /* integers are within N ulps when they are within N */
+        if (vals[0].float64_value != trunc(vals[0].float64_value))
+            vals[0].flags &= flags_float;
+        zero_uservalue(&vals[1]);
+        vals[1].uint64_value = n;
+        *ulps = true;
+        return true;
+    }
+
+    eps = strtod(tol, &endptr);
+    if (errno != 0 || endptr == tol || *endptr != '\0' || !(eps >= 0))
+        return false;
+    if (!parse_uservalue_float(val, &vals[0]))
+        return false;
+    set_range_bounds(vals[0].float64_value - eps, vals[0].float64_value + eps, vals);
+    return true;
+}
+
 void free_uservalue(uservalue_t *uval)
 {
-    /* bytearray arrays are dynamically allocated and have to be freed, strings are not */
+    /* bytearray arrays, groups and regexes are dynamically allocated and have to be freed, strings are not */
     if (uval->bytearray_value)
         free((void*)uval->bytearray_value);
     if (uval->wildcard_value)
         free((void*)uval->wildcard_value);
+    if (uval->group_value)
+        free((void*)uval->group_value);
+    if (uval->set_value)
+        free_valueset((valueset_t*)uval->set_value);
+    if (uval->regex_value)
+        sm_regex_free(uval->regex_value);
 }
@@ -118,12 +118,39 @@ typedef union __attribute__((packed)) {
 
 /* bytearray wildcards: they must be uint8_t. They are ANDed with the incoming
  * memory before the comparison, so that '??' wildcards always return true
- * It's possible to extend them to fully granular wildcard-ing, if needed */
+ * and CASELESS ignores the bit that tells ASCII lower case letters apart */
 typedef enum __attribute__ ((__packed__)) {
     FIXED = 0xffu,
+    CASELESS = 0xdfu,
     WILDCARD = 0x00u,
 } wildcard_t;
 
+/* encodings of the strings searched with the `"` command */
+typedef enum {
+    ENCODING_UTF8,
+    ENCODING_UTF16LE,
+    ENCODING_UTF16BE
+} string_encoding_t;
+
+/* the fields of a group scan, defined in scanroutines.h */
+typedef struct group group_t;
+
+/* the values of a `{v1,v2,...}` set: for each type, sorted and without
+ * duplicates, the values that can be stored in it */
+#define VALUESET_TYPES (10)
+#define VALUESET_INDEX(field) (__builtin_ctz(flag_##field))
+
+typedef struct {
+    void *values[VALUESET_TYPES];     /* indexed by VALUESET_INDEX() */
+    size_t counts[VALUESET_TYPES];
+} valueset_t;
+
+/* a compiled regular expression, see memregex.h */
+typedef struct sm_regex sm_regex_t;
+
+/* a set of byte signatures, see signatures.h */
+typedef struct sm_sigset sm_sigset_t;
+
 /* this struct describes values provided by users */
 typedef struct {
     match_flags flags;
@@ -143,6 +170,12 @@ typedef struct {
     const wildcard_t *wildcard_value;
 
     const char *string_value;
+
+    const group_t *group_value;
+    const valueset_t *set_value;
+
+    sm_regex_t *regex_value;    /* its DFA grows while scanning */
+    sm_sigset_t *sigset_value;  /* not freed with the uservalue */
 } uservalue_t;
 
 /* used when outputting values to user */
@@ -153,6 +186,17 @@ bool parse_uservalue_bytearray(char *const *argv, unsigned argc, uservalue_t *va
 bool parse_uservalue_number(const char *nptr, uservalue_t * val); /* parse int or float */
 bool parse_uservalue_int(const char *nptr, uservalue_t * val);
 bool parse_uservalue_float(const char *nptr, uservalue_t * val);
+/* parse an UTF-8 string into `encoding`, into a bytearray with CASELESS letters
+ * if `ignore_case` is set. It will allocate the string or the arrays itself,
+ * then the string needs to be free'd by the caller, the arrays by `free_uservalue()` */
+bool parse_uservalue_string(const char *str, string_encoding_t encoding, bool ignore_case, uservalue_t *val);
+/* parse a `{v1,v2,...}` set of numbers, it needs to be free'd by `free_uservalue()` */
+bool parse_uservalue_set(const char *str, uservalue_t *val);
+/* parse a number with a tolerance: `~v`, `v±eps` (or `v+-eps`) are parsed into
+ * the bounds of a range in `vals[0]` and `vals[1]`, `v±Nulp` into the value in
+ * `vals[0]` and N in `vals[1].uint64_value`, setting `*ulps`. `~v` allows half
+ * a unit of the last of `digits` decimals, or of those written if negative. */
+bool parse_uservalue_tolerance(const char *str, int digits, uservalue_t vals[2], bool *ulps);
 void free_uservalue(uservalue_t *uval);
 void valcpy(value_t * dst, const value_t * src);
 void uservalue2value(value_t * dst, const uservalue_t * src); /* dst.flags must be set beforehand */